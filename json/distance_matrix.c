@@ -0,0 +1,202 @@
+#include "distance_matrix.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "harvestine_math.h"
+#include "page_alloc.h"
+
+// Columns are padded like those of pairs_t, for the vector kernels.
+#define POINTS_PADDING 8
+
+// Points the columns of points at count, padded to capacity, in columns and
+// fills them in.
+static void fill_points(haversine_points_t *points, double *columns,
+                        size_t capacity, const double *x, const double *y,
+                        int count) {
+  points->sin_half_lat = columns;
+  points->cos_half_lat = columns + capacity;
+  points->sin_half_lon = columns + 2 * capacity;
+  points->cos_half_lon = columns + 3 * capacity;
+  points->cos_lat = columns + 4 * capacity;
+  points->count = count;
+
+  // The angles first, then the kernels replace them with their sines and
+  // cosines in place.
+  for (int i = 0; i < count; i++) {
+    double lat = HARVESTINE_DEGREES_TO_RADIANS * y[i];
+    double lon = HARVESTINE_DEGREES_TO_RADIANS * x[i];
+    points->sin_half_lat[i] = points->cos_half_lat[i] = lat * 0.5;
+    points->sin_half_lon[i] = points->cos_half_lon[i] = lon * 0.5;
+    points->cos_lat[i] = lat;
+  }
+  haversine_kernels.sin(points->sin_half_lat, count, points->sin_half_lat);
+  haversine_kernels.cos(points->cos_half_lat, count, points->cos_half_lat);
+  haversine_kernels.sin(points->sin_half_lon, count, points->sin_half_lon);
+  haversine_kernels.cos(points->cos_half_lon, count, points->cos_half_lon);
+  haversine_kernels.cos(points->cos_lat, count, points->cos_lat);
+}
+
+bool haversine_points_init(haversine_points_t *points, const double *x,
+                           const double *y, int count) {
+  size_t capacity =
+      ((size_t)count + POINTS_PADDING - 1) / POINTS_PADDING * POINTS_PADDING;
+  capacity = capacity == 0 ? POINTS_PADDING : capacity;
+  size_t size = 5 * capacity * sizeof(double);
+  double *columns = page_alloc(size);
+  if (columns == NULL) {
+    return false;
+  }
+  memset(columns, 0, size);
+  fill_points(points, columns, capacity, x, y, count);
+  return true;
+}
+
+void haversine_points_free(haversine_points_t *points) {
+  page_free(points->sin_half_lat);
+  points->sin_half_lat = points->cos_half_lat = NULL;
+  points->sin_half_lon = points->cos_half_lon = points->cos_lat = NULL;
+  points->count = 0;
+}
+
+static haversine_point_t point_at(const haversine_points_t *points, int i) {
+  return (haversine_point_t){
+      points->sin_half_lat[i], points->cos_half_lat[i],
+      points->sin_half_lon[i], points->cos_half_lon[i],
+      points->cos_lat[i],
+  };
+}
+
+haversine_point_t haversine_point_prepare(double x, double y) {
+  double columns[5 * POINTS_PADDING] = {0};
+  haversine_points_t points;
+  fill_points(&points, columns, POINTS_PADDING, &x, &y, 1);
+  return point_at(&points, 0);
+}
+
+// The rows [first_row, end_row) of one thread. out is set for the matrix,
+// nearest and distance for the nearest columns.
+typedef struct {
+  _Alignas(64) const haversine_points_t *rows;
+  const haversine_points_t *columns;
+  int first_row;
+  int end_row;
+  double earth_radius;
+  double *out;
+  size_t stride;
+  int *nearest;
+  double *distance;
+} share_t;
+
+static void run_matrix(const share_t *share) {
+  const haversine_points_t *columns = share->columns;
+  haversine_row_t row = haversine_kernels.row;
+
+  for (int tile = share->first_row; tile < share->end_row;
+       tile += DISTANCE_MATRIX_TILE_ROWS) {
+    int end_tile = share->end_row - tile < DISTANCE_MATRIX_TILE_ROWS
+                       ? share->end_row
+                       : tile + DISTANCE_MATRIX_TILE_ROWS;
+    for (int j = 0; j < columns->count; j += DISTANCE_MATRIX_TILE_COLUMNS) {
+      int n = columns->count - j < DISTANCE_MATRIX_TILE_COLUMNS
+                  ? columns->count - j
+                  : DISTANCE_MATRIX_TILE_COLUMNS;
+      for (int i = tile; i < end_tile; i++) {
+        haversine_point_t point = point_at(share->rows, i);
+        row(&point, columns, j, n, share->earth_radius,
+            share->out + (size_t)i * share->stride + j);
+      }
+    }
+  }
+}
+
+// Only a, which orders the same as the distance, is compared, and the
+// distance taken once per row at the end.
+static void run_nearest(const share_t *share) {
+  const haversine_points_t *columns = share->columns;
+  haversine_row_nearest_t row_nearest = haversine_kernels.row_nearest;
+  double best[DISTANCE_MATRIX_TILE_ROWS];
+
+  for (int tile = share->first_row; tile < share->end_row;
+       tile += DISTANCE_MATRIX_TILE_ROWS) {
+    int end_tile = share->end_row - tile < DISTANCE_MATRIX_TILE_ROWS
+                       ? share->end_row
+                       : tile + DISTANCE_MATRIX_TILE_ROWS;
+    for (int i = tile; i < end_tile; i++) {
+      best[i - tile] = INFINITY;
+      share->nearest[i] = 0;
+    }
+    for (int j = 0; j < columns->count; j += DISTANCE_MATRIX_TILE_COLUMNS) {
+      int n = columns->count - j < DISTANCE_MATRIX_TILE_COLUMNS
+                  ? columns->count - j
+                  : DISTANCE_MATRIX_TILE_COLUMNS;
+      for (int i = tile; i < end_tile; i++) {
+        haversine_point_t point = point_at(share->rows, i);
+        double a;
+        size_t nearest = row_nearest(&point, columns, j, n, &a);
+        // Strictly less, so that earlier tiles win ties.
+        if (a < best[i - tile]) {
+          best[i - tile] = a;
+          share->nearest[i] = (int)nearest;
+        }
+      }
+    }
+    for (int i = tile; i < end_tile; i++) {
+      share->distance[i] =
+          haversine_kernels.from_a(best[i - tile], share->earth_radius);
+    }
+  }
+}
+
+static void *run_share(void *arg) {
+  share_t *share = (share_t *)arg;
+  if (share->out != NULL) {
+    run_matrix(share);
+  } else {
+    run_nearest(share);
+  }
+  return NULL;
+}
+
+// Splits the rows of share into threads contiguous runs and runs them.
+static void run_shares(const share_t *share, int threads) {
+  assert(1 <= threads && threads <= PARALLEL_MAX_THREADS);
+  share_t shares[PARALLEL_MAX_THREADS];
+  int rows = share->rows->count;
+  for (int t = 0; t < threads; t++) {
+    shares[t] = *share;
+    shares[t].first_row = parallel_split(rows, threads, t);
+    shares[t].end_row = parallel_split(rows, threads, t + 1);
+  }
+  run_parallel(shares, sizeof(share_t), threads, run_share);
+}
+
+void distance_matrix(const haversine_points_t *rows,
+                     const haversine_points_t *columns, int threads,
+                     double earth_radius, double *out, size_t stride) {
+  assert(stride >= (size_t)columns->count);
+  share_t share = {
+      .rows = rows,
+      .columns = columns,
+      .earth_radius = earth_radius,
+      .out = out,
+      .stride = stride,
+  };
+  run_shares(&share, threads);
+}
+
+void distance_matrix_nearest(const haversine_points_t *rows,
+                             const haversine_points_t *columns, int threads,
+                             double earth_radius, int *nearest,
+                             double *distance) {
+  assert(columns->count > 0);
+  share_t share = {
+      .rows = rows,
+      .columns = columns,
+      .earth_radius = earth_radius,
+      .nearest = nearest,
+      .distance = distance,
+  };
+  run_shares(&share, threads);
+}
@@ -0,0 +1,49 @@
+#ifndef DISTANCE_MATRIX_H_
+#define DISTANCE_MATRIX_H_
+
+// Distances between every point of one set and every point of another,
+// depots and customers say: the whole matrix, or only the nearest column
+// of every row. The points are prepared once, see haversine_points_t, and
+// the rows go through the row kernels of haversine_kernels.
+//
+// Rows are split across threads, 1 to PARALLEL_MAX_THREADS, in contiguous
+// runs. Each thread walks the columns a tile of
+// DISTANCE_MATRIX_TILE_COLUMNS at a time, 20 KB of them, which stays in L1
+// while DISTANCE_MATRIX_TILE_ROWS rows go over it. The columns are then
+// read from memory once per tile of rows instead of once per row.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "harvestine.h"
+#include "parallel.h"
+
+#define DISTANCE_MATRIX_TILE_COLUMNS 512
+#define DISTANCE_MATRIX_TILE_ROWS 64
+
+// Prepares count points given in degrees, x the longitude and y the
+// latitude as in pairs_t, with haversine_kernels. They have to be in range,
+// |x| <= 180 and |y| <= 90, which the approximations rely on. Returns false
+// if out of memory.
+bool haversine_points_init(haversine_points_t *points, const double *x,
+                           const double *y, int count);
+void haversine_points_free(haversine_points_t *points);
+
+// One point prepared the same way, bit for bit.
+haversine_point_t haversine_point_prepare(double x, double y);
+
+// out[i * stride + j] is the distance from point i of rows to point j of
+// columns, stride >= columns->count.
+void distance_matrix(const haversine_points_t *rows,
+                     const haversine_points_t *columns, int threads,
+                     double earth_radius, double *out, size_t stride);
+
+// nearest[i] is the point of columns nearest to point i of rows, the lowest
+// index of them on ties, and distance[i] the distance to it. columns can't
+// be empty.
+void distance_matrix_nearest(const haversine_points_t *rows,
+                             const haversine_points_t *columns, int threads,
+                             double earth_radius, int *nearest,
+                             double *distance);
+
+#endif // DISTANCE_MATRIX_H_
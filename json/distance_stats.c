@@ -0,0 +1,270 @@
+#include "distance_stats.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harvestine.h"
+
+#define K DISTANCE_STATS_SKETCH_K
+
+void distance_stats_init(distance_stats_t *stats) {
+  stats->count = 0;
+  stats->nans = 0;
+  stats->min = INFINITY;
+  stats->max = -INFINITY;
+  stats->mean = 0;
+  stats->m2 = 0;
+  memset(stats->histogram, 0, sizeof(stats->histogram));
+  stats->levels = 0;
+  stats->parity = 0;
+  memset(stats->sizes, 0, sizeof(stats->sizes));
+}
+
+// The histogram bin of a distance, from its exponent and the top mantissa
+// bits, like the error bins of verify.c.
+static int distance_bin(double distance) {
+  uint64_t bits;
+  memcpy(&bits, &distance, sizeof(bits));
+  int exponent = (int)((bits >> 52) & 0x7ff) - 1023;
+  int fraction = (int)((bits >> 49) & (DISTANCE_STATS_BINS_PER_OCTAVE - 1));
+  if (exponent < DISTANCE_STATS_MIN_EXPONENT) {
+    return 0;
+  }
+  if (exponent >= DISTANCE_STATS_MAX_EXPONENT) {
+    return DISTANCE_STATS_BINS - 1;
+  }
+  return (exponent - DISTANCE_STATS_MIN_EXPONENT) *
+             DISTANCE_STATS_BINS_PER_OCTAVE +
+         fraction + 1;
+}
+
+double distance_stats_bin_bound(int bin) {
+  assert(0 <= bin && bin <= DISTANCE_STATS_BINS);
+  if (bin == 0) {
+    return 0;
+  }
+  if (bin == DISTANCE_STATS_BINS) {
+    return INFINITY;
+  }
+  int exponent =
+      DISTANCE_STATS_MIN_EXPONENT + (bin - 1) / DISTANCE_STATS_BINS_PER_OCTAVE;
+  int fraction = (bin - 1) % DISTANCE_STATS_BINS_PER_OCTAVE;
+  return ldexp(1 + fraction / (double)DISTANCE_STATS_BINS_PER_OCTAVE,
+               exponent);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Distances are never negative or NaN in the sketch, so their bits sort
+// the same as they do. A radix sort on the top 32 of them, a byte at a
+// time: that orders them to within 2^-20 of each other, far finer than the
+// sketch can tell apart, in half the passes of a full sort and several
+// times faster than qsort(). Bytes that are the same in all of them are
+// skipped, like the exponent often is.
+#define SORT_BYTES 4
+
+static void sort_distances(double *items, int n) {
+  uint64_t buffers[2][K];
+  uint32_t counts[SORT_BYTES][256];
+  memset(counts, 0, sizeof(counts));
+  memcpy(buffers[0], items, n * sizeof(double));
+  for (int i = 0; i < n; i++) {
+    uint64_t bits = buffers[0][i];
+    for (int byte = 0; byte < SORT_BYTES; byte++) {
+      counts[byte][(bits >> (32 + 8 * byte)) & 0xff]++;
+    }
+  }
+
+  int from = 0;
+  for (int byte = 0; byte < SORT_BYTES; byte++) {
+    int shift = 32 + 8 * byte;
+    uint32_t *count = counts[byte];
+    if (count[(buffers[from][0] >> shift) & 0xff] == (uint32_t)n) {
+      continue;
+    }
+    uint32_t offset = 0;
+    for (int digit = 0; digit < 256; digit++) {
+      uint32_t c = count[digit];
+      count[digit] = offset;
+      offset += c;
+    }
+    const uint64_t *in = buffers[from];
+    uint64_t *out = buffers[from ^ 1];
+    for (int i = 0; i < n; i++) {
+      out[count[(in[i] >> shift) & 0xff]++] = in[i];
+    }
+    from ^= 1;
+  }
+  memcpy(items, buffers[from], n * sizeof(double));
+}
+
+// Sorts level h and moves every other distance of it to level h + 1, making
+// room there first. With an odd number of them the largest stays behind.
+static void compact(distance_stats_t *stats, int h) {
+  assert(h + 1 < DISTANCE_STATS_SKETCH_LEVELS);
+  double *items = stats->items[h];
+  int size = stats->sizes[h];
+  int half = size / 2;
+  if (stats->sizes[h + 1] + half > K) {
+    compact(stats, h + 1);
+  }
+  if (size > 0) {
+    sort_distances(items, size);
+  }
+
+  int offset = (stats->parity >> h) & 1;
+  stats->parity ^= 1u << h;
+  double *up = stats->items[h + 1] + stats->sizes[h + 1];
+  for (int i = 0; i < half; i++) {
+    up[i] = items[2 * i + offset];
+  }
+  stats->sizes[h + 1] += half;
+  if (size % 2 != 0) {
+    items[0] = items[size - 1];
+  }
+  stats->sizes[h] = size % 2;
+  if (stats->levels < h + 2) {
+    stats->levels = h + 2;
+  }
+}
+
+static inline void push(distance_stats_t *stats, int h, double distance) {
+  if (stats->sizes[h] == K) {
+    compact(stats, h);
+  }
+  stats->items[h][stats->sizes[h]++] = distance;
+  if (stats->levels < h + 1) {
+    stats->levels = h + 1;
+  }
+}
+
+// Merges the moments of count more distances into stats.
+static void add_moments(distance_stats_t *stats, uint64_t count, double mean,
+                        double m2) {
+  if (stats->count == 0) {
+    stats->count = count;
+    stats->mean = mean;
+    stats->m2 = m2;
+    return;
+  }
+  uint64_t total = stats->count + count;
+  double delta = mean - stats->mean;
+  stats->mean += delta * ((double)count / total);
+  stats->m2 += m2 + delta * delta * ((double)stats->count * count / total);
+  stats->count = total;
+}
+
+void distance_stats_add(distance_stats_t *stats, const double *distances,
+                        int n) {
+  // The moments, minimum and maximum by the kernels in use. The histogram
+  // and the sketch below take one distance at a time, and stay scalar.
+  haversine_moments_t block;
+  haversine_kernels.moments(distances, n, &block);
+  stats->nans += n - block.count;
+  if (block.count == 0) {
+    return;
+  }
+  add_moments(stats, block.count, block.sum / block.count, block.m2);
+  stats->min = block.min < stats->min ? block.min : stats->min;
+  stats->max = block.max > stats->max ? block.max : stats->max;
+
+  // Straight into level 0, compacting it whenever it fills up. Adding 0
+  // turns -0 into 0, which sorts by its bits.
+  double *level = stats->items[0];
+  for (int i = 0; i < n; i++) {
+    double distance = distances[i];
+    if (distance == distance) {
+      if (stats->sizes[0] == K) {
+        compact(stats, 0);
+      }
+      stats->histogram[distance_bin(distance)]++;
+      level[stats->sizes[0]++] = distance + 0.0;
+    }
+  }
+  if (stats->levels == 0) {
+    stats->levels = 1;
+  }
+}
+
+void distance_stats_merge(distance_stats_t *stats,
+                          const distance_stats_t *from) {
+  stats->nans += from->nans;
+  if (from->count == 0) {
+    return;
+  }
+  add_moments(stats, from->count, from->mean, from->m2);
+  stats->min = from->min < stats->min ? from->min : stats->min;
+  stats->max = from->max > stats->max ? from->max : stats->max;
+  for (int bin = 0; bin < DISTANCE_STATS_BINS; bin++) {
+    stats->histogram[bin] += from->histogram[bin];
+  }
+  // A distance keeps its level, and so its weight.
+  for (int h = 0; h < from->levels; h++) {
+    for (int i = 0; i < from->sizes[h]; i++) {
+      push(stats, h, from->items[h][i]);
+    }
+  }
+}
+
+double distance_stats_variance(const distance_stats_t *stats) {
+  return stats->count > 0 ? stats->m2 / stats->count : 0;
+}
+
+typedef struct {
+  double value;
+  uint64_t weight;
+} weighted_t;
+
+static int compare_weighted(const void *a, const void *b) {
+  return compare_doubles(&((const weighted_t *)a)->value,
+                         &((const weighted_t *)b)->value);
+}
+
+bool distance_stats_quantiles(const distance_stats_t *stats,
+                              const double *fractions, int n, double *out) {
+  if (stats->count == 0) {
+    for (int i = 0; i < n; i++) {
+      out[i] = NAN;
+    }
+    return true;
+  }
+
+  size_t len = 0;
+  for (int h = 0; h < stats->levels; h++) {
+    len += stats->sizes[h];
+  }
+  weighted_t *items = malloc(len * sizeof(weighted_t));
+  if (items == NULL) {
+    return false;
+  }
+  len = 0;
+  for (int h = 0; h < stats->levels; h++) {
+    for (int i = 0; i < stats->sizes[h]; i++) {
+      items[len++] = (weighted_t){stats->items[h][i], (uint64_t)1 << h};
+    }
+  }
+  qsort(items, len, sizeof(weighted_t), compare_weighted);
+
+  // Compacting halves the distances and doubles their weight, so the
+  // weights still add up to count.
+  for (int q = 0; q < n; q++) {
+    double rank = ceil(fractions[q] * stats->count);
+    uint64_t seen = 0;
+    out[q] = items[len - 1].value;
+    for (size_t i = 0; i < len; i++) {
+      seen += items[i].weight;
+      if (seen >= rank) {
+        out[q] = items[i].value;
+        break;
+      }
+    }
+  }
+  free(items);
+  return true;
+}
@@ -0,0 +1,81 @@
+#ifndef DISTANCE_STATS_H_
+#define DISTANCE_STATS_H_
+
+// Statistics of the distances beyond their mean: the extremes, the
+// variance, a histogram and approximate quantiles. They are gathered a
+// block at a time in the same pass that computes the distances, see
+// average_harvestine_into(), every thread into a distance_stats_t of its
+// own, and merged at the end. Nothing needs a second pass over the
+// distances or a sort of all of them.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The histogram has this many bins per power of two of the distance in km,
+// each within 2^(1/8), about 9%, of its neighbours.
+#define DISTANCE_STATS_BINS_PER_OCTAVE 8
+// Distances below 2^DISTANCE_STATS_MIN_EXPONENT km, about 1 mm, go into bin
+// 0, and distances of 2^DISTANCE_STATS_MAX_EXPONENT km and above, farther
+// than anything on Earth, into the last bin.
+#define DISTANCE_STATS_MIN_EXPONENT (-20)
+#define DISTANCE_STATS_MAX_EXPONENT 15
+#define DISTANCE_STATS_BINS                                                    \
+  ((DISTANCE_STATS_MAX_EXPONENT - DISTANCE_STATS_MIN_EXPONENT) *               \
+       DISTANCE_STATS_BINS_PER_OCTAVE +                                        \
+   2)
+
+// The quantile sketch is a KLL sketch with every compactor the same size:
+// level h holds up to DISTANCE_STATS_SKETCH_K distances that stand for 2^h
+// each. A full level is sorted and every other distance of it moves up a
+// level, alternating between the odd and the even ones so that the rank
+// errors mostly cancel. Ranks come out within about n / K of the exact
+// ones.
+#define DISTANCE_STATS_SKETCH_K 1024
+// Enough for K * 2^23 distances, more than pairs_t holds.
+#define DISTANCE_STATS_SKETCH_LEVELS 24
+
+typedef struct {
+  // Distances that aren't NaN. NaNs are only counted.
+  uint64_t count;
+  uint64_t nans;
+  // INFINITY and -INFINITY while count is 0.
+  double min;
+  double max;
+  // Of the distances so far, merged the way Chan et al. merge them, which
+  // stays accurate where the sum of squares would cancel.
+  double mean;
+  double m2; // sum of squared differences from the mean
+
+  uint64_t histogram[DISTANCE_STATS_BINS];
+
+  int levels;
+  // Bit h says which half level h keeps next.
+  uint32_t parity;
+  int sizes[DISTANCE_STATS_SKETCH_LEVELS];
+  double items[DISTANCE_STATS_SKETCH_LEVELS][DISTANCE_STATS_SKETCH_K];
+} distance_stats_t;
+
+void distance_stats_init(distance_stats_t *stats);
+// Adds n distances, a block of them at a time.
+void distance_stats_add(distance_stats_t *stats, const double *distances,
+                        int n);
+// Adds the distances of from into stats, as if they had been added there.
+// Merging the shares of threads in order gives the same results every time.
+void distance_stats_merge(distance_stats_t *stats,
+                          const distance_stats_t *from);
+
+// Population variance, 0 without distances.
+double distance_stats_variance(const distance_stats_t *stats);
+
+// The distances below which the given fractions of them fall, in any
+// order, NaN without distances. Sorts the sketch, not the distances, but
+// still needs memory for it. Returns false if out of memory.
+bool distance_stats_quantiles(const distance_stats_t *stats,
+                              const double *fractions, int n, double *out);
+
+// The range of histogram bin `bin` is [bound(bin), bound(bin + 1)), with
+// bound(0) = 0 and bound(DISTANCE_STATS_BINS) = INFINITY.
+double distance_stats_bin_bound(int bin);
+
+#endif // DISTANCE_STATS_H_
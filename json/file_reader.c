@@ -0,0 +1,141 @@
+#include "file_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "stopwatch.h"
+
+typedef struct {
+  const char *data;
+  size_t len;
+} piece_t;
+
+static void *run_reader(void *arg) {
+  file_reader_t *reader = (file_reader_t *)arg;
+  stopwatch_t stopwatch;
+  stopwatch_init(&stopwatch);
+
+  size_t offset = 0;
+  for (uint64_t i = 0;
+       !atomic_load_explicit(&reader->stop, memory_order_relaxed); i++) {
+    piece_t *piece = (piece_t *)spsc_ring_begin_push(&reader->ring);
+    char *buffer =
+        reader->buffers + (i % reader->buffer_count) * reader->buffer_size;
+
+    // Fills the buffer unless the file ends first.
+    stopwatch_start(&stopwatch);
+    size_t len = 0;
+    while (len < reader->buffer_size) {
+      ssize_t n = pread(reader->fd, buffer + len, reader->buffer_size - len,
+                        offset + len);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        reader->error = errno;
+      }
+      if (n <= 0) {
+        break;
+      }
+      len += n;
+    }
+    reader->read_ns += stopwatch_end(&stopwatch);
+
+    if (len == 0 || reader->error != 0) {
+      break;
+    }
+    offset += len;
+    piece->data = buffer;
+    piece->len = len;
+    spsc_ring_end_push(&reader->ring);
+  }
+
+  reader->len = offset;
+  spsc_ring_close(&reader->ring);
+  return NULL;
+}
+
+bool file_reader_open(file_reader_t *reader, const char *filename,
+                      size_t buffer_size, int buffer_count) {
+  reader->fd = open(filename, O_RDONLY);
+  if (reader->fd < 0) {
+    return false;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  // The ring's capacity is a power of two, and has to match the buffers.
+  int count = 1;
+  while (count < buffer_count || count < 2) {
+    count *= 2;
+  }
+  buffer_size = (buffer_size + FILE_READER_ALIGNMENT - 1) /
+                FILE_READER_ALIGNMENT * FILE_READER_ALIGNMENT;
+
+  reader->buffer_size = buffer_size;
+  reader->buffer_count = count;
+  reader->buffers = aligned_alloc(FILE_READER_ALIGNMENT, count * buffer_size);
+  if (reader->buffers == NULL ||
+      !spsc_ring_init(&reader->ring, count, sizeof(piece_t))) {
+    free(reader->buffers);
+    close(reader->fd);
+    errno = ENOMEM;
+    return false;
+  }
+
+  atomic_init(&reader->stop, false);
+  reader->error = 0;
+  reader->len = 0;
+  reader->read_ns = 0;
+  reader->wait_ns = 0;
+
+  int error = pthread_create(&reader->thread, NULL, run_reader, reader);
+  if (error != 0) {
+    spsc_ring_free(&reader->ring);
+    free(reader->buffers);
+    close(reader->fd);
+    errno = error;
+    return false;
+  }
+  return true;
+}
+
+const char *file_reader_next(file_reader_t *reader, size_t *len) {
+  stopwatch_t stopwatch;
+  stopwatch_init(&stopwatch);
+  stopwatch_start(&stopwatch);
+  const piece_t *piece = (const piece_t *)spsc_ring_begin_pop(&reader->ring);
+  reader->wait_ns += stopwatch_end(&stopwatch);
+
+  if (piece == NULL) {
+    return NULL;
+  }
+  *len = piece->len;
+  return piece->data;
+}
+
+void file_reader_release(file_reader_t *reader) {
+  spsc_ring_end_pop(&reader->ring);
+}
+
+bool file_reader_close(file_reader_t *reader) {
+  atomic_store_explicit(&reader->stop, true, memory_order_relaxed);
+  // The thread may be waiting for a buffer, give it all of them back.
+  size_t len;
+  while (file_reader_next(reader, &len) != NULL) {
+    file_reader_release(reader);
+  }
+  pthread_join(reader->thread, NULL);
+
+  spsc_ring_free(&reader->ring);
+  free(reader->buffers);
+  close(reader->fd);
+  if (reader->error != 0) {
+    errno = reader->error;
+    return false;
+  }
+  return true;
+}
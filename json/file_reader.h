@@ -0,0 +1,58 @@
+#ifndef FILE_READER_H_
+#define FILE_READER_H_
+
+// Reads a file front to back on a background thread, ahead of whoever
+// consumes it. Large preads go into a small set of reusable page-aligned
+// buffers: while the consumer works on one, the thread fills the next, so
+// the time spent reading hides behind the time spent using the data. Once
+// all the buffers are full the thread waits for the consumer to release one.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "spsc_ring.h"
+
+#define FILE_READER_ALIGNMENT 4096
+#define FILE_READER_DEFAULT_BUFFER (1 << 20)
+#define FILE_READER_DEFAULT_BUFFERS 2
+
+typedef struct {
+  int fd;
+  size_t buffer_size;
+  // buffer_count buffers of buffer_size bytes, in a single allocation.
+  char *buffers;
+  int buffer_count;
+  // One slot per buffer, buffer i % buffer_count goes with the i-th slot.
+  spsc_ring_t ring;
+  pthread_t thread;
+  // Set by the consumer to stop the thread early.
+  atomic_bool stop;
+
+  // Written by the thread, valid once the end of the file has been reached
+  // or after file_reader_close().
+  int error; // errno of a failed read, 0 if none
+  size_t len;
+  uint64_t read_ns;
+  // Written by the consumer: time spent waiting for the thread.
+  uint64_t wait_ns;
+} file_reader_t;
+
+// Opens filename and starts reading it into buffer_count buffers of
+// buffer_size bytes. Returns false and sets errno on failure.
+bool file_reader_open(file_reader_t *reader, const char *filename,
+                      size_t buffer_size, int buffer_count);
+
+// The next piece of the file, at most buffer_size bytes. Returns NULL at the
+// end of the file or after a failed read. The piece stays valid until
+// file_reader_release().
+const char *file_reader_next(file_reader_t *reader, size_t *len);
+void file_reader_release(file_reader_t *reader);
+
+// Stops the thread, whether or not the whole file has been read, and frees
+// everything. Returns false and sets errno if a read failed.
+bool file_reader_close(file_reader_t *reader);
+
+#endif // FILE_READER_H_
@@ -1,5 +1,10 @@
+#include "harvestine.h"
+
+#include <assert.h>
 #include <math.h>
 
+#include "harvestine_math.h"
+
 #define f64 double
 
 static f64 square(f64 A) {
@@ -31,3 +36,221 @@ f64 reference_haversine(f64 X0, f64 Y0, f64 X1, f64 Y1, f64 EarthRadius) {
 
   return Result;
 }
+
+f64 haversine(f64 x0, f64 y0, f64 x1, f64 y1, f64 earth_radius) {
+  f64 d_lat = radians_from_degrees(y1 - y0);
+  f64 d_lon = radians_from_degrees(x1 - x0);
+  f64 lat1 = radians_from_degrees(y0);
+  f64 lat2 = radians_from_degrees(y1);
+
+  f64 sin_lat = harvestine_sin(d_lat / 2.0);
+  f64 sin_lon = harvestine_sin(d_lon / 2.0);
+  f64 a = fma(harvestine_cos(lat1) * harvestine_cos(lat2) * sin_lon, sin_lon,
+              square(sin_lat));
+  // Rounding can push a slightly out of [0, 1], which asin_sqrt clamps.
+  f64 half_c = harvestine_asin_sqrt(a);
+
+  return earth_radius * (half_c + half_c);
+}
+
+// Widens a coordinate stored as T.
+static f64 widen_f64(f64 x) { return x; }
+static f64 widen_f32(float x) { return x; }
+static f64 widen_microdegrees(int32_t x) {
+  return x * HARVESTINE_DEGREES_PER_MICRODEGREE;
+}
+
+#define DEFINE_BATCH(name, T, widen, distance)                                 \
+  static f64 name(const T *x0, const T *y0, const T *x1, const T *y1,          \
+                  size_t n, f64 earth_radius, f64 *out) {                      \
+    f64 sum = 0;                                                               \
+    for (size_t i = 0; i < n; i++) {                                           \
+      f64 d = distance(widen(x0[i]), widen(y0[i]), widen(x1[i]), widen(y1[i]), \
+                       earth_radius);                                          \
+      if (out != NULL) {                                                       \
+        out[i] = d;                                                            \
+      }                                                                        \
+      sum += d;                                                                \
+    }                                                                          \
+    return sum;                                                                \
+  }
+
+// a of the haversine formula from prepared points, see haversine_points_t.
+// The vector kernels perform the same operations.
+static f64 prepared_a(const haversine_point_t *p, const haversine_points_t *to,
+                      size_t j) {
+  f64 sin_lat = fma(to->sin_half_lat[j], p->cos_half_lat,
+                    -(to->cos_half_lat[j] * p->sin_half_lat));
+  f64 sin_lon = fma(to->sin_half_lon[j], p->cos_half_lon,
+                    -(to->cos_half_lon[j] * p->sin_half_lon));
+  return fma(p->cos_lat * to->cos_lat[j] * sin_lon, sin_lon,
+             square(sin_lat));
+}
+
+static f64 from_a_libm(f64 a, f64 earth_radius) {
+  return earth_radius * (2.0 * asin(sqrt(a)));
+}
+
+static f64 from_a_scalar(f64 a, f64 earth_radius) {
+  f64 half_c = harvestine_asin_sqrt(a);
+  return earth_radius * (half_c + half_c);
+}
+
+#define DEFINE_ROW(name, from_a)                                               \
+  static void name(const haversine_point_t *point,                             \
+                   const haversine_points_t *to, size_t first, size_t n,       \
+                   f64 earth_radius, f64 *out) {                               \
+    for (size_t j = 0; j < n; j++) {                                           \
+      out[j] = from_a(prepared_a(point, to, first + j), earth_radius);         \
+    }                                                                          \
+  }
+
+static size_t row_nearest(const haversine_point_t *point,
+                          const haversine_points_t *to, size_t first,
+                          size_t n, f64 *a) {
+  size_t nearest = first;
+  f64 best = prepared_a(point, to, first);
+  for (size_t j = first + 1; j < first + n; j++) {
+    f64 candidate = prepared_a(point, to, j);
+    if (candidate < best) {
+      best = candidate;
+      nearest = j;
+    }
+  }
+  *a = best;
+  return nearest;
+}
+
+static f64 errors(const f64 *x, const f64 *y, size_t n, f64 *out) {
+  f64 max = 0;
+  for (size_t i = 0; i < n; i++) {
+    f64 error = fabs(x[i] - y[i]);
+    error = error == error ? error : INFINITY;
+    out[i] = error;
+    max = error > max ? error : max;
+  }
+  return max;
+}
+
+static void moments(const f64 *x, size_t n, haversine_moments_t *out) {
+  size_t count = 0;
+  f64 sum = 0;
+  f64 min = INFINITY;
+  f64 max = -INFINITY;
+  for (size_t i = 0; i < n; i++) {
+    if (x[i] == x[i]) {
+      count++;
+      sum += x[i];
+      min = x[i] < min ? x[i] : min;
+      max = x[i] > max ? x[i] : max;
+    }
+  }
+  f64 mean = count > 0 ? sum / count : 0;
+  f64 m2 = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (x[i] == x[i]) {
+      m2 += square(x[i] - mean);
+    }
+  }
+  *out = (haversine_moments_t){count, sum, min, max, m2};
+}
+
+#define DEFINE_MAP(name, f)                                                    \
+  static void name(const f64 *x, size_t n, f64 *out) {                         \
+    for (size_t i = 0; i < n; i++) {                                           \
+      out[i] = f(x[i]);                                                        \
+    }                                                                          \
+  }
+
+DEFINE_BATCH(batch_libm, f64, widen_f64, reference_haversine)
+DEFINE_BATCH(batch_f32_libm, float, widen_f32, reference_haversine)
+DEFINE_BATCH(batch_microdegrees_libm, int32_t, widen_microdegrees,
+             reference_haversine)
+DEFINE_ROW(row_libm, from_a_libm)
+DEFINE_MAP(sin_libm, sin)
+DEFINE_MAP(cos_libm, cos)
+DEFINE_MAP(asin_libm, asin)
+DEFINE_MAP(sqrt_libm, sqrt)
+
+DEFINE_BATCH(batch_scalar, f64, widen_f64, haversine)
+DEFINE_BATCH(batch_f32_scalar, float, widen_f32, haversine)
+DEFINE_BATCH(batch_microdegrees_scalar, int32_t, widen_microdegrees,
+             haversine)
+DEFINE_ROW(row_scalar, from_a_scalar)
+DEFINE_MAP(sin_scalar, harvestine_sin)
+DEFINE_MAP(cos_scalar, harvestine_cos)
+DEFINE_MAP(asin_scalar, harvestine_asin)
+DEFINE_MAP(sqrt_scalar, harvestine_sqrt)
+
+const haversine_kernels_t haversine_kernels_libm = {
+    .name = "libm",
+    .isa = ISA_SCALAR,
+    .batch = batch_libm,
+    .batch_f32 = batch_f32_libm,
+    .batch_microdegrees = batch_microdegrees_libm,
+    .row = row_libm,
+    .row_nearest = row_nearest,
+    .from_a = from_a_libm,
+    .errors = errors,
+    .moments = moments,
+    .sin = sin_libm,
+    .cos = cos_libm,
+    .asin = asin_libm,
+    .sqrt = sqrt_libm,
+};
+
+const haversine_kernels_t haversine_kernels_scalar = {
+    .name = "scalar",
+    .isa = ISA_SCALAR,
+    .batch = batch_scalar,
+    .batch_f32 = batch_f32_scalar,
+    .batch_microdegrees = batch_microdegrees_scalar,
+    .row = row_scalar,
+    .row_nearest = row_nearest,
+    .from_a = from_a_scalar,
+    .errors = errors,
+    .moments = moments,
+    .sin = sin_scalar,
+    .cos = cos_scalar,
+    .asin = asin_scalar,
+    .sqrt = sqrt_scalar,
+};
+
+haversine_kernels_t haversine_kernels = {
+    .name = "scalar",
+    .isa = ISA_SCALAR,
+    .batch = batch_scalar,
+    .batch_f32 = batch_f32_scalar,
+    .batch_microdegrees = batch_microdegrees_scalar,
+    .row = row_scalar,
+    .row_nearest = row_nearest,
+    .from_a = from_a_scalar,
+    .errors = errors,
+    .moments = moments,
+    .sin = sin_scalar,
+    .cos = cos_scalar,
+    .asin = asin_scalar,
+    .sqrt = sqrt_scalar,
+};
+
+void haversine_kernels_select(isa_t isa) {
+  assert(isa_supported(isa));
+
+  switch (isa) {
+#if defined(__x86_64__) || defined(__i386__)
+  case ISA_AVX512:
+    haversine_kernels = haversine_kernels_avx512;
+    break;
+  case ISA_AVX2:
+    haversine_kernels = haversine_kernels_avx2;
+    break;
+#endif
+  default:
+    haversine_kernels = haversine_kernels_scalar;
+    break;
+  }
+}
+
+__attribute__((constructor)) static void haversine_kernels_init(void) {
+  haversine_kernels_select(isa_detect());
+}
@@ -1,9 +1,159 @@
 #ifndef HARVESTINE_H_
 #define HARVESTINE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "isa.h"
+
 #define REFERENCE_EARTH_RADIUS 6372.8
 
 double reference_haversine(double X0, double Y0, double X1, double Y1,
                            double EarthRadius);
 
+// Same formula as reference_haversine() with the libm calls replaced by the
+// functions from harvestine_math.h.
+double haversine(double x0, double y0, double x1, double y1,
+                 double earth_radius);
+
+// Distances between (x0[i], y0[i]) and (x1[i], y1[i]) for i in [0, n), in
+// degrees as in reference_haversine(). Returns their sum and, if out is not
+// NULL, stores each distance in out[i] as well.
+//
+// The libm kernels call reference_haversine(), all the others use the
+// approximations from harvestine_math.h. For coordinates in range their
+// relative error against the reference is below 1e-14 as long as the points
+// are more than 1000 km from being antipodal. Closer than that asin()
+// amplifies the rounding of its argument, in the reference as much as here,
+// and the two can drift apart by up to 1e-4 km.
+typedef double (*haversine_batch_t)(const double *x0, const double *y0,
+                                    const double *x1, const double *y1,
+                                    size_t n, double earth_radius,
+                                    double *out);
+
+// The same for coordinates stored compactly, widened to double as they are
+// loaded: as floats, or as int32 millionths of a degree.
+typedef double (*haversine_batch_f32_t)(const float *x0, const float *y0,
+                                        const float *x1, const float *y1,
+                                        size_t n, double earth_radius,
+                                        double *out);
+typedef double (*haversine_batch_microdegrees_t)(
+    const int32_t *x0, const int32_t *y0, const int32_t *x1,
+    const int32_t *y1, size_t n, double earth_radius, double *out);
+
+// Microdegrees are widened by multiplying with this rather than dividing,
+// which costs at most an ulp on top of the quantization.
+#define HARVESTINE_MICRODEGREES 1000000.0
+#define HARVESTINE_DEGREES_PER_MICRODEGREE 1e-6
+
+// Points prepared for the distances between every point of one set and
+// every point of another, see distance_matrix.h. The sines and cosines of
+// the formula are taken once per point instead of once per distance, with
+//
+//   sin((lat1 - lat0) / 2) =
+//       sin(lat1 / 2) cos(lat0 / 2) - cos(lat1 / 2) sin(lat0 / 2)
+//
+// and the same for the longitudes, which leaves only multiplications, adds
+// and the final asin(sqrt(a)) per distance. The difference is then off by
+// an ulp of 1 instead of one of itself, a few 1e-13 km of distance, and the
+// same point twice comes out that far apart. Columns as in pairs_t.
+typedef struct {
+  double *sin_half_lat;
+  double *cos_half_lat;
+  double *sin_half_lon;
+  double *cos_half_lon;
+  double *cos_lat;
+  int count;
+} haversine_points_t;
+
+// One of the points above.
+typedef struct {
+  double sin_half_lat;
+  double cos_half_lat;
+  double sin_half_lon;
+  double cos_half_lon;
+  double cos_lat;
+} haversine_point_t;
+
+// Distances from point to the points [first, first + n) of to, stored in
+// out[0, n).
+typedef void (*haversine_row_t)(const haversine_point_t *point,
+                                const haversine_points_t *to, size_t first,
+                                size_t n, double earth_radius, double *out);
+
+// The nearest of the points [first, first + n) of to, the lowest index on
+// ties, n > 0. Stores a, the sin^2(c / 2) of the haversine formula, which
+// orders the same as the distance, in *a, so that asin() and sqrt() are
+// only needed for the nearest point, by from_a below.
+typedef size_t (*haversine_row_nearest_t)(const haversine_point_t *point,
+                                          const haversine_points_t *to,
+                                          size_t first, size_t n, double *a);
+
+// out[i] = f(x[i]) for i in [0, n). out may be x.
+typedef void (*haversine_map_t)(const double *x, size_t n, double *out);
+
+// out[i] = |x[i] - y[i]| for i in [0, n), infinite where that is NaN.
+// Returns the largest of them, 0 if n is 0.
+typedef double (*haversine_errors_t)(const double *x, const double *y,
+                                     size_t n, double *out);
+
+// Of the values of a block that aren't NaN.
+typedef struct {
+  size_t count;
+  double sum;
+  double min; // INFINITY if there are none
+  double max; // -INFINITY if there are none
+  // Sum of the squared differences from sum / count.
+  double m2;
+} haversine_moments_t;
+
+typedef void (*haversine_block_moments_t)(const double *x, size_t n,
+                                          haversine_moments_t *out);
+
+typedef struct {
+  const char *name;
+  isa_t isa;
+  haversine_batch_t batch;
+  haversine_batch_f32_t batch_f32;
+  haversine_batch_microdegrees_t batch_microdegrees;
+  haversine_row_t row;
+  haversine_row_nearest_t row_nearest;
+  // The distance for an a from row_nearest.
+  double (*from_a)(double a, double earth_radius);
+  // Reductions over distances already computed, for verify.c and
+  // distance_stats.c.
+  haversine_errors_t errors;
+  haversine_block_moments_t moments;
+  // The math functions batch is built from, on the domains listed in
+  // harvestine_math.h. Exposed for testing them one at a time.
+  haversine_map_t sin;
+  haversine_map_t cos;
+  haversine_map_t asin;
+  haversine_map_t sqrt;
+} haversine_kernels_t;
+
+// The kernels in use. Chosen by isa_detect() before main() runs.
+extern haversine_kernels_t haversine_kernels;
+
+// Switches to the best kernels for the given tier, which must be supported.
+// Never picks the libm kernels, those have to be set explicitly.
+void haversine_kernels_select(isa_t isa);
+
+static inline double haversine_batch(const double *x0, const double *y0,
+                                     const double *x1, const double *y1,
+                                     size_t n, double earth_radius,
+                                     double *out) {
+  return haversine_kernels.batch(x0, y0, x1, y1, n, earth_radius, out);
+}
+
+// libm, as a baseline for the others.
+extern const haversine_kernels_t haversine_kernels_libm;
+
+// Per-tier tables. There is nothing to gain from SSE4.2 over scalar here.
+extern const haversine_kernels_t haversine_kernels_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+extern const haversine_kernels_t haversine_kernels_avx2;
+extern const haversine_kernels_t haversine_kernels_avx512;
+#endif
+
 #endif // HARVESTINE_H_
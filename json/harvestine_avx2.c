@@ -0,0 +1,377 @@
+#include "harvestine.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+#include <math.h>
+
+#include "harvestine_math.h"
+
+// Four pairs per iteration. See harvestine_math.h for the approximations.
+
+static __m256d horner(__m256d x, const double *coefficients, int degree) {
+  __m256d result = _mm256_set1_pd(coefficients[degree - 1]);
+  for (int i = degree - 2; i >= 0; i--) {
+    result = _mm256_fmadd_pd(result, x, _mm256_set1_pd(coefficients[i]));
+  }
+  return result;
+}
+
+static __m256d abs_pd(__m256d x) {
+  return _mm256_andnot_pd(_mm256_set1_pd(-0.0), x);
+}
+
+// sin(x) for x in [0, pi/2].
+static __m256d sin_quadrant(__m256d x) {
+  __m256d x2 = _mm256_mul_pd(x, x);
+  __m256d p = horner(x2, harvestine_sin_coefficients, HARVESTINE_SIN_DEGREE);
+  return _mm256_fmadd_pd(_mm256_mul_pd(x, x2), p, x);
+}
+
+// sin(x) for |x| <= pi.
+static __m256d sin_pd(__m256d x) {
+  __m256d ax = abs_pd(x);
+  __m256d reflected =
+      _mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(HARVESTINE_PI_HI), ax),
+                    _mm256_set1_pd(HARVESTINE_PI_LO));
+  __m256d above =
+      _mm256_cmp_pd(ax, _mm256_set1_pd(HARVESTINE_PI_2_HI), _CMP_GT_OQ);
+  __m256d result = sin_quadrant(_mm256_blendv_pd(ax, reflected, above));
+  return _mm256_or_pd(result, _mm256_and_pd(x, _mm256_set1_pd(-0.0)));
+}
+
+// cos(x) for |x| <= pi/2.
+static __m256d cos_pd(__m256d x) {
+  __m256d shifted =
+      _mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(HARVESTINE_PI_2_HI), abs_pd(x)),
+                    _mm256_set1_pd(HARVESTINE_PI_2_LO));
+  return sin_quadrant(_mm256_max_pd(shifted, _mm256_setzero_pd()));
+}
+
+// asin(x) = x + x^3 Q(x^2) for x in [0, 1/2], given x and x^2.
+static __m256d asin_half(__m256d x, __m256d x2) {
+  __m256d q = horner(x2, harvestine_asin_coefficients, HARVESTINE_ASIN_DEGREE);
+  return _mm256_fmadd_pd(_mm256_mul_pd(x, x2), q, x);
+}
+
+// asin(x) for x in [0, 1], given x and x^2.
+static __m256d asin_reduced(__m256d x, __m256d x2) {
+  __m256d big = _mm256_cmp_pd(x, _mm256_set1_pd(0.5), _CMP_GT_OQ);
+  __m256d t = _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(1.0), x),
+                            _mm256_set1_pd(0.5));
+  __m256d y = asin_half(_mm256_blendv_pd(x, _mm256_sqrt_pd(t), big),
+                        _mm256_blendv_pd(x2, t, big));
+
+  __m256d folded =
+      _mm256_add_pd(_mm256_fnmadd_pd(_mm256_set1_pd(2.0), y,
+                                     _mm256_set1_pd(HARVESTINE_PI_2_HI)),
+                    _mm256_set1_pd(HARVESTINE_PI_2_LO));
+  return _mm256_blendv_pd(y, folded, big);
+}
+
+static __m256d clamp_unit(__m256d x) {
+  return _mm256_min_pd(_mm256_max_pd(x, _mm256_setzero_pd()),
+                       _mm256_set1_pd(1.0));
+}
+
+// asin(x) for x in [0, 1].
+static __m256d asin_pd(__m256d x) {
+  x = clamp_unit(x);
+  return asin_reduced(x, _mm256_mul_pd(x, x));
+}
+
+// asin(sqrt(a)) for a in [0, 1]. a is more precise than sqrt(a)^2.
+static __m256d asin_sqrt_pd(__m256d a) {
+  a = clamp_unit(a);
+  return asin_reduced(_mm256_sqrt_pd(a), a);
+}
+
+static __m256d haversine_pd(__m256d x0, __m256d y0, __m256d x1, __m256d y1,
+                            __m256d earth_radius) {
+  const __m256d radians = _mm256_set1_pd(HARVESTINE_DEGREES_TO_RADIANS);
+  const __m256d half = _mm256_set1_pd(0.5);
+
+  __m256d d_lat = _mm256_mul_pd(radians, _mm256_sub_pd(y1, y0));
+  __m256d d_lon = _mm256_mul_pd(radians, _mm256_sub_pd(x1, x0));
+  __m256d lat1 = _mm256_mul_pd(radians, y0);
+  __m256d lat2 = _mm256_mul_pd(radians, y1);
+
+  __m256d sin_lat = sin_pd(_mm256_mul_pd(d_lat, half));
+  __m256d sin_lon = sin_pd(_mm256_mul_pd(d_lon, half));
+  __m256d a = _mm256_fmadd_pd(
+      _mm256_mul_pd(_mm256_mul_pd(cos_pd(lat1), cos_pd(lat2)), sin_lon),
+      sin_lon, _mm256_mul_pd(sin_lat, sin_lat));
+
+  __m256d half_c = asin_sqrt_pd(a);
+  return _mm256_mul_pd(earth_radius, _mm256_add_pd(half_c, half_c));
+}
+
+// Lanes of the 4-pair block at offset i that are inside [0, n), as a mask
+// for the masked loads and stores.
+static __m256i block_mask(size_t i, size_t n) {
+  size_t left = n - i;
+  const __m256i lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+  return _mm256_cmpgt_epi64(_mm256_set1_epi64x(left < 4 ? left : 4), lanes);
+}
+
+// Lanes as in block_mask(), for 32-bit elements.
+static __m128i block_mask32(size_t i, size_t n) {
+  size_t left = n - i;
+  const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+  return _mm_cmpgt_epi32(_mm_set1_epi32(left < 4 ? (int)left : 4), lanes);
+}
+
+static __m256d load_f64(const double *p) { return _mm256_loadu_pd(p); }
+
+static __m256d maskload_f64(const double *p, size_t i, size_t n) {
+  return _mm256_maskload_pd(p, block_mask(i, n));
+}
+
+static __m256d load_f32(const float *p) {
+  return _mm256_cvtps_pd(_mm_loadu_ps(p));
+}
+
+static __m256d maskload_f32(const float *p, size_t i, size_t n) {
+  return _mm256_cvtps_pd(_mm_maskload_ps(p, block_mask32(i, n)));
+}
+
+static __m256d widen_microdegrees(__m128i micro) {
+  return _mm256_mul_pd(_mm256_cvtepi32_pd(micro),
+                       _mm256_set1_pd(HARVESTINE_DEGREES_PER_MICRODEGREE));
+}
+
+static __m256d load_microdegrees(const int32_t *p) {
+  return widen_microdegrees(_mm_loadu_si128((const __m128i *)p));
+}
+
+static __m256d maskload_microdegrees(const int32_t *p, size_t i, size_t n) {
+  return widen_microdegrees(
+      _mm_maskload_epi32((const int *)p, block_mask32(i, n)));
+}
+
+#define DEFINE_BATCH(name, T, load, maskload)                                  \
+  static double name(const T *x0, const T *y0, const T *x1, const T *y1,       \
+                     size_t n, double earth_radius, double *out) {             \
+    const __m256d radius = _mm256_set1_pd(earth_radius);                       \
+    __m256d sum = _mm256_setzero_pd();                                         \
+                                                                               \
+    size_t i = 0;                                                              \
+    for (; n - i >= 4; i += 4) {                                               \
+      __m256d d = haversine_pd(load(x0 + i), load(y0 + i), load(x1 + i),       \
+                               load(y1 + i), radius);                          \
+      if (out != NULL) {                                                       \
+        _mm256_storeu_pd(out + i, d);                                          \
+      }                                                                        \
+      sum = _mm256_add_pd(sum, d);                                             \
+    }                                                                          \
+                                                                               \
+    if (i < n) {                                                               \
+      __m256i mask = block_mask(i, n);                                         \
+      __m256d d = haversine_pd(                                                \
+          maskload(x0 + i, i, n), maskload(y0 + i, i, n),                      \
+          maskload(x1 + i, i, n), maskload(y1 + i, i, n), radius);             \
+      if (out != NULL) {                                                       \
+        _mm256_maskstore_pd(out + i, mask, d);                                 \
+      }                                                                        \
+      /* Masked out lanes compute the distance between (0, 0) and itself. */  \
+      sum = _mm256_add_pd(sum, _mm256_and_pd(d, _mm256_castsi256_pd(mask)));   \
+    }                                                                          \
+                                                                               \
+    __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(sum),                     \
+                              _mm256_extractf128_pd(sum, 1));                  \
+    return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));       \
+  }
+
+DEFINE_BATCH(batch, double, load_f64, maskload_f64)
+DEFINE_BATCH(batch_f32, float, load_f32, maskload_f32)
+DEFINE_BATCH(batch_microdegrees, int32_t, load_microdegrees,
+             maskload_microdegrees)
+
+// The point of a row in every lane.
+typedef struct {
+  __m256d sin_half_lat;
+  __m256d cos_half_lat;
+  __m256d sin_half_lon;
+  __m256d cos_half_lon;
+  __m256d cos_lat;
+} broadcast_t;
+
+static broadcast_t broadcast(const haversine_point_t *p) {
+  return (broadcast_t){
+      _mm256_set1_pd(p->sin_half_lat), _mm256_set1_pd(p->cos_half_lat),
+      _mm256_set1_pd(p->sin_half_lon), _mm256_set1_pd(p->cos_half_lon),
+      _mm256_set1_pd(p->cos_lat),
+  };
+}
+
+// a of the haversine formula for the 4 points of to from j, the same
+// operations as prepared_a() in harvestine.c. Lanes outside of mask load
+// zeros.
+static __m256d prepared_a_pd(const broadcast_t *p, const haversine_points_t *to,
+                             size_t j, __m256i mask) {
+  __m256d sin_lat = _mm256_fmsub_pd(
+      _mm256_maskload_pd(to->sin_half_lat + j, mask), p->cos_half_lat,
+      _mm256_mul_pd(_mm256_maskload_pd(to->cos_half_lat + j, mask),
+                    p->sin_half_lat));
+  __m256d sin_lon = _mm256_fmsub_pd(
+      _mm256_maskload_pd(to->sin_half_lon + j, mask), p->cos_half_lon,
+      _mm256_mul_pd(_mm256_maskload_pd(to->cos_half_lon + j, mask),
+                    p->sin_half_lon));
+  __m256d cos_lat = _mm256_maskload_pd(to->cos_lat + j, mask);
+  return _mm256_fmadd_pd(
+      _mm256_mul_pd(_mm256_mul_pd(p->cos_lat, cos_lat), sin_lon), sin_lon,
+      _mm256_mul_pd(sin_lat, sin_lat));
+}
+
+static void row(const haversine_point_t *point, const haversine_points_t *to,
+                size_t first, size_t n, double earth_radius, double *out) {
+  const broadcast_t p = broadcast(point);
+  const __m256d radius = _mm256_set1_pd(earth_radius);
+  for (size_t j = 0; j < n; j += 4) {
+    __m256i mask = block_mask(j, n);
+    __m256d half_c = asin_sqrt_pd(prepared_a_pd(&p, to, first + j, mask));
+    _mm256_maskstore_pd(out + j, mask,
+                        _mm256_mul_pd(radius, _mm256_add_pd(half_c, half_c)));
+  }
+}
+
+// The lowest a and its index in every lane, then across them. The indices
+// are kept as doubles, which hold them exactly, for blendv.
+static size_t row_nearest(const haversine_point_t *point,
+                          const haversine_points_t *to, size_t first,
+                          size_t n, double *a) {
+  const broadcast_t p = broadcast(point);
+  __m256d best = _mm256_set1_pd(INFINITY);
+  __m256d best_index = _mm256_set1_pd((double)first);
+  __m256d index = _mm256_add_pd(_mm256_set1_pd((double)first),
+                                _mm256_setr_pd(0, 1, 2, 3));
+  for (size_t j = 0; j < n; j += 4) {
+    __m256i mask = block_mask(j, n);
+    __m256d candidate = prepared_a_pd(&p, to, first + j, mask);
+    __m256d better =
+        _mm256_and_pd(_mm256_cmp_pd(candidate, best, _CMP_LT_OQ),
+                      _mm256_castsi256_pd(mask));
+    best = _mm256_blendv_pd(best, candidate, better);
+    best_index = _mm256_blendv_pd(best_index, index, better);
+    index = _mm256_add_pd(index, _mm256_set1_pd(4));
+  }
+
+  double lanes[4];
+  double indices[4];
+  _mm256_storeu_pd(lanes, best);
+  _mm256_storeu_pd(indices, best_index);
+  size_t nearest = (size_t)indices[0];
+  *a = lanes[0];
+  for (int lane = 1; lane < 4; lane++) {
+    if (lanes[lane] < *a ||
+        (lanes[lane] == *a && (size_t)indices[lane] < nearest)) {
+      *a = lanes[lane];
+      nearest = (size_t)indices[lane];
+    }
+  }
+  return nearest;
+}
+
+static double from_a(double a, double earth_radius) {
+  double half_c = harvestine_asin_sqrt(a);
+  return earth_radius * (half_c + half_c);
+}
+
+static double reduce_add(__m256d x) {
+  __m128d pair =
+      _mm_add_pd(_mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+static double reduce_min(__m256d x) {
+  __m128d pair =
+      _mm_min_pd(_mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1));
+  return _mm_cvtsd_f64(_mm_min_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+static double reduce_max(__m256d x) {
+  __m128d pair =
+      _mm_max_pd(_mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1));
+  return _mm_cvtsd_f64(_mm_max_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+static double errors(const double *x, const double *y, size_t n,
+                     double *out) {
+  const __m256d infinity = _mm256_set1_pd(INFINITY);
+  __m256d max = _mm256_setzero_pd();
+  for (size_t i = 0; i < n; i += 4) {
+    __m256i mask = block_mask(i, n);
+    __m256d error = abs_pd(_mm256_sub_pd(_mm256_maskload_pd(x + i, mask),
+                                         _mm256_maskload_pd(y + i, mask)));
+    error = _mm256_blendv_pd(error, infinity,
+                             _mm256_cmp_pd(error, error, _CMP_UNORD_Q));
+    _mm256_maskstore_pd(out + i, mask, error);
+    // Lanes outside of mask are 0, which doesn't change the maximum.
+    max = _mm256_max_pd(max, error);
+  }
+  return reduce_max(max);
+}
+
+static void moments(const double *x, size_t n, haversine_moments_t *out) {
+  size_t count = 0;
+  __m256d sum = _mm256_setzero_pd();
+  __m256d min = _mm256_set1_pd(INFINITY);
+  __m256d max = _mm256_set1_pd(-INFINITY);
+  for (size_t i = 0; i < n; i += 4) {
+    __m256i mask = block_mask(i, n);
+    __m256d v = _mm256_maskload_pd(x + i, mask);
+    __m256d numbers = _mm256_and_pd(_mm256_cmp_pd(v, v, _CMP_ORD_Q),
+                                    _mm256_castsi256_pd(mask));
+    count += __builtin_popcount(_mm256_movemask_pd(numbers));
+    sum = _mm256_add_pd(sum, _mm256_and_pd(v, numbers));
+    min = _mm256_blendv_pd(min, _mm256_min_pd(min, v), numbers);
+    max = _mm256_blendv_pd(max, _mm256_max_pd(max, v), numbers);
+  }
+  double total = reduce_add(sum);
+
+  // Again while the block is in L1, for the squares about the mean.
+  const __m256d mean = _mm256_set1_pd(count > 0 ? total / count : 0);
+  __m256d m2 = _mm256_setzero_pd();
+  for (size_t i = 0; i < n; i += 4) {
+    __m256i mask = block_mask(i, n);
+    __m256d v = _mm256_maskload_pd(x + i, mask);
+    __m256d numbers = _mm256_and_pd(_mm256_cmp_pd(v, v, _CMP_ORD_Q),
+                                    _mm256_castsi256_pd(mask));
+    __m256d difference = _mm256_and_pd(_mm256_sub_pd(v, mean), numbers);
+    m2 = _mm256_fmadd_pd(difference, difference, m2);
+  }
+  *out = (haversine_moments_t){count, total, reduce_min(min), reduce_max(max),
+                               reduce_add(m2)};
+}
+
+#define DEFINE_MAP(name, f)                                                    \
+  static void name(const double *x, size_t n, double *out) {                   \
+    for (size_t i = 0; i < n; i += 4) {                                        \
+      __m256i mask = block_mask(i, n);                                         \
+      _mm256_maskstore_pd(out + i, mask, f(_mm256_maskload_pd(x + i, mask)));  \
+    }                                                                          \
+  }
+
+DEFINE_MAP(map_sin, sin_pd)
+DEFINE_MAP(map_cos, cos_pd)
+DEFINE_MAP(map_asin, asin_pd)
+DEFINE_MAP(map_sqrt, _mm256_sqrt_pd)
+
+const haversine_kernels_t haversine_kernels_avx2 = {
+    .name = "avx2",
+    .isa = ISA_AVX2,
+    .batch = batch,
+    .batch_f32 = batch_f32,
+    .batch_microdegrees = batch_microdegrees,
+    .row = row,
+    .row_nearest = row_nearest,
+    .from_a = from_a,
+    .errors = errors,
+    .moments = moments,
+    .sin = map_sin,
+    .cos = map_cos,
+    .asin = map_asin,
+    .sqrt = map_sqrt,
+};
+
+#endif
@@ -0,0 +1,325 @@
+#include "harvestine.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "harvestine_math.h"
+
+// Eight pairs per iteration, same approximations as the AVX2 version.
+
+static __m512d horner(__m512d x, const double *coefficients, int degree) {
+  __m512d result = _mm512_set1_pd(coefficients[degree - 1]);
+  for (int i = degree - 2; i >= 0; i--) {
+    result = _mm512_fmadd_pd(result, x, _mm512_set1_pd(coefficients[i]));
+  }
+  return result;
+}
+
+// sin(x) for x in [0, pi/2].
+static __m512d sin_quadrant(__m512d x) {
+  __m512d x2 = _mm512_mul_pd(x, x);
+  __m512d p = horner(x2, harvestine_sin_coefficients, HARVESTINE_SIN_DEGREE);
+  return _mm512_fmadd_pd(_mm512_mul_pd(x, x2), p, x);
+}
+
+// sin(x) for |x| <= pi.
+static __m512d sin_pd(__m512d x) {
+  __m512d ax = _mm512_abs_pd(x);
+  __m512d reflected =
+      _mm512_add_pd(_mm512_sub_pd(_mm512_set1_pd(HARVESTINE_PI_HI), ax),
+                    _mm512_set1_pd(HARVESTINE_PI_LO));
+  __mmask8 above =
+      _mm512_cmp_pd_mask(ax, _mm512_set1_pd(HARVESTINE_PI_2_HI), _CMP_GT_OQ);
+  __m512d result = sin_quadrant(_mm512_mask_blend_pd(above, ax, reflected));
+  __m512i sign = _mm512_and_si512(_mm512_castpd_si512(x),
+                                  _mm512_set1_epi64(INT64_MIN));
+  return _mm512_castsi512_pd(
+      _mm512_or_si512(_mm512_castpd_si512(result), sign));
+}
+
+// cos(x) for |x| <= pi/2.
+static __m512d cos_pd(__m512d x) {
+  __m512d shifted = _mm512_add_pd(
+      _mm512_sub_pd(_mm512_set1_pd(HARVESTINE_PI_2_HI), _mm512_abs_pd(x)),
+      _mm512_set1_pd(HARVESTINE_PI_2_LO));
+  return sin_quadrant(_mm512_max_pd(shifted, _mm512_setzero_pd()));
+}
+
+// asin(x) = x + x^3 Q(x^2) for x in [0, 1/2], given x and x^2.
+static __m512d asin_half(__m512d x, __m512d x2) {
+  __m512d q = horner(x2, harvestine_asin_coefficients, HARVESTINE_ASIN_DEGREE);
+  return _mm512_fmadd_pd(_mm512_mul_pd(x, x2), q, x);
+}
+
+// asin(x) for x in [0, 1], given x and x^2.
+static __m512d asin_reduced(__m512d x, __m512d x2) {
+  __mmask8 big = _mm512_cmp_pd_mask(x, _mm512_set1_pd(0.5), _CMP_GT_OQ);
+  __m512d t = _mm512_mul_pd(_mm512_sub_pd(_mm512_set1_pd(1.0), x),
+                            _mm512_set1_pd(0.5));
+  __m512d y = asin_half(_mm512_mask_sqrt_pd(x, big, t),
+                        _mm512_mask_blend_pd(big, x2, t));
+
+  __m512d folded =
+      _mm512_add_pd(_mm512_fnmadd_pd(_mm512_set1_pd(2.0), y,
+                                     _mm512_set1_pd(HARVESTINE_PI_2_HI)),
+                    _mm512_set1_pd(HARVESTINE_PI_2_LO));
+  return _mm512_mask_blend_pd(big, y, folded);
+}
+
+static __m512d clamp_unit(__m512d x) {
+  return _mm512_min_pd(_mm512_max_pd(x, _mm512_setzero_pd()),
+                       _mm512_set1_pd(1.0));
+}
+
+// asin(x) for x in [0, 1].
+static __m512d asin_pd(__m512d x) {
+  x = clamp_unit(x);
+  return asin_reduced(x, _mm512_mul_pd(x, x));
+}
+
+// asin(sqrt(a)) for a in [0, 1]. a is more precise than sqrt(a)^2.
+static __m512d asin_sqrt_pd(__m512d a) {
+  a = clamp_unit(a);
+  return asin_reduced(_mm512_sqrt_pd(a), a);
+}
+
+static __m512d haversine_pd(__m512d x0, __m512d y0, __m512d x1, __m512d y1,
+                            __m512d earth_radius) {
+  const __m512d radians = _mm512_set1_pd(HARVESTINE_DEGREES_TO_RADIANS);
+  const __m512d half = _mm512_set1_pd(0.5);
+
+  __m512d d_lat = _mm512_mul_pd(radians, _mm512_sub_pd(y1, y0));
+  __m512d d_lon = _mm512_mul_pd(radians, _mm512_sub_pd(x1, x0));
+  __m512d lat1 = _mm512_mul_pd(radians, y0);
+  __m512d lat2 = _mm512_mul_pd(radians, y1);
+
+  __m512d sin_lat = sin_pd(_mm512_mul_pd(d_lat, half));
+  __m512d sin_lon = sin_pd(_mm512_mul_pd(d_lon, half));
+  __m512d a = _mm512_fmadd_pd(
+      _mm512_mul_pd(_mm512_mul_pd(cos_pd(lat1), cos_pd(lat2)), sin_lon),
+      sin_lon, _mm512_mul_pd(sin_lat, sin_lat));
+
+  __m512d half_c = asin_sqrt_pd(a);
+  return _mm512_mul_pd(earth_radius, _mm512_add_pd(half_c, half_c));
+}
+
+// Lanes of the 8-pair block at offset i that are inside [0, n).
+static __mmask8 block_mask(size_t i, size_t n) {
+  size_t left = n - i;
+  return left >= 8 ? 0xFF : (__mmask8)((1u << left) - 1);
+}
+
+static __m512d load_f64(const double *p, __mmask8 valid) {
+  return _mm512_maskz_loadu_pd(valid, p);
+}
+
+// 16-lane loads with only the low 8 lanes in the mask, AVX-512F has no
+// masked 256-bit ones.
+static __m512d load_f32(const float *p, __mmask8 valid) {
+  return _mm512_cvtps_pd(
+      _mm512_castps512_ps256(_mm512_maskz_loadu_ps((__mmask16)valid, p)));
+}
+
+static __m512d load_microdegrees(const int32_t *p, __mmask8 valid) {
+  __m256i micro =
+      _mm512_castsi512_si256(_mm512_maskz_loadu_epi32((__mmask16)valid, p));
+  return _mm512_mul_pd(_mm512_cvtepi32_pd(micro),
+                       _mm512_set1_pd(HARVESTINE_DEGREES_PER_MICRODEGREE));
+}
+
+// Masked loads don't touch the lanes outside of the mask, so there's no
+// scalar tail.
+#define DEFINE_BATCH(name, T, load)                                            \
+  static double name(const T *x0, const T *y0, const T *x1, const T *y1,       \
+                     size_t n, double earth_radius, double *out) {             \
+    const __m512d radius = _mm512_set1_pd(earth_radius);                       \
+    __m512d sum = _mm512_setzero_pd();                                         \
+    for (size_t i = 0; i < n; i += 8) {                                        \
+      __mmask8 valid = block_mask(i, n);                                       \
+      __m512d d = haversine_pd(load(x0 + i, valid), load(y0 + i, valid),       \
+                               load(x1 + i, valid), load(y1 + i, valid),       \
+                               radius);                                        \
+      if (out != NULL) {                                                       \
+        _mm512_mask_storeu_pd(out + i, valid, d);                              \
+      }                                                                        \
+      sum = _mm512_mask_add_pd(sum, valid, sum, d);                            \
+    }                                                                          \
+    return _mm512_reduce_add_pd(sum);                                          \
+  }
+
+DEFINE_BATCH(batch, double, load_f64)
+DEFINE_BATCH(batch_f32, float, load_f32)
+DEFINE_BATCH(batch_microdegrees, int32_t, load_microdegrees)
+
+// The point of a row in every lane.
+typedef struct {
+  __m512d sin_half_lat;
+  __m512d cos_half_lat;
+  __m512d sin_half_lon;
+  __m512d cos_half_lon;
+  __m512d cos_lat;
+} broadcast_t;
+
+static broadcast_t broadcast(const haversine_point_t *p) {
+  return (broadcast_t){
+      _mm512_set1_pd(p->sin_half_lat), _mm512_set1_pd(p->cos_half_lat),
+      _mm512_set1_pd(p->sin_half_lon), _mm512_set1_pd(p->cos_half_lon),
+      _mm512_set1_pd(p->cos_lat),
+  };
+}
+
+// a of the haversine formula for the 8 points of to from j, the same
+// operations as prepared_a() in harvestine.c.
+static __m512d prepared_a_pd(const broadcast_t *p, const haversine_points_t *to,
+                             size_t j, __mmask8 valid) {
+  __m512d sin_lat = _mm512_fmsub_pd(
+      _mm512_maskz_loadu_pd(valid, to->sin_half_lat + j), p->cos_half_lat,
+      _mm512_mul_pd(_mm512_maskz_loadu_pd(valid, to->cos_half_lat + j),
+                    p->sin_half_lat));
+  __m512d sin_lon = _mm512_fmsub_pd(
+      _mm512_maskz_loadu_pd(valid, to->sin_half_lon + j), p->cos_half_lon,
+      _mm512_mul_pd(_mm512_maskz_loadu_pd(valid, to->cos_half_lon + j),
+                    p->sin_half_lon));
+  __m512d cos_lat = _mm512_maskz_loadu_pd(valid, to->cos_lat + j);
+  return _mm512_fmadd_pd(
+      _mm512_mul_pd(_mm512_mul_pd(p->cos_lat, cos_lat), sin_lon), sin_lon,
+      _mm512_mul_pd(sin_lat, sin_lat));
+}
+
+static void row(const haversine_point_t *point, const haversine_points_t *to,
+                size_t first, size_t n, double earth_radius, double *out) {
+  const broadcast_t p = broadcast(point);
+  const __m512d radius = _mm512_set1_pd(earth_radius);
+  for (size_t j = 0; j < n; j += 8) {
+    __mmask8 valid = block_mask(j, n);
+    __m512d half_c = asin_sqrt_pd(prepared_a_pd(&p, to, first + j, valid));
+    _mm512_mask_storeu_pd(out + j, valid,
+                          _mm512_mul_pd(radius, _mm512_add_pd(half_c, half_c)));
+  }
+}
+
+// The lowest a and its index in every lane, then across them.
+static size_t row_nearest(const haversine_point_t *point,
+                          const haversine_points_t *to, size_t first,
+                          size_t n, double *a) {
+  const broadcast_t p = broadcast(point);
+  __m512d best = _mm512_set1_pd(INFINITY);
+  __m512i best_index = _mm512_set1_epi64((int64_t)first);
+  __m512i index = _mm512_add_epi64(_mm512_set1_epi64((int64_t)first),
+                                   _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7));
+  for (size_t j = 0; j < n; j += 8) {
+    __mmask8 valid = block_mask(j, n);
+    __m512d candidate = prepared_a_pd(&p, to, first + j, valid);
+    __mmask8 better =
+        _mm512_mask_cmp_pd_mask(valid, candidate, best, _CMP_LT_OQ);
+    best = _mm512_mask_mov_pd(best, better, candidate);
+    best_index = _mm512_mask_mov_epi64(best_index, better, index);
+    index = _mm512_add_epi64(index, _mm512_set1_epi64(8));
+  }
+
+  double lanes[8];
+  int64_t indices[8];
+  _mm512_storeu_pd(lanes, best);
+  _mm512_storeu_si512(indices, best_index);
+  size_t nearest = (size_t)indices[0];
+  *a = lanes[0];
+  for (int lane = 1; lane < 8; lane++) {
+    if (lanes[lane] < *a ||
+        (lanes[lane] == *a && (size_t)indices[lane] < nearest)) {
+      *a = lanes[lane];
+      nearest = (size_t)indices[lane];
+    }
+  }
+  return nearest;
+}
+
+static double from_a(double a, double earth_radius) {
+  double half_c = harvestine_asin_sqrt(a);
+  return earth_radius * (half_c + half_c);
+}
+
+static double errors(const double *x, const double *y, size_t n,
+                     double *out) {
+  const __m512d infinity = _mm512_set1_pd(INFINITY);
+  __m512d max = _mm512_setzero_pd();
+  for (size_t i = 0; i < n; i += 8) {
+    __mmask8 valid = block_mask(i, n);
+    __m512d error =
+        _mm512_abs_pd(_mm512_sub_pd(_mm512_maskz_loadu_pd(valid, x + i),
+                                    _mm512_maskz_loadu_pd(valid, y + i)));
+    error = _mm512_mask_mov_pd(
+        error, _mm512_cmp_pd_mask(error, error, _CMP_UNORD_Q), infinity);
+    _mm512_mask_storeu_pd(out + i, valid, error);
+    // Lanes outside of valid are 0, which doesn't change the maximum.
+    max = _mm512_max_pd(max, error);
+  }
+  return _mm512_reduce_max_pd(max);
+}
+
+static void moments(const double *x, size_t n, haversine_moments_t *out) {
+  size_t count = 0;
+  __m512d sum = _mm512_setzero_pd();
+  __m512d min = _mm512_set1_pd(INFINITY);
+  __m512d max = _mm512_set1_pd(-INFINITY);
+  for (size_t i = 0; i < n; i += 8) {
+    __mmask8 valid = block_mask(i, n);
+    __m512d v = _mm512_maskz_loadu_pd(valid, x + i);
+    __mmask8 numbers = _mm512_mask_cmp_pd_mask(valid, v, v, _CMP_ORD_Q);
+    count += __builtin_popcount(numbers);
+    sum = _mm512_mask_add_pd(sum, numbers, sum, v);
+    min = _mm512_mask_min_pd(min, numbers, min, v);
+    max = _mm512_mask_max_pd(max, numbers, max, v);
+  }
+  double total = _mm512_reduce_add_pd(sum);
+
+  // Again while the block is in L1, for the squares about the mean.
+  const __m512d mean = _mm512_set1_pd(count > 0 ? total / count : 0);
+  __m512d m2 = _mm512_setzero_pd();
+  for (size_t i = 0; i < n; i += 8) {
+    __mmask8 valid = block_mask(i, n);
+    __m512d v = _mm512_maskz_loadu_pd(valid, x + i);
+    __mmask8 numbers = _mm512_mask_cmp_pd_mask(valid, v, v, _CMP_ORD_Q);
+    __m512d difference = _mm512_sub_pd(v, mean);
+    m2 = _mm512_mask_mov_pd(m2, numbers,
+                            _mm512_fmadd_pd(difference, difference, m2));
+  }
+  *out = (haversine_moments_t){count, total, _mm512_reduce_min_pd(min),
+                               _mm512_reduce_max_pd(max),
+                               _mm512_reduce_add_pd(m2)};
+}
+
+#define DEFINE_MAP(name, f)                                                    \
+  static void name(const double *x, size_t n, double *out) {                   \
+    for (size_t i = 0; i < n; i += 8) {                                        \
+      __mmask8 valid = block_mask(i, n);                                       \
+      _mm512_mask_storeu_pd(out + i, valid,                                    \
+                            f(_mm512_maskz_loadu_pd(valid, x + i)));           \
+    }                                                                          \
+  }
+
+DEFINE_MAP(map_sin, sin_pd)
+DEFINE_MAP(map_cos, cos_pd)
+DEFINE_MAP(map_asin, asin_pd)
+DEFINE_MAP(map_sqrt, _mm512_sqrt_pd)
+
+const haversine_kernels_t haversine_kernels_avx512 = {
+    .name = "avx512",
+    .isa = ISA_AVX512,
+    .batch = batch,
+    .batch_f32 = batch_f32,
+    .batch_microdegrees = batch_microdegrees,
+    .row = row,
+    .row_nearest = row_nearest,
+    .from_a = from_a,
+    .errors = errors,
+    .moments = moments,
+    .sin = map_sin,
+    .cos = map_cos,
+    .asin = map_asin,
+    .sqrt = map_sqrt,
+};
+
+#endif
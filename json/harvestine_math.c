@@ -0,0 +1,76 @@
+#include "harvestine_math.h"
+
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#endif
+
+// Every step is the same operation, fused or not, as in the vector kernels,
+// so that all of them produce the same bits for the same input. fma() is a
+// single instruction on anything recent, glibc picks it at load time.
+
+static double horner(double x, const double *coefficients, int degree) {
+  double result = coefficients[degree - 1];
+  for (int i = degree - 2; i >= 0; i--) {
+    result = fma(result, x, coefficients[i]);
+  }
+  return result;
+}
+
+// sin(x) for x in [0, pi/2].
+static double sin_quadrant(double x) {
+  double x2 = x * x;
+  return fma(x * x2,
+             horner(x2, harvestine_sin_coefficients, HARVESTINE_SIN_DEGREE), x);
+}
+
+double harvestine_sin(double x) {
+  double ax = fabs(x);
+  if (ax > HARVESTINE_PI_2_HI) {
+    ax = (HARVESTINE_PI_HI - ax) + HARVESTINE_PI_LO;
+  }
+  return copysign(sin_quadrant(ax), x);
+}
+
+double harvestine_cos(double x) {
+  double shifted = (HARVESTINE_PI_2_HI - fabs(x)) + HARVESTINE_PI_2_LO;
+  return sin_quadrant(shifted > 0 ? shifted : 0);
+}
+
+// asin(x) for x in [0, 1/2], given x and x^2.
+static double asin_half(double x, double x2) {
+  return fma(x * x2,
+             horner(x2, harvestine_asin_coefficients, HARVESTINE_ASIN_DEGREE),
+             x);
+}
+
+// asin(x) for x in [0, 1], given x and x^2.
+static double asin_reduced(double x, double x2) {
+  if (x <= 0.5) {
+    return asin_half(x, x2);
+  }
+  double t = (1.0 - x) * 0.5;
+  return (HARVESTINE_PI_2_HI - 2.0 * asin_half(harvestine_sqrt(t), t)) +
+         HARVESTINE_PI_2_LO;
+}
+
+static double clamp_unit(double x) { return x < 0 ? 0 : x > 1 ? 1 : x; }
+
+double harvestine_asin(double x) {
+  x = clamp_unit(x);
+  return asin_reduced(x, x * x);
+}
+
+double harvestine_asin_sqrt(double a) {
+  a = clamp_unit(a);
+  return asin_reduced(harvestine_sqrt(a), a);
+}
+
+double harvestine_sqrt(double x) {
+#if defined(__x86_64__) || defined(__i386__)
+  return _mm_cvtsd_f64(_mm_sqrt_sd(_mm_setzero_pd(), _mm_set_sd(x)));
+#else
+  return sqrt(x);
+#endif
+}
@@ -0,0 +1,64 @@
+#ifndef HARVESTINE_MATH_H_
+#define HARVESTINE_MATH_H_
+
+// Replacements for the libm functions in reference_haversine(), specialized
+// to the arguments the haversine formula can produce for coordinates in
+// range. They skip the general range reduction and special cases of libm and
+// are only valid on these domains:
+//
+//   sin(x)          |x| <= pi, reduced to [0, pi/2] by symmetry
+//   cos(x)          |x| <= pi/2, computed as sin(pi/2 - |x|)
+//   asin(x)         0 <= x <= 1, reduced to [0, 1/2] by
+//                   asin(x) = pi/2 - 2 asin(sqrt((1 - x) / 2)) for x > 1/2
+//
+// The coefficients are Chebyshev fits of
+//
+//   sin(x) = x + x^3 P(x^2)     x^2 in [0, (pi/2)^2]
+//   asin(x) = x + x^3 Q(x^2)    x^2 in [0, 1/4]
+//
+// with |error| below 1e-18 and 6e-17 respectively, so what's left is the
+// rounding of the evaluation itself, a couple of ulps at most.
+//
+// The scalar versions are declared below. The vector kernels inline their
+// own copies and expose them through haversine_kernels_t for testing. All of
+// them perform the same sequence of operations, so every tier returns the
+// same bits for the same input.
+
+// pi and pi/2 split into the nearest double and the rest, so that pi - x and
+// pi/2 - x keep their precision when x is close.
+#define HARVESTINE_PI_HI 3.141592653589793116
+#define HARVESTINE_PI_LO 1.224646799147353207e-16
+#define HARVESTINE_PI_2_HI 1.570796326794896558
+#define HARVESTINE_PI_2_LO 6.123233995736766036e-17
+
+#define HARVESTINE_DEGREES_TO_RADIANS 0.01745329251994329577
+
+// Lowest degree first.
+#define HARVESTINE_SIN_DEGREE 8
+static const double harvestine_sin_coefficients[HARVESTINE_SIN_DEGREE] = {
+    -0.16666666666666666,     0.008333333333333316,
+    -0.00019841269841254974,  2.7557319219163234e-06,
+    -2.5052107616996182e-08,  1.6058977312464087e-10,
+    -7.643970296798572e-13,   2.7314447669863995e-15,
+};
+
+#define HARVESTINE_ASIN_DEGREE 12
+static const double harvestine_asin_coefficients[HARVESTINE_ASIN_DEGREE] = {
+    0.1666666666666665,    0.07500000000020764,   0.044642857103423646,
+    0.03038194736709848,   0.02237204763174451,   0.017355259955786323,
+    0.013929652902326633,  0.011875494382636922,  0.0078029494773533175,
+    0.01603551434914882,   -0.010749050339697808, 0.028169218060881414,
+};
+
+// |x| <= pi
+double harvestine_sin(double x);
+// |x| <= pi/2
+double harvestine_cos(double x);
+// 0 <= x <= 1
+double harvestine_asin(double x);
+// asin(sqrt(a)) for 0 <= a <= 1. Uses a where asin() would square sqrt(a).
+double harvestine_asin_sqrt(double a);
+// x >= 0, the correctly rounded hardware instruction where there is one.
+double harvestine_sqrt(double x);
+
+#endif // HARVESTINE_MATH_H_
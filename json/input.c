@@ -0,0 +1,120 @@
+#include "input.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "page_alloc.h"
+
+static bool read_file(input_t *input, int fd, size_t len) {
+  char *data = (char *)page_alloc(len + 1);
+  if (data == NULL) {
+    return false;
+  }
+
+  size_t total = 0;
+  while (total < len) {
+    ssize_t n = read(fd, data + total, len - total);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      // The file shrank under us if n == 0.
+      if (n == 0) {
+        errno = EIO;
+      }
+      page_free(data);
+      return false;
+    }
+    total += n;
+  }
+  data[len] = '\0';
+
+  input->data = data;
+  input->len = len;
+  return true;
+}
+
+// Reserves room for the file and the NUL in anonymous memory, then maps the
+// file over the start of it. What's left of the last page of the file reads
+// as zeros, and if the file fills its last page exactly the NUL comes from
+// the reservation instead, so there is always one.
+static bool map_file(input_t *input, int fd, size_t len, bool populate) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t mapped = (len + 1 + page - 1) / page * page;
+
+  char *base = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+
+  if (len > 0) {
+    int flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_POPULATE
+    if (populate) {
+      flags |= MAP_POPULATE;
+    }
+#else
+    (void)populate;
+#endif
+    if (mmap(base, len, PROT_READ | PROT_WRITE, flags, fd, 0) == MAP_FAILED) {
+      int error = errno;
+      munmap(base, mapped);
+      errno = error;
+      return false;
+    }
+    // The parsers go through the input front to back, once. Only hints,
+    // failures don't matter.
+    madvise(base, len, MADV_SEQUENTIAL);
+    madvise(base, len, MADV_WILLNEED);
+  }
+
+  input->data = base;
+  input->len = len;
+  input->mapped = mapped;
+  return true;
+}
+
+bool input_open(input_t *input, const char *filename, input_mode_t mode,
+                bool populate) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return false;
+  }
+
+  input->mode = mode;
+  input->mapped = 0;
+  bool opened = mode == INPUT_MMAP
+                    ? map_file(input, fd, (size_t)st.st_size, populate)
+                    : read_file(input, fd, (size_t)st.st_size);
+  // A mapping stays valid after the descriptor is closed.
+  int error = errno;
+  close(fd);
+  errno = error;
+  return opened;
+}
+
+void input_close(input_t *input) {
+  if (input->data == NULL) {
+    return;
+  }
+  if (input->mode == INPUT_MMAP) {
+    munmap(input->data, input->mapped);
+  } else {
+    page_free(input->data);
+  }
+  input->data = NULL;
+  input->len = 0;
+}
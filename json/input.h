@@ -0,0 +1,32 @@
+#ifndef INPUT_H_
+#define INPUT_H_
+
+// The input file as one NUL-terminated, writable buffer, the way the
+// parsers want it.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+  // Read into a buffer from page_alloc().
+  INPUT_READ,
+  // Mapped privately. Pages are read in on first access, so the time moves
+  // from opening the input to parsing it, unless populate is set.
+  INPUT_MMAP,
+} input_mode_t;
+
+typedef struct {
+  char *data; // len bytes followed by a NUL
+  size_t len;
+  input_mode_t mode;
+  // INPUT_MMAP: bytes mapped, the file and at least one more for the NUL.
+  size_t mapped;
+} input_t;
+
+// With INPUT_MMAP, populate prefaults the whole mapping up front
+// (MAP_POPULATE) where supported. Returns false and sets errno on failure.
+bool input_open(input_t *input, const char *filename, input_mode_t mode,
+                bool populate);
+void input_close(input_t *input);
+
+#endif // INPUT_H_
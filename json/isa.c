@@ -0,0 +1,88 @@
+#include "isa.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <stdint.h>
+
+// Bits of XCR0 the OS sets when it saves the corresponding register state.
+#define XCR0_SSE (1 << 1)
+#define XCR0_AVX (1 << 2)
+#define XCR0_AVX512 (7 << 5) // opmask, upper ZMM halves, ZMM16-31
+
+static uint64_t xgetbv(void) {
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((uint64_t)edx << 32) | eax;
+}
+
+static isa_t detect(void) {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return ISA_SCALAR;
+  }
+
+  if (!(ecx & bit_SSE4_2)) {
+    return ISA_SCALAR;
+  }
+
+  bool has_fma = ecx & bit_FMA;
+  bool has_osxsave = ecx & bit_OSXSAVE;
+  uint64_t xcr0 = has_osxsave ? xgetbv() : 0;
+  if (!has_fma || (xcr0 & (XCR0_SSE | XCR0_AVX)) != (XCR0_SSE | XCR0_AVX)) {
+    return ISA_SSE42;
+  }
+
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return ISA_SSE42;
+  }
+
+  if (!(ebx & bit_AVX2) || !(ebx & bit_BMI2)) {
+    return ISA_SSE42;
+  }
+
+  if (!(ebx & bit_AVX512F) || !(ebx & bit_AVX512BW) ||
+      (xcr0 & XCR0_AVX512) != XCR0_AVX512) {
+    return ISA_AVX2;
+  }
+
+  return ISA_AVX512;
+}
+
+#else
+
+static isa_t detect(void) { return ISA_SCALAR; }
+
+#endif
+
+isa_t isa_detect(void) {
+  static bool detected = false;
+  static isa_t isa;
+  if (!detected) {
+    isa = detect();
+    detected = true;
+  }
+  return isa;
+}
+
+bool isa_supported(isa_t isa) { return isa <= isa_detect(); }
+
+static const char *names[ISA_COUNT] = {
+    [ISA_SCALAR] = "scalar",
+    [ISA_SSE42] = "sse4.2",
+    [ISA_AVX2] = "avx2",
+    [ISA_AVX512] = "avx512",
+};
+
+const char *isa_name(isa_t isa) { return names[isa]; }
+
+bool isa_from_name(const char *name, isa_t *isa) {
+  for (int i = 0; i < ISA_COUNT; i++) {
+    if (strcmp(names[i], name) == 0) {
+      *isa = (isa_t)i;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,25 @@
+#ifndef ISA_H_
+#define ISA_H_
+
+#include <stdbool.h>
+
+// Instruction set tiers that kernels can be specialized for, in increasing
+// order. Each tier implies the ones below it.
+typedef enum {
+  ISA_SCALAR, // portable C, SWAR at most
+  ISA_SSE42,
+  ISA_AVX2,   // together with FMA and BMI2
+  ISA_AVX512, // F and BW
+  ISA_COUNT,
+} isa_t;
+
+// Best tier supported by the CPU and the OS. Always ISA_SCALAR on
+// non-x86 builds.
+isa_t isa_detect(void);
+bool isa_supported(isa_t isa);
+
+const char *isa_name(isa_t isa);
+// Accepts the names returned by isa_name().
+bool isa_from_name(const char *name, isa_t *isa);
+
+#endif // ISA_H_
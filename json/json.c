@@ -1,11 +1,10 @@
 #include "json.h"
 
 #include <assert.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include "json_lexer.h"
-
 // JSON data model.
 
 json_object_t json_new_number(double value) {
@@ -19,8 +18,41 @@ json_object_t json_new_number(double value) {
   return obj;
 }
 
+json_object_t json_new_int64(int64_t value) {
+  json_object_t obj = {
+      .typ = JSON_NUMBER,
+      .number_repr = JSON_NUMBER_INT64,
+      .val =
+          {
+              .integer = value,
+          },
+  };
+  return obj;
+}
+
+static json_object_t json_new_lazy_number(const char *text, int len) {
+  json_lazy_number_t *lazy =
+      (json_lazy_number_t *)json_alloc(sizeof(json_lazy_number_t));
+  lazy->text = text;
+  lazy->len = len;
+  lazy->converted = false;
+  lazy->is_integer = false;
+  lazy->integer = 0;
+  lazy->value = 0;
+
+  json_object_t obj = {
+      .typ = JSON_NUMBER,
+      .number_repr = JSON_NUMBER_LAZY,
+      .val =
+          {
+              .lazy_number = lazy,
+          },
+  };
+  return obj;
+}
+
 json_object_t json_new_string(const char *value) {
-  char *string_copy = strdup(value);
+  char *string_copy = json_strdup(value);
   json_object_t obj = {
       .typ = JSON_STRING,
       .val =
@@ -74,11 +106,13 @@ json_object_t json_new_null(void) {
 void json_free(json_object_t obj) {
   switch (obj.typ) {
   case JSON_NUMBER:
-    // noop
+    if (obj.number_repr == JSON_NUMBER_LAZY) {
+      json_dealloc(obj.val.lazy_number);
+    }
     break;
   case JSON_STRING: {
     if (obj.val.string != NULL) {
-      free(obj.val.string);
+      json_dealloc(obj.val.string);
     }
   } break;
   case JSON_BOOLEAN:
@@ -100,7 +134,7 @@ void json_free(json_object_t obj) {
     // We own the key strings, so we need to carefully deallocate them.
     // First, copy all keys into a buffer.
     int len = shlen(obj.val.dict);
-    char **keys = (char **)malloc(sizeof(char *) * len);
+    char **keys = (char **)json_alloc(sizeof(char *) * len);
     for (int i = 0; i < len; i++) {
       keys[i] = obj.val.dict[i].key;
     }
@@ -110,11 +144,11 @@ void json_free(json_object_t obj) {
 
     // Deallocate each key.
     for (int i = 0; i < len; i++) {
-      free(keys[i]);
+      json_dealloc(keys[i]);
     }
 
     // Finally, get rid of the buffer we just allocated.
-    free(keys);
+    json_dealloc(keys);
     break;
   }
   }
@@ -129,9 +163,68 @@ bool json_is_dict(json_object_t obj) { return obj.typ == JSON_DICT; }
 bool json_is_array(json_object_t obj) { return obj.typ == JSON_ARRAY; }
 bool json_is_null(json_object_t obj) { return obj.typ == JSON_NULL; }
 
+static json_lazy_number_t *json_convert_lazy_number(json_object_t obj);
+
+bool json_is_integer(json_object_t obj) {
+  if (obj.typ != JSON_NUMBER) {
+    return false;
+  }
+  if (obj.number_repr == JSON_NUMBER_LAZY) {
+    return json_convert_lazy_number(obj)->is_integer;
+  }
+  return obj.number_repr == JSON_NUMBER_INT64;
+}
+
+// The text is followed by the rest of the input, so it is copied out to
+// keep strtod() from reading past it. Numbers are cut off where the lexer
+// cuts them off when it converts them itself, which keeps the copy on the
+// stack and gives the same value either way.
+static double parse_lazy_double(const char *text, int len) {
+  char buffer[JSON_LEXER_MAX_STRING + 1];
+  if (len > JSON_LEXER_MAX_STRING) {
+    len = JSON_LEXER_MAX_STRING;
+  }
+  memcpy(buffer, text, len);
+  buffer[len] = '\0';
+  return strtod(buffer, NULL);
+}
+
+static json_lazy_number_t *json_convert_lazy_number(json_object_t obj) {
+  json_lazy_number_t *lazy = obj.val.lazy_number;
+  if (lazy->converted) {
+    return lazy;
+  }
+
+  lazy->is_integer =
+      json_lexer_parse_integer(lazy->text, lazy->len, &lazy->integer);
+  if (lazy->is_integer) {
+    lazy->value = (double)lazy->integer;
+  } else {
+    lazy->value = parse_lazy_double(lazy->text, lazy->len);
+  }
+
+  lazy->converted = true;
+  return lazy;
+}
+
 double json_get_number(json_object_t obj) {
   assert(obj.typ == JSON_NUMBER);
-  return obj.val.number;
+  switch (obj.number_repr) {
+  case JSON_NUMBER_INT64:
+    return (double)obj.val.integer;
+  case JSON_NUMBER_LAZY:
+    return json_convert_lazy_number(obj)->value;
+  default:
+    return obj.val.number;
+  }
+}
+
+int64_t json_get_int64(json_object_t obj) {
+  assert(json_is_integer(obj));
+  if (obj.number_repr == JSON_NUMBER_LAZY) {
+    return json_convert_lazy_number(obj)->integer;
+  }
+  return obj.val.integer;
 }
 
 char *json_get_string(json_object_t obj) {
@@ -168,7 +261,7 @@ json_object_t json_array_get(json_object_t obj, int index) {
 
 void json_dict_set(json_object_t *obj, const char *key, json_object_t value) {
   assert(obj->typ == JSON_DICT);
-  char *key_copy = strdup(key);
+  char *key_copy = json_strdup(key);
   shput(obj->val.dict, key_copy, value);
 }
 
@@ -202,7 +295,11 @@ char *json_dict_get_key(json_object_t obj, int i) {
 void json_fprint(FILE *out, json_object_t obj) {
   switch (obj.typ) {
   case JSON_NUMBER:
-    fprintf(out, "%g", json_get_number(obj));
+    if (json_is_integer(obj)) {
+      fprintf(out, "%" PRId64, json_get_int64(obj));
+    } else {
+      fprintf(out, "%g", json_get_number(obj));
+    }
     break;
   case JSON_STRING:
     fprintf(out, "\"%s\"", json_get_string(obj));
@@ -249,15 +346,42 @@ void json_print(json_object_t obj) { json_fprint(stdout, obj); }
 
 // JSON parsing.
 
-bool json_parse_array(json_lexer_t *lexer, json_object_t *output);
-bool json_parse_dict(json_lexer_t *lexer, json_object_t *output);
+bool json_parse_array(json_parser_t *parser, json_object_t *output);
+bool json_parse_dict(json_parser_t *parser, json_object_t *output);
+
+static void json_parser_push(json_parser_t *parser, json_object_t obj) {
+  if (parser->stack_len == parser->stack_cap) {
+    parser->stack_cap = parser->stack_cap ? parser->stack_cap * 2 : 64;
+    // The stack outlives individual documents, so it bypasses the arena.
+    parser->stack = (json_object_t *)parser->allocator.realloc(
+        parser->allocator.ctx, parser->stack,
+        sizeof(json_object_t) * parser->stack_cap);
+  }
+  parser->stack[parser->stack_len++] = obj;
+}
+
+// Frees everything pushed after base and pops it off the stack.
+static void json_parser_unwind(json_parser_t *parser, int base) {
+  for (int i = base; i < parser->stack_len; i++) {
+    json_free(parser->stack[i]);
+  }
+  parser->stack_len = base;
+}
 
 // This is a hack for handling empty arrays [].
 // We split json_parse_value() into two parts so we can have
 // json_parse_value_in_array().
-bool json_parse_value_cont(json_lexer_t *lexer, json_object_t *output) {
+bool json_parse_value_cont(json_parser_t *parser, json_object_t *output) {
+  json_lexer_t *lexer = &parser->lexer;
+
   if (lexer->token == JSON_TOK_NUMBER) {
-    *output = json_new_number(lexer->numeric_value);
+    if (lexer->lazy_numbers) {
+      *output = json_new_lazy_number(lexer->number_start, lexer->number_len);
+    } else if (lexer->is_integer) {
+      *output = json_new_int64(lexer->integer_value);
+    } else {
+      *output = json_new_number(lexer->numeric_value);
+    }
     return true;
   }
 
@@ -282,27 +406,29 @@ bool json_parse_value_cont(json_lexer_t *lexer, json_object_t *output) {
   }
 
   if (lexer->token == '[') {
-    return json_parse_array(lexer, output);
+    return json_parse_array(parser, output);
   }
 
   if (lexer->token == '{') {
-    return json_parse_dict(lexer, output);
+    return json_parse_dict(parser, output);
   }
 
   return true;
 }
 
-bool json_parse_value(json_lexer_t *lexer, json_object_t *output) {
-  if (!json_lexer_get_token(lexer)) {
+bool json_parse_value(json_parser_t *parser, json_object_t *output) {
+  if (!json_lexer_get_token(&parser->lexer)) {
     fprintf(stderr, "json error: Unexpected EOF\n");
     return false;
   }
 
-  return json_parse_value_cont(lexer, output);
+  return json_parse_value_cont(parser, output);
 }
 
-bool json_parse_value_in_array(json_lexer_t *lexer, json_object_t *output,
+bool json_parse_value_in_array(json_parser_t *parser, json_object_t *output,
                                bool *is_array_end) {
+  json_lexer_t *lexer = &parser->lexer;
+
   *is_array_end = false;
   if (!json_lexer_get_token(lexer)) {
     fprintf(stderr, "json error: Unexpected EOF\n");
@@ -314,28 +440,31 @@ bool json_parse_value_in_array(json_lexer_t *lexer, json_object_t *output,
     return false;
   }
 
-  return json_parse_value_cont(lexer, output);
+  return json_parse_value_cont(parser, output);
 }
 
-bool json_parse_array(json_lexer_t *lexer, json_object_t *output) {
-  json_object_t array = json_new_array();
+bool json_parse_array(json_parser_t *parser, json_object_t *output) {
+  json_lexer_t *lexer = &parser->lexer;
+  // Elements are collected on the scratch stack first, so that the array
+  // itself is allocated only once with the exact size.
+  int base = parser->stack_len;
 
   while (true) {
     json_object_t elem;
     bool is_array_end = false;
-    if (!json_parse_value_in_array(lexer, &elem, &is_array_end)) {
+    if (!json_parse_value_in_array(parser, &elem, &is_array_end)) {
       if (is_array_end) {
         break;
       }
-      return false;
+      goto cleanup;
     }
 
-    json_array_append(&array, elem);
+    json_parser_push(parser, elem);
 
     if (!json_lexer_get_token(lexer)) {
       fprintf(stderr,
               "json error: Unexpected EOF when parsing array seprator\n");
-      return false;
+      goto cleanup;
     }
 
     if (lexer->token == ']') {
@@ -351,14 +480,27 @@ bool json_parse_array(json_lexer_t *lexer, json_object_t *output) {
             "json error: Unexpected token when parsing array "
             "separator: %d\n",
             lexer->token);
-    return false;
+    goto cleanup;
   }
 
+  json_object_t array = json_new_array();
+  int len = parser->stack_len - base;
+  if (len > 0) {
+    arrsetlen(array.val.array, len);
+    memcpy(array.val.array, parser->stack + base, sizeof(json_object_t) * len);
+  }
+  parser->stack_len = base;
+
   *output = array;
   return true;
+
+cleanup:
+  json_parser_unwind(parser, base);
+  return false;
 }
 
-bool json_parse_dict(json_lexer_t *lexer, json_object_t *output) {
+bool json_parse_dict(json_parser_t *parser, json_object_t *output) {
+  json_lexer_t *lexer = &parser->lexer;
   json_object_t dict = json_new_dict();
   char *key = NULL;
 
@@ -380,7 +522,7 @@ bool json_parse_dict(json_lexer_t *lexer, json_object_t *output) {
       goto cleanup;
     }
 
-    key = strdup(lexer->string_value);
+    key = json_strdup(lexer->string_value);
 
     if (!json_lexer_get_token(lexer)) {
       fprintf(stderr,
@@ -396,12 +538,12 @@ bool json_parse_dict(json_lexer_t *lexer, json_object_t *output) {
     }
 
     json_object_t value;
-    if (!json_parse_value(lexer, &value)) {
+    if (!json_parse_value(parser, &value)) {
       goto cleanup;
     }
 
-    json_dict_set(&dict, key, value);
-    free(key);
+    // The dict takes ownership of the key.
+    shput(dict.val.dict, key, value);
     key = NULL;
 
     if (!json_lexer_get_token(lexer)) {
@@ -430,15 +572,81 @@ bool json_parse_dict(json_lexer_t *lexer, json_object_t *output) {
 
 cleanup:
   if (key != NULL) {
-    free(key);
+    json_dealloc(key);
   }
+  json_free(dict);
   return false;
 }
 
+static bool json_parse_document(json_parser_t *parser, const char *input,
+                                size_t len, json_object_t *output) {
+  json_lexer_reset(&parser->lexer, input, len);
+  parser->lexer.lazy_numbers = parser->lazy_numbers;
+  return json_parse_value(parser, output);
+}
+
 bool json_parse(const char *input, json_object_t *output) {
-  json_lexer_t lexer;
-  json_lexer_init(&lexer, input);
-  bool result = json_parse_value(&lexer, output);
-  json_lexer_free(&lexer);
+  return json_parse_len(input, strlen(input), output);
+}
+
+bool json_parse_len(const char *input, size_t len, json_object_t *output) {
+  // A one-off parser without an active arena: the document is allocated with
+  // the regular allocator and is owned by the caller.
+  json_parser_t parser;
+  json_parser_init(&parser);
+  bool result = json_parse_document(&parser, input, len, output);
+  json_parser_free(&parser);
+  return result;
+}
+
+// Reusable parser.
+
+void json_parser_init(json_parser_t *parser) {
+  json_parser_init_with_allocator(parser, json_get_allocator());
+}
+
+void json_parser_init_with_allocator(json_parser_t *parser,
+                                     const json_allocator_t *allocator) {
+  parser->allocator = *allocator;
+  json_arena_init(&parser->arena, &parser->allocator);
+  parser->arena_allocator = json_arena_allocator(&parser->arena);
+  parser->stack = NULL;
+  parser->stack_len = 0;
+  parser->stack_cap = 0;
+  parser->lazy_numbers = false;
+
+  const json_allocator_t *previous = json_set_allocator(&parser->allocator);
+  json_lexer_init(&parser->lexer, NULL);
+  json_set_allocator(previous);
+}
+
+void json_parser_free(json_parser_t *parser) {
+  const json_allocator_t *previous = json_set_allocator(&parser->allocator);
+  json_lexer_free(&parser->lexer);
+  json_set_allocator(previous);
+
+  json_arena_free(&parser->arena);
+  parser->allocator.free(parser->allocator.ctx, parser->stack);
+}
+
+void json_parser_reset(json_parser_t *parser) {
+  json_arena_reset(&parser->arena);
+  parser->stack_len = 0;
+}
+
+bool json_parser_parse(json_parser_t *parser, const char *input,
+                       json_object_t *output) {
+  return json_parser_parse_len(parser, input, strlen(input), output);
+}
+
+bool json_parser_parse_len(json_parser_t *parser, const char *input,
+                           size_t len, json_object_t *output) {
+  json_parser_reset(parser);
+
+  const json_allocator_t *previous =
+      json_set_allocator(&parser->arena_allocator);
+  bool result = json_parse_document(parser, input, len, output);
+  json_set_allocator(previous);
+
   return result;
 }
@@ -2,8 +2,13 @@
 #define JSON_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
+#include "json_alloc.h"
+#include "json_arena.h"
+#include "json_lexer.h"
 #include "stb_ds.h"
 
 enum {
@@ -15,12 +20,34 @@ enum {
   JSON_NULL,
 };
 
+// How a JSON_NUMBER is stored.
+enum {
+  JSON_NUMBER_DOUBLE,
+  JSON_NUMBER_INT64,
+  JSON_NUMBER_LAZY,
+};
+
+// The text of a number that hasn't been converted yet. It points into the
+// parser input, which has to outlive the document.
+typedef struct {
+  const char *text;
+  int len;
+  bool converted;
+  // Valid once converted.
+  bool is_integer;
+  int64_t integer;
+  double value;
+} json_lazy_number_t;
+
 struct json_dict_entry_t;
 
 typedef struct json_object_t {
   int typ;
+  int number_repr; // JSON_NUMBER only
   union {
     double number;
+    int64_t integer;
+    json_lazy_number_t *lazy_number; // owned
     char *string; // owned
     bool boolean;
     struct json_dict_entry_t *dict; // owned
@@ -34,6 +61,7 @@ typedef struct json_dict_entry_t {
 } json_dict_entry_t;
 
 json_object_t json_new_number(double value);
+json_object_t json_new_int64(int64_t value);
 json_object_t json_new_string(const char *value);
 json_object_t json_new_boolean(bool value);
 json_object_t json_new_dict(void);
@@ -49,8 +77,13 @@ bool json_is_boolean(json_object_t obj);
 bool json_is_dict(json_object_t obj);
 bool json_is_array(json_object_t obj);
 bool json_is_null(json_object_t obj);
+// True for numbers that were written as integer literals and fit into int64.
+bool json_is_integer(json_object_t obj);
 
+// Converts lazy numbers on first access and caches the result in place,
+// so concurrent readers of the same document need external locking.
 double json_get_number(json_object_t obj);
+int64_t json_get_int64(json_object_t obj);
 char *json_get_string(json_object_t obj);
 bool json_get_boolean(json_object_t obj);
 
@@ -70,5 +103,43 @@ void json_print(json_object_t obj);
 
 // Returns true if parsed successfully.
 bool json_parse(const char *input, json_object_t *output);
+// The same for len bytes of input followed by a NUL, when the length is
+// known already.
+bool json_parse_len(const char *input, size_t len, json_object_t *output);
+
+// A parsing context that can be reused across many documents.
+// Documents produced by json_parser_parse() live in the parser's arena: they
+// must not be passed to json_free() and stay valid until the next call to
+// json_parser_parse() or json_parser_reset(). Once the arena and the scratch
+// stack have grown to fit the typical document, parsing does no mallocs.
+typedef struct {
+  // Backs the lexer, the arena and the stack.
+  json_allocator_t allocator;
+  // Installed as the current allocator while parsing.
+  json_allocator_t arena_allocator;
+  json_lexer_t lexer;
+  json_arena_t arena;
+  // Elements of the arrays currently being parsed, innermost last.
+  json_object_t *stack;
+  int stack_len;
+  int stack_cap;
+  // Keep numbers as slices of the input and convert them on first access
+  // by json_get_number(). The input must outlive the documents. Off by
+  // default.
+  bool lazy_numbers;
+} json_parser_t;
+
+// Uses the current thread's allocator.
+void json_parser_init(json_parser_t *parser);
+void json_parser_init_with_allocator(json_parser_t *parser,
+                                     const json_allocator_t *allocator);
+void json_parser_free(json_parser_t *parser);
+// Releases all documents parsed so far but keeps the memory around.
+void json_parser_reset(json_parser_t *parser);
+// Returns true if parsed successfully.
+bool json_parser_parse(json_parser_t *parser, const char *input,
+                       json_object_t *output);
+bool json_parser_parse_len(json_parser_t *parser, const char *input,
+                           size_t len, json_object_t *output);
 
 #endif // JSON_H_
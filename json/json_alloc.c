@@ -0,0 +1,56 @@
+#include "json_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void *libc_alloc(void *ctx, size_t size) {
+  (void)ctx;
+  return malloc(size);
+}
+
+static void *libc_realloc(void *ctx, void *ptr, size_t size) {
+  (void)ctx;
+  return realloc(ptr, size);
+}
+
+static void libc_free(void *ctx, void *ptr) {
+  (void)ctx;
+  free(ptr);
+}
+
+const json_allocator_t json_libc_allocator = {
+    .alloc = libc_alloc,
+    .realloc = libc_realloc,
+    .free = libc_free,
+    .ctx = NULL,
+};
+
+static _Thread_local const json_allocator_t *current_allocator =
+    &json_libc_allocator;
+
+const json_allocator_t *json_set_allocator(const json_allocator_t *allocator) {
+  const json_allocator_t *previous = current_allocator;
+  current_allocator = allocator;
+  return previous;
+}
+
+const json_allocator_t *json_get_allocator(void) { return current_allocator; }
+
+void *json_alloc(size_t size) {
+  return current_allocator->alloc(current_allocator->ctx, size);
+}
+
+void *json_realloc(void *ptr, size_t size) {
+  return current_allocator->realloc(current_allocator->ctx, ptr, size);
+}
+
+void json_dealloc(void *ptr) {
+  current_allocator->free(current_allocator->ctx, ptr);
+}
+
+char *json_strdup(const char *str) {
+  size_t len = strlen(str);
+  char *copy = (char *)json_alloc(len + 1);
+  memcpy(copy, str, len + 1);
+  return copy;
+}
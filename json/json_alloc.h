@@ -0,0 +1,37 @@
+#ifndef JSON_ALLOC_H_
+#define JSON_ALLOC_H_
+
+#include <stddef.h>
+
+// Allocator interface used by the JSON library. Semantics follow the C
+// library: realloc(ctx, NULL, size) allocates and free(ctx, NULL) is a no-op.
+typedef struct {
+  void *(*alloc)(void *ctx, size_t size);
+  void *(*realloc)(void *ctx, void *ptr, size_t size);
+  void (*free)(void *ctx, void *ptr);
+  void *ctx;
+} json_allocator_t;
+
+// Forwards to malloc/realloc/free.
+extern const json_allocator_t json_libc_allocator;
+
+// All allocations made by the JSON library (including the ones stb_ds makes
+// on our behalf) go through the current thread's allocator, which is
+// json_libc_allocator unless changed. stb_ds containers have no room for a
+// per-container allocator, so a document has to be modified and freed with
+// the same allocator it was built with.
+// Returns the previous allocator. The allocator must outlive its use.
+const json_allocator_t *json_set_allocator(const json_allocator_t *allocator);
+const json_allocator_t *json_get_allocator(void);
+
+void *json_alloc(size_t size);
+void *json_realloc(void *ptr, size_t size);
+void json_dealloc(void *ptr);
+char *json_strdup(const char *str);
+
+// Must be defined before every inclusion of stb_ds.h since some of the
+// stb_ds macros (e.g. arrfree) expand to STBDS_FREE directly.
+#define STBDS_REALLOC(context, ptr, size) json_realloc(ptr, size)
+#define STBDS_FREE(context, ptr) json_dealloc(ptr)
+
+#endif // JSON_ALLOC_H_
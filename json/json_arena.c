@@ -0,0 +1,159 @@
+#include "json_arena.h"
+
+#include <string.h>
+
+#define ALIGNMENT 16
+// Every allocation is prefixed with its size so that it can be reallocated.
+// The header is padded to ALIGNMENT to keep the payload aligned.
+#define HEADER_SIZE 16
+
+static size_t align_up(size_t n) {
+  return (n + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+}
+
+static char *block_data(json_arena_block_t *block) {
+  return (char *)block + align_up(sizeof(json_arena_block_t));
+}
+
+static size_t *size_slot(void *ptr) { return (size_t *)((char *)ptr - HEADER_SIZE); }
+
+static json_arena_block_t *new_block(json_arena_t *arena, size_t size) {
+  json_arena_block_t *block = (json_arena_block_t *)arena->backing->alloc(
+      arena->backing->ctx, align_up(sizeof(json_arena_block_t)) + size);
+  if (block == NULL) {
+    return NULL;
+  }
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+void json_arena_init(json_arena_t *arena, const json_allocator_t *backing) {
+  arena->backing = backing;
+  arena->head = NULL;
+  arena->current = NULL;
+  arena->last = NULL;
+  arena->block_size = JSON_ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+void json_arena_free(json_arena_t *arena) {
+  json_arena_block_t *block = arena->head;
+  while (block != NULL) {
+    json_arena_block_t *next = block->next;
+    arena->backing->free(arena->backing->ctx, block);
+    block = next;
+  }
+  arena->head = NULL;
+  arena->current = NULL;
+  arena->last = NULL;
+}
+
+void json_arena_reset(json_arena_t *arena) {
+  // If the previous document spilled over into several blocks, replace them
+  // with a single block that can hold all of it. This way the arena converges
+  // to one block and stops allocating after the first few documents.
+  if (arena->head != NULL && arena->head->next != NULL) {
+    size_t total = 0;
+    for (json_arena_block_t *block = arena->head; block != NULL;
+         block = block->next) {
+      total += block->size;
+    }
+    json_arena_free(arena);
+    arena->head = new_block(arena, total);
+  }
+
+  if (arena->head != NULL) {
+    arena->head->used = 0;
+  }
+  arena->current = arena->head;
+  arena->last = NULL;
+}
+
+void *json_arena_alloc(json_arena_t *arena, size_t size) {
+  size_t needed = HEADER_SIZE + align_up(size);
+  json_arena_block_t *block = arena->current;
+
+  if (block == NULL || block->size - block->used < needed) {
+    size_t block_size = arena->block_size;
+    if (block_size < needed) {
+      block_size = needed;
+    }
+
+    json_arena_block_t *next = new_block(arena, block_size);
+    if (next == NULL) {
+      return NULL;
+    }
+
+    if (block == NULL) {
+      arena->head = next;
+    } else {
+      block->next = next;
+    }
+    arena->current = next;
+    block = next;
+  }
+
+  char *ptr = block_data(block) + block->used + HEADER_SIZE;
+  *size_slot(ptr) = size;
+  block->used += needed;
+  arena->last = ptr;
+  return ptr;
+}
+
+void *json_arena_realloc(json_arena_t *arena, void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return json_arena_alloc(arena, size);
+  }
+
+  size_t old_size = *size_slot(ptr);
+
+  // The most recent allocation can be resized in place, which is the common
+  // case for a growing stb_ds array.
+  if (ptr == arena->last) {
+    json_arena_block_t *block = arena->current;
+    size_t old_needed = align_up(old_size);
+    size_t new_needed = align_up(size);
+    if (new_needed <= old_needed ||
+        block->size - block->used >= new_needed - old_needed) {
+      block->used = block->used - old_needed + new_needed;
+      *size_slot(ptr) = size;
+      return ptr;
+    }
+  }
+
+  if (size <= old_size) {
+    return ptr;
+  }
+
+  void *new_ptr = json_arena_alloc(arena, size);
+  if (new_ptr == NULL) {
+    return NULL;
+  }
+  memcpy(new_ptr, ptr, old_size);
+  return new_ptr;
+}
+
+static void *arena_alloc(void *ctx, size_t size) {
+  return json_arena_alloc((json_arena_t *)ctx, size);
+}
+
+static void *arena_realloc(void *ctx, void *ptr, size_t size) {
+  return json_arena_realloc((json_arena_t *)ctx, ptr, size);
+}
+
+static void arena_free(void *ctx, void *ptr) {
+  // Arena memory is released by json_arena_reset().
+  (void)ctx;
+  (void)ptr;
+}
+
+json_allocator_t json_arena_allocator(json_arena_t *arena) {
+  json_allocator_t allocator = {
+      .alloc = arena_alloc,
+      .realloc = arena_realloc,
+      .free = arena_free,
+      .ctx = arena,
+  };
+  return allocator;
+}
@@ -0,0 +1,39 @@
+#ifndef JSON_ARENA_H_
+#define JSON_ARENA_H_
+
+#include <stddef.h>
+
+#include "json_alloc.h"
+
+#define JSON_ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+typedef struct json_arena_block_t {
+  struct json_arena_block_t *next;
+  size_t size;
+  size_t used;
+} json_arena_block_t;
+
+// A bump allocator for documents owned by a json_parser_t.
+// Memory is released all at once by json_arena_reset(), which keeps the
+// blocks around so that subsequent documents of similar size don't have to
+// hit malloc at all.
+typedef struct {
+  const json_allocator_t *backing; // where the blocks come from
+  json_arena_block_t *head;
+  json_arena_block_t *current;
+  void *last; // most recent allocation, can be grown in place
+  size_t block_size;
+} json_arena_t;
+
+void json_arena_init(json_arena_t *arena, const json_allocator_t *backing);
+void json_arena_free(json_arena_t *arena);
+// Drops all allocations but keeps the memory for reuse.
+void json_arena_reset(json_arena_t *arena);
+
+void *json_arena_alloc(json_arena_t *arena, size_t size);
+void *json_arena_realloc(json_arena_t *arena, void *ptr, size_t size);
+
+// Wraps the arena into the allocator interface. Freeing is a no-op.
+json_allocator_t json_arena_allocator(json_arena_t *arena);
+
+#endif // JSON_ARENA_H_
@@ -0,0 +1,84 @@
+#include "json_kernels.h"
+
+#include <assert.h>
+
+#include "json_swar.h"
+
+// Scalar versions, eight bytes at a time where possible.
+
+// True if any of the 8 bytes in w can't be copied verbatim inside a string.
+static bool has_special_byte(uint64_t w) {
+  return ((w & JSON_SWAR_HIGHS) |
+          json_swar_has_zero_byte(w ^ (JSON_SWAR_ONES * '"')) |
+          json_swar_has_zero_byte(w ^ (JSON_SWAR_ONES * '\\')) |
+          json_swar_has_byte_less_than(w, 0x20)) != 0;
+}
+
+static size_t scan_string(const char *p, size_t len) {
+  size_t i = 0;
+  while (len - i >= 8 && !has_special_byte(json_swar_load(p + i))) {
+    i += 8;
+  }
+  for (; i < len; i++) {
+    unsigned char ch = p[i];
+    if (ch == '"' || ch == '\\' || ch < 0x20 || ch >= 0x80) {
+      break;
+    }
+  }
+  return i;
+}
+
+static size_t scan_digits(const char *p, size_t len) {
+  size_t i = 0;
+  while (len - i >= 8 && json_swar_all_digits(json_swar_load(p + i))) {
+    i += 8;
+  }
+  while (i < len && '0' <= p[i] && p[i] <= '9') {
+    i++;
+  }
+  return i;
+}
+
+static uint64_t parse_sixteen_digits(const char *p) {
+  return json_swar_parse_eight_digits(json_swar_load(p)) * 100000000ULL +
+         json_swar_parse_eight_digits(json_swar_load(p + 8));
+}
+
+const json_kernels_t json_kernels_scalar = {
+    .isa = ISA_SCALAR,
+    .scan_string = scan_string,
+    .scan_digits = scan_digits,
+    .parse_sixteen_digits = parse_sixteen_digits,
+};
+
+json_kernels_t json_kernels = {
+    .isa = ISA_SCALAR,
+    .scan_string = scan_string,
+    .scan_digits = scan_digits,
+    .parse_sixteen_digits = parse_sixteen_digits,
+};
+
+void json_kernels_select(isa_t isa) {
+  assert(isa_supported(isa));
+
+  switch (isa) {
+#if defined(__x86_64__) || defined(__i386__)
+  case ISA_AVX512:
+    json_kernels = json_kernels_avx512;
+    break;
+  case ISA_AVX2:
+    json_kernels = json_kernels_avx2;
+    break;
+  case ISA_SSE42:
+    json_kernels = json_kernels_sse42;
+    break;
+#endif
+  default:
+    json_kernels = json_kernels_scalar;
+    break;
+  }
+}
+
+__attribute__((constructor)) static void json_kernels_init(void) {
+  json_kernels_select(isa_detect());
+}
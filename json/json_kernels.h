@@ -0,0 +1,41 @@
+#ifndef JSON_KERNELS_H_
+#define JSON_KERNELS_H_
+
+// Hot loops of the lexer and the validator, compiled once per instruction
+// set tier and picked at startup for the CPU we're running on.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "isa.h"
+
+typedef struct {
+  isa_t isa;
+  // Number of leading bytes in p[0, len) that can be copied verbatim inside
+  // a string, i.e. everything up to the first quote, backslash, control
+  // character or non-ASCII byte.
+  size_t (*scan_string)(const char *p, size_t len);
+  // Number of leading ASCII digits in p[0, len).
+  size_t (*scan_digits)(const char *p, size_t len);
+  // Value of the 16 ASCII digits at p.
+  uint64_t (*parse_sixteen_digits)(const char *p);
+} json_kernels_t;
+
+// The kernels in use. Chosen by isa_detect() before main() runs.
+extern json_kernels_t json_kernels;
+
+// Switches to the kernels for the given tier, which must be supported.
+void json_kernels_select(isa_t isa);
+
+// Per-tier tables. Only the ones the target architecture can build exist.
+extern const json_kernels_t json_kernels_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+extern const json_kernels_t json_kernels_sse42;
+extern const json_kernels_t json_kernels_avx2;
+extern const json_kernels_t json_kernels_avx512;
+
+// Shared by the SSE4.2 and wider tables.
+uint64_t json_parse_sixteen_digits_sse42(const char *p);
+#endif
+
+#endif // JSON_KERNELS_H_
@@ -0,0 +1,54 @@
+#include "json_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+static size_t scan_string(const char *p, size_t len) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i space = _mm256_set1_epi8(0x20);
+
+  size_t i = 0;
+  for (; len - i >= 32; i += 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(p + i));
+    // The comparison is signed, so non-ASCII bytes are below 0x20 as well.
+    __m256i special = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote),
+                        _mm256_cmpeq_epi8(chunk, backslash)),
+        _mm256_cmpgt_epi8(space, chunk));
+    unsigned mask = _mm256_movemask_epi8(special);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + json_kernels_sse42.scan_string(p + i, len - i);
+}
+
+static size_t scan_digits(const char *p, size_t len) {
+  const __m256i zero = _mm256_set1_epi8('0');
+  const __m256i nine = _mm256_set1_epi8(9);
+
+  size_t i = 0;
+  for (; len - i >= 32; i += 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(p + i));
+    __m256i value = _mm256_sub_epi8(chunk, zero);
+    __m256i is_digit =
+        _mm256_cmpeq_epi8(_mm256_min_epu8(value, nine), value);
+    unsigned mask = ~(unsigned)_mm256_movemask_epi8(is_digit);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + json_kernels_sse42.scan_digits(p + i, len - i);
+}
+
+const json_kernels_t json_kernels_avx2 = {
+    .isa = ISA_AVX2,
+    .scan_string = scan_string,
+    .scan_digits = scan_digits,
+    // 16 digits fit in a single SSE register already.
+    .parse_sixteen_digits = json_parse_sixteen_digits_sse42,
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include "json_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+// Bytes of the 64-byte chunk at offset i that are inside [0, len). Masked
+// loads don't touch the bytes outside of the mask, so there's no scalar tail.
+static __mmask64 chunk_mask(size_t i, size_t len) {
+  size_t left = len - i;
+  return left >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << left) - 1;
+}
+
+static size_t scan_string(const char *p, size_t len) {
+  const __m512i quote = _mm512_set1_epi8('"');
+  const __m512i backslash = _mm512_set1_epi8('\\');
+  const __m512i space = _mm512_set1_epi8(0x20);
+
+  for (size_t i = 0; i < len; i += 64) {
+    __mmask64 valid = chunk_mask(i, len);
+    __m512i chunk = _mm512_maskz_loadu_epi8(valid, p + i);
+    // The comparison is signed, so non-ASCII bytes are below 0x20 as well.
+    __mmask64 special = _mm512_cmpeq_epi8_mask(chunk, quote) |
+                        _mm512_cmpeq_epi8_mask(chunk, backslash) |
+                        _mm512_cmplt_epi8_mask(chunk, space);
+    special &= valid;
+    if (special != 0) {
+      return i + __builtin_ctzll(special);
+    }
+  }
+  return len;
+}
+
+static size_t scan_digits(const char *p, size_t len) {
+  const __m512i zero = _mm512_set1_epi8('0');
+  const __m512i nine = _mm512_set1_epi8(9);
+
+  for (size_t i = 0; i < len; i += 64) {
+    __mmask64 valid = chunk_mask(i, len);
+    __m512i chunk = _mm512_maskz_loadu_epi8(valid, p + i);
+    __mmask64 non_digit =
+        ~_mm512_cmple_epu8_mask(_mm512_sub_epi8(chunk, zero), nine) & valid;
+    if (non_digit != 0) {
+      return i + __builtin_ctzll(non_digit);
+    }
+  }
+  return len;
+}
+
+const json_kernels_t json_kernels_avx512 = {
+    .isa = ISA_AVX512,
+    .scan_string = scan_string,
+    .scan_digits = scan_digits,
+    // 16 digits fit in a single SSE register already.
+    .parse_sixteen_digits = json_parse_sixteen_digits_sse42,
+};
+
+#endif
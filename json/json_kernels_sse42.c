@@ -0,0 +1,69 @@
+#include "json_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+static size_t scan_string(const char *p, size_t len) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(0x20);
+
+  size_t i = 0;
+  for (; len - i >= 16; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(p + i));
+    // The comparison is signed, so non-ASCII bytes are below 0x20 as well.
+    __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                     _mm_cmpeq_epi8(chunk, backslash)),
+        _mm_cmplt_epi8(chunk, space));
+    unsigned mask = _mm_movemask_epi8(special);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + json_kernels_scalar.scan_string(p + i, len - i);
+}
+
+static size_t scan_digits(const char *p, size_t len) {
+  const __m128i zero = _mm_set1_epi8('0');
+  const __m128i nine = _mm_set1_epi8(9);
+
+  size_t i = 0;
+  for (; len - i >= 16; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i value = _mm_sub_epi8(chunk, zero);
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(value, nine), value);
+    unsigned mask = ~_mm_movemask_epi8(is_digit) & 0xFFFF;
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + json_kernels_scalar.scan_digits(p + i, len - i);
+}
+
+uint64_t json_parse_sixteen_digits_sse42(const char *p) {
+  __m128i digits = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)p),
+                                _mm_set1_epi8('0'));
+  // Combine neighbouring lanes: pairs of digits, groups of four, then eight.
+  __m128i pairs = _mm_maddubs_epi16(
+      digits, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1,
+                            10, 1));
+  __m128i quads = _mm_madd_epi16(
+      pairs, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+  __m128i packed = _mm_packus_epi32(quads, quads);
+  __m128i octets = _mm_madd_epi16(
+      packed, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+  uint64_t hi = (uint32_t)_mm_cvtsi128_si32(octets);
+  uint64_t lo = (uint32_t)_mm_extract_epi32(octets, 1);
+  return hi * 100000000ULL + lo;
+}
+
+const json_kernels_t json_kernels_sse42 = {
+    .isa = ISA_SSE42,
+    .scan_string = scan_string,
+    .scan_digits = scan_digits,
+    .parse_sixteen_digits = json_parse_sixteen_digits_sse42,
+};
+
+#endif
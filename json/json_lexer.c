@@ -4,13 +4,31 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "json_alloc.h"
+#include "json_kernels.h"
+#include "json_swar.h"
+
 void json_lexer_init(json_lexer_t *lexer, const char *input) {
   lexer->input = input;
+  lexer->end = input != NULL ? input + strlen(input) : NULL;
+  lexer->numeric_value = 0;
+  lexer->is_integer = false;
+  lexer->integer_value = 0;
+  lexer->string_value = (char *)json_alloc(JSON_LEXER_MAX_STRING + 1);
+  lexer->lazy_numbers = false;
+  lexer->number_start = NULL;
+  lexer->number_len = 0;
+}
+
+void json_lexer_reset(json_lexer_t *lexer, const char *input, size_t len) {
+  lexer->input = input;
+  lexer->end = input + len;
   lexer->numeric_value = 0;
-  lexer->string_value = (char *)malloc(JSON_LEXER_MAX_STRING + 1);
 }
 
-void json_lexer_free(json_lexer_t *lexer) { free(lexer->string_value); }
+void json_lexer_free(json_lexer_t *lexer) {
+  json_dealloc(lexer->string_value);
+}
 
 static bool is_whitespace(char ch) {
   return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
@@ -44,6 +62,66 @@ static bool is_float_char(char ch) {
          ch == '+';
 }
 
+bool json_lexer_parse_integer(const char *text, int len, int64_t *output) {
+  bool negative = false;
+  if (len > 0 && text[0] == '-') {
+    negative = true;
+    text++;
+    len--;
+  }
+
+  // 19 digits cover the int64 range and can't overflow uint64.
+  if (len == 0 || len > 19) {
+    return false;
+  }
+
+  if (json_kernels.scan_digits(text, len) != (size_t)len) {
+    return false;
+  }
+
+  uint64_t value = 0;
+  if (len >= 16) {
+    value = json_kernels.parse_sixteen_digits(text);
+    text += 16;
+    len -= 16;
+  }
+  if (len >= 8) {
+    value = value * 100000000 +
+            json_swar_parse_eight_digits(json_swar_load(text));
+    text += 8;
+    len -= 8;
+  }
+  for (; len > 0; text++, len--) {
+    value = value * 10 + (*text - '0');
+  }
+
+  if (negative) {
+    // -0 is left to the floating point path, which keeps its sign.
+    if (value == 0 || value > (uint64_t)INT64_MAX + 1) {
+      return false;
+    }
+    *output = (int64_t)(0 - value);
+  } else {
+    if (value > (uint64_t)INT64_MAX) {
+      return false;
+    }
+    *output = (int64_t)value;
+  }
+  return true;
+}
+
+// Appends n bytes to the string value, truncating it at
+// JSON_LEXER_MAX_STRING. Returns the new length.
+static int append_string(json_lexer_t *lexer, int len, const char *src,
+                         size_t n) {
+  size_t room = JSON_LEXER_MAX_STRING - len;
+  if (n > room) {
+    n = room;
+  }
+  memcpy(lexer->string_value + len, src, n);
+  return len + n;
+}
+
 bool json_lexer_get_token(json_lexer_t *lexer) {
   skip_whitespace(lexer);
 
@@ -56,9 +134,14 @@ bool json_lexer_get_token(json_lexer_t *lexer) {
     lexer->input++;
 
     int len = 0;
-    lexer->string_value[0] = '\0';
 
     while (true) {
+      // Copy everything up to the next interesting byte in one go.
+      size_t run =
+          json_kernels.scan_string(lexer->input, lexer->end - lexer->input);
+      len = append_string(lexer, len, lexer->input, run);
+      lexer->input += run;
+
       ch = lexer->input[0];
       if (ch == '\0') {
         break;
@@ -80,22 +163,44 @@ bool json_lexer_get_token(json_lexer_t *lexer) {
         ch = unescape(ch);
       }
 
-      lexer->string_value[len] = ch;
-      lexer->string_value[len + 1] = '\0';
-      len++;
+      char unescaped = ch;
+      len = append_string(lexer, len, &unescaped, 1);
 
       lexer->input++;
     }
+
+    lexer->string_value[len] = '\0';
   } else if (isdigit(ch) || ch == '-') {
     lexer->token = JSON_TOK_NUMBER;
-    int len = 0;
-    while (is_float_char(ch)) {
-      lexer->string_value[len++] = ch;
-      lexer->input++;
-      ch = lexer->input[0];
+    lexer->number_start = lexer->input;
+    const char *p = lexer->input;
+    while (true) {
+      p += json_kernels.scan_digits(p, lexer->end - p);
+      if (!is_float_char(*p)) {
+        break;
+      }
+      p++;
+    }
+    lexer->input = p;
+    lexer->number_len = lexer->input - lexer->number_start;
+
+    if (lexer->lazy_numbers) {
+      return true;
+    }
+
+    lexer->is_integer = json_lexer_parse_integer(
+        lexer->number_start, lexer->number_len, &lexer->integer_value);
+    if (lexer->is_integer) {
+      lexer->numeric_value = (double)lexer->integer_value;
+    } else {
+      int len = lexer->number_len;
+      if (len > JSON_LEXER_MAX_STRING) {
+        len = JSON_LEXER_MAX_STRING;
+      }
+      memcpy(lexer->string_value, lexer->number_start, len);
+      lexer->string_value[len] = '\0';
+      lexer->numeric_value = atof(lexer->string_value);
     }
-    lexer->string_value[len] = '\0';
-    lexer->numeric_value = atof(lexer->string_value);
   } else if (strncmp(lexer->input, "true", 4) == 0) {
     lexer->token = JSON_TOK_TRUE;
     lexer->input += 4;
@@ -2,6 +2,8 @@
 #define JSON_LEXER_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #define JSON_LEXER_MAX_STRING 1023
 
@@ -15,13 +17,31 @@ enum {
 
 typedef struct {
   const char *input;
+  const char *end; // terminating NUL of the input
   int token;
   double numeric_value;
+  // Integer literals that fit into int64 are also available exactly.
+  bool is_integer;
+  int64_t integer_value;
   char *string_value;
+  // Text of the last number token.
+  const char *number_start;
+  int number_len;
+  // When set, numbers are not converted: only number_start and number_len
+  // are filled in.
+  bool lazy_numbers;
 } json_lexer_t;
 
 void json_lexer_init(json_lexer_t *lexer, const char *input);
+// Points the lexer at a new input, keeping its buffers. The input is len
+// bytes followed by a NUL, len known to the caller so that it isn't
+// measured again.
+void json_lexer_reset(json_lexer_t *lexer, const char *input, size_t len);
 void json_lexer_free(json_lexer_t *lexer);
 bool json_lexer_get_token(json_lexer_t *lexer);
 
+// Parses an optionally negative run of decimal digits. Returns false if the
+// text is not of that form or doesn't fit into int64.
+bool json_lexer_parse_integer(const char *text, int len, int64_t *output);
+
 #endif // JSON_LEXER_H_
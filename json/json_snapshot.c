@@ -0,0 +1,420 @@
+#include "json_snapshot.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BYTE_ORDER_MARK 0x01020304
+
+// Writing.
+
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+} snapshot_buffer_t;
+
+typedef struct {
+  char *key;
+  uint32_t value;
+} key_index_t;
+
+// Appends size zeroed bytes at the next 8-byte boundary, returns their offset.
+static uint64_t buffer_reserve(snapshot_buffer_t *buf, size_t size) {
+  size_t offset = (buf->len + 7) & ~(size_t)7;
+  size_t end = offset + size;
+  if (end > buf->cap) {
+    size_t cap = buf->cap ? buf->cap : 4096;
+    while (cap < end) {
+      cap *= 2;
+    }
+    buf->data = (char *)json_realloc(buf->data, cap);
+    buf->cap = cap;
+  }
+  memset(buf->data + buf->len, 0, end - buf->len);
+  buf->len = end;
+  return offset;
+}
+
+static uint64_t buffer_put_string(snapshot_buffer_t *buf, const char *str,
+                                  size_t len) {
+  uint64_t offset = buffer_reserve(buf, len + 1);
+  memcpy(buf->data + offset, str, len);
+  return offset;
+}
+
+static void collect_keys(json_object_t obj, key_index_t **keys) {
+  if (json_is_array(obj)) {
+    for (int i = 0; i < json_array_len(obj); i++) {
+      collect_keys(json_array_get(obj, i), keys);
+    }
+  } else if (json_is_dict(obj)) {
+    for (int i = 0; i < json_dict_len(obj); i++) {
+      shput(*keys, obj.val.dict[i].key, 0);
+      collect_keys(obj.val.dict[i].value, keys);
+    }
+  }
+}
+
+static int compare_keys(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void write_node(snapshot_buffer_t *buf, key_index_t *keys,
+                       json_object_t obj, uint64_t node_offset) {
+  json_snapshot_node_t node;
+  memset(&node, 0, sizeof(node));
+  node.typ = obj.typ;
+
+  switch (obj.typ) {
+  case JSON_NUMBER:
+    if (json_is_integer(obj)) {
+      node.len = JSON_NUMBER_INT64;
+      node.val.integer = json_get_int64(obj);
+    } else {
+      node.len = JSON_NUMBER_DOUBLE;
+      node.val.number = json_get_number(obj);
+    }
+    break;
+  case JSON_STRING: {
+    const char *str = json_get_string(obj);
+    size_t len = strlen(str);
+    node.len = len;
+    node.val.offset = buffer_put_string(buf, str, len);
+  } break;
+  case JSON_BOOLEAN:
+    node.val.boolean = json_get_boolean(obj);
+    break;
+  case JSON_NULL:
+    break;
+  case JSON_ARRAY: {
+    int len = json_array_len(obj);
+    uint64_t offset = buffer_reserve(buf, sizeof(json_snapshot_node_t) * len);
+    for (int i = 0; i < len; i++) {
+      write_node(buf, keys, json_array_get(obj, i),
+                 offset + sizeof(json_snapshot_node_t) * i);
+    }
+    node.len = len;
+    node.val.offset = offset;
+  } break;
+  case JSON_DICT: {
+    int len = json_dict_len(obj);
+    uint64_t offset = buffer_reserve(buf, sizeof(json_snapshot_entry_t) * len);
+    for (int i = 0; i < len; i++) {
+      uint64_t entry_offset = offset + sizeof(json_snapshot_entry_t) * i;
+      uint32_t key = shget(keys, obj.val.dict[i].key);
+      memcpy(buf->data + entry_offset + offsetof(json_snapshot_entry_t, key),
+             &key, sizeof(key));
+      write_node(buf, keys, obj.val.dict[i].value,
+                 entry_offset + offsetof(json_snapshot_entry_t, value));
+    }
+    node.len = len;
+    node.val.offset = offset;
+  } break;
+  }
+
+  // Written last, since the children may have moved the buffer.
+  memcpy(buf->data + node_offset, &node, sizeof(node));
+}
+
+bool json_snapshot_source_of(const char *filename,
+                             json_snapshot_source_t *source) {
+  struct stat st;
+  if (stat(filename, &st) != 0) {
+    return false;
+  }
+  source->size = (uint64_t)st.st_size;
+  source->mtime_sec = (int64_t)st.st_mtim.tv_sec;
+  source->mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+  return true;
+}
+
+bool json_snapshot_write(FILE *out, json_object_t obj,
+                         const json_snapshot_source_t *source) {
+  snapshot_buffer_t buf = {0};
+  key_index_t *keys = NULL;
+
+  uint64_t header_offset = buffer_reserve(&buf, sizeof(json_snapshot_header_t));
+  assert(header_offset == 0);
+
+  // Intern the keys: sort them and assign each one its index in the table.
+  collect_keys(obj, &keys);
+  int key_count = shlen(keys);
+  char **sorted = (char **)json_alloc(sizeof(char *) * (key_count + 1));
+  for (int i = 0; i < key_count; i++) {
+    sorted[i] = keys[i].key;
+  }
+  qsort(sorted, key_count, sizeof(char *), compare_keys);
+
+  uint64_t table = buffer_reserve(&buf, sizeof(uint64_t) * key_count);
+  for (int i = 0; i < key_count; i++) {
+    shput(keys, sorted[i], i);
+    uint64_t offset = buffer_put_string(&buf, sorted[i], strlen(sorted[i]));
+    memcpy(buf.data + table + sizeof(uint64_t) * i, &offset, sizeof(offset));
+  }
+  json_dealloc(sorted);
+
+  write_node(&buf, keys, obj, offsetof(json_snapshot_header_t, root));
+  shfree(keys);
+
+  json_snapshot_header_t *header = (json_snapshot_header_t *)buf.data;
+  memcpy(header->magic, JSON_SNAPSHOT_MAGIC, sizeof(header->magic));
+  header->version = JSON_SNAPSHOT_VERSION;
+  header->byte_order = BYTE_ORDER_MARK;
+  header->key_count = key_count;
+  header->size = buf.len;
+  header->keys = table;
+  // Left zero, unknown, otherwise.
+  if (source != NULL) {
+    header->source = *source;
+  }
+
+  bool success = fwrite(buf.data, 1, buf.len, out) == buf.len;
+  json_dealloc(buf.data);
+  return success;
+}
+
+bool json_snapshot_save(const char *filename, json_object_t obj,
+                        const json_snapshot_source_t *source) {
+  FILE *out = fopen(filename, "wb");
+  if (out == NULL) {
+    return false;
+  }
+  bool success = json_snapshot_write(out, obj, source);
+  if (fclose(out) != 0) {
+    success = false;
+  }
+  return success;
+}
+
+// Loading.
+
+bool json_snapshot_open(json_snapshot_t *snapshot, const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < sizeof(json_snapshot_header_t)) {
+    close(fd);
+    return false;
+  }
+
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed.
+  close(fd);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+
+  const json_snapshot_header_t *header = (const json_snapshot_header_t *)base;
+  if (memcmp(header->magic, JSON_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != JSON_SNAPSHOT_VERSION ||
+      header->byte_order != BYTE_ORDER_MARK ||
+      header->size != (uint64_t)st.st_size) {
+    munmap(base, st.st_size);
+    return false;
+  }
+
+  snapshot->base = (const char *)base;
+  snapshot->size = st.st_size;
+  return true;
+}
+
+bool json_snapshot_is_fresh(const json_snapshot_t *snapshot,
+                            const char *filename) {
+  const json_snapshot_source_t *recorded =
+      &((const json_snapshot_header_t *)snapshot->base)->source;
+  json_snapshot_source_t current;
+  if (!json_snapshot_source_of(filename, &current) ||
+      (recorded->size == 0 && recorded->mtime_sec == 0 &&
+       recorded->mtime_nsec == 0)) {
+    return false;
+  }
+  return recorded->size == current.size &&
+         recorded->mtime_sec == current.mtime_sec &&
+         recorded->mtime_nsec == current.mtime_nsec;
+}
+
+void json_snapshot_close(json_snapshot_t *snapshot) {
+  if (snapshot->base != NULL) {
+    munmap((void *)snapshot->base, snapshot->size);
+  }
+  snapshot->base = NULL;
+  snapshot->size = 0;
+}
+
+// Accessors.
+
+static const json_snapshot_node_t null_node = {.typ = JSON_NULL};
+
+static const json_snapshot_header_t *header_of(const char *base) {
+  return (const json_snapshot_header_t *)base;
+}
+
+static const char *key_at(const char *base, uint32_t index) {
+  uint64_t offset;
+  memcpy(&offset, base + header_of(base)->keys + sizeof(uint64_t) * index,
+         sizeof(offset));
+  return base + offset;
+}
+
+static const json_snapshot_entry_t *entries_of(json_snapshot_value_t value) {
+  return (const json_snapshot_entry_t *)(value.base + value.node->val.offset);
+}
+
+static int find_key(const char *base, const char *key) {
+  int lo = 0;
+  int hi = (int)header_of(base)->key_count - 1;
+  while (lo <= hi) {
+    int mid = lo + (hi - lo) / 2;
+    int cmp = strcmp(key_at(base, mid), key);
+    if (cmp == 0) {
+      return mid;
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return -1;
+}
+
+json_snapshot_value_t json_snapshot_root(const json_snapshot_t *snapshot) {
+  json_snapshot_value_t value = {
+      .base = snapshot->base,
+      .node = &header_of(snapshot->base)->root,
+  };
+  return value;
+}
+
+int json_snapshot_get_type(json_snapshot_value_t value) {
+  return value.node->typ;
+}
+
+bool json_snapshot_is_number(json_snapshot_value_t value) {
+  return value.node->typ == JSON_NUMBER;
+}
+
+bool json_snapshot_is_integer(json_snapshot_value_t value) {
+  return value.node->typ == JSON_NUMBER &&
+         value.node->len == JSON_NUMBER_INT64;
+}
+
+bool json_snapshot_is_string(json_snapshot_value_t value) {
+  return value.node->typ == JSON_STRING;
+}
+
+bool json_snapshot_is_boolean(json_snapshot_value_t value) {
+  return value.node->typ == JSON_BOOLEAN;
+}
+
+bool json_snapshot_is_dict(json_snapshot_value_t value) {
+  return value.node->typ == JSON_DICT;
+}
+
+bool json_snapshot_is_array(json_snapshot_value_t value) {
+  return value.node->typ == JSON_ARRAY;
+}
+
+bool json_snapshot_is_null(json_snapshot_value_t value) {
+  return value.node->typ == JSON_NULL;
+}
+
+double json_snapshot_get_number(json_snapshot_value_t value) {
+  assert(value.node->typ == JSON_NUMBER);
+  if (value.node->len == JSON_NUMBER_INT64) {
+    return (double)value.node->val.integer;
+  }
+  return value.node->val.number;
+}
+
+int64_t json_snapshot_get_int64(json_snapshot_value_t value) {
+  assert(json_snapshot_is_integer(value));
+  return value.node->val.integer;
+}
+
+const char *json_snapshot_get_string(json_snapshot_value_t value) {
+  assert(value.node->typ == JSON_STRING);
+  return value.base + value.node->val.offset;
+}
+
+bool json_snapshot_get_boolean(json_snapshot_value_t value) {
+  assert(value.node->typ == JSON_BOOLEAN);
+  return value.node->val.boolean != 0;
+}
+
+int json_snapshot_array_len(json_snapshot_value_t value) {
+  assert(value.node->typ == JSON_ARRAY);
+  return value.node->len;
+}
+
+json_snapshot_value_t json_snapshot_array_get(json_snapshot_value_t value,
+                                              int index) {
+  assert(value.node->typ == JSON_ARRAY);
+  assert(index >= 0 && index < (int)value.node->len);
+  const json_snapshot_node_t *elems =
+      (const json_snapshot_node_t *)(value.base + value.node->val.offset);
+  json_snapshot_value_t elem = {
+      .base = value.base,
+      .node = &elems[index],
+  };
+  return elem;
+}
+
+json_snapshot_value_t json_snapshot_dict_get_id(json_snapshot_value_t value,
+                                                int key_id) {
+  assert(value.node->typ == JSON_DICT);
+  json_snapshot_value_t result = {
+      .base = value.base,
+      .node = &null_node,
+  };
+
+  const json_snapshot_entry_t *entries = entries_of(value);
+  for (uint32_t i = 0; i < value.node->len; i++) {
+    if ((int)entries[i].key == key_id) {
+      result.node = &entries[i].value;
+      break;
+    }
+  }
+  return result;
+}
+
+json_snapshot_value_t json_snapshot_dict_get(json_snapshot_value_t value,
+                                             const char *key) {
+  return json_snapshot_dict_get_id(value, find_key(value.base, key));
+}
+
+bool json_snapshot_dict_has_key(json_snapshot_value_t value, const char *key) {
+  assert(value.node->typ == JSON_DICT);
+  int key_id = find_key(value.base, key);
+  const json_snapshot_entry_t *entries = entries_of(value);
+  for (uint32_t i = 0; i < value.node->len; i++) {
+    if ((int)entries[i].key == key_id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int json_snapshot_dict_len(json_snapshot_value_t value) {
+  assert(value.node->typ == JSON_DICT);
+  return value.node->len;
+}
+
+const char *json_snapshot_dict_get_key(json_snapshot_value_t value, int i) {
+  assert(value.node->typ == JSON_DICT);
+  assert(i >= 0 && i < (int)value.node->len);
+  return key_at(value.base, entries_of(value)[i].key);
+}
+
+int json_snapshot_key_id(const json_snapshot_t *snapshot, const char *key) {
+  return find_key(snapshot->base, key);
+}
@@ -0,0 +1,147 @@
+#ifndef JSON_SNAPSHOT_H_
+#define JSON_SNAPSHOT_H_
+
+// A binary, position-independent image of a parsed document that can be
+// mapped into memory and read in place, without parsing or allocating.
+//
+// Layout (native little-endian, every offset is relative to the start of the
+// file and every node is 8-byte aligned):
+//
+//   json_snapshot_header_t   magic, version, total size, key table, source,
+//                            root node
+//   key table                key_count offsets of NUL-terminated strings,
+//                            sorted by strcmp(); every dict key in the
+//                            document is stored here exactly once
+//   data                     nodes, arrays of nodes, dict entries, strings
+//
+// A node is 16 bytes: the JSON_* type, a length and an 8-byte payload.
+//   JSON_NUMBER   len is JSON_NUMBER_DOUBLE or JSON_NUMBER_INT64,
+//                 payload is the value
+//   JSON_STRING   len is the length in bytes, payload is the offset of the
+//                 NUL-terminated string
+//   JSON_BOOLEAN  payload is 0 or 1
+//   JSON_ARRAY    len is the element count, payload is the offset of that
+//                 many consecutive nodes
+//   JSON_DICT     len is the entry count, payload is the offset of that many
+//                 consecutive json_snapshot_entry_t in insertion order
+//   JSON_NULL     nothing
+//
+// Snapshots are trusted input: loading only checks the header.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "json.h"
+
+#define JSON_SNAPSHOT_MAGIC "JSNP"
+#define JSON_SNAPSHOT_VERSION 2
+
+typedef struct {
+  uint32_t typ;
+  uint32_t len;
+  union {
+    double number;
+    int64_t integer;
+    uint64_t boolean;
+    uint64_t offset;
+  } val;
+} json_snapshot_node_t;
+
+typedef struct {
+  uint32_t key; // index into the key table
+  uint32_t reserved;
+  json_snapshot_node_t value;
+} json_snapshot_entry_t;
+
+// The file a document was parsed from, as it was before it was read. A
+// snapshot is only up to date while the file still has the same size and
+// modification time, to the nanosecond: a file rewritten within the same
+// second as the snapshot has to count as changed. All zero if unknown.
+typedef struct {
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+} json_snapshot_source_t;
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t byte_order; // 0x01020304 as written by the producer
+  uint32_t key_count;
+  uint64_t size;
+  uint64_t keys;
+  json_snapshot_source_t source;
+  json_snapshot_node_t root;
+} json_snapshot_header_t;
+
+// Fills in source from filename as it is now. Returns false and sets errno
+// if it can't be stat()ed.
+bool json_snapshot_source_of(const char *filename,
+                             json_snapshot_source_t *source);
+
+// Serializes a document parsed from source, which may be NULL if unknown.
+// Returns false on I/O errors.
+bool json_snapshot_write(FILE *out, json_object_t obj,
+                         const json_snapshot_source_t *source);
+bool json_snapshot_save(const char *filename, json_object_t obj,
+                        const json_snapshot_source_t *source);
+
+typedef struct {
+  const char *base;
+  size_t size;
+} json_snapshot_t;
+
+// Maps a snapshot file read-only. Returns false if the file can't be mapped
+// or isn't a snapshot of the supported version.
+bool json_snapshot_open(json_snapshot_t *snapshot, const char *filename);
+void json_snapshot_close(json_snapshot_t *snapshot);
+
+// Whether snapshot was taken of filename as it is now, see
+// json_snapshot_source_t. False if filename can't be stat()ed or the source
+// is unknown.
+bool json_snapshot_is_fresh(const json_snapshot_t *snapshot,
+                            const char *filename);
+
+// Read-only counterpart of json_object_t, cheap to pass by value.
+typedef struct {
+  const char *base;
+  const json_snapshot_node_t *node;
+} json_snapshot_value_t;
+
+json_snapshot_value_t json_snapshot_root(const json_snapshot_t *snapshot);
+
+int json_snapshot_get_type(json_snapshot_value_t value);
+bool json_snapshot_is_number(json_snapshot_value_t value);
+bool json_snapshot_is_integer(json_snapshot_value_t value);
+bool json_snapshot_is_string(json_snapshot_value_t value);
+bool json_snapshot_is_boolean(json_snapshot_value_t value);
+bool json_snapshot_is_dict(json_snapshot_value_t value);
+bool json_snapshot_is_array(json_snapshot_value_t value);
+bool json_snapshot_is_null(json_snapshot_value_t value);
+
+double json_snapshot_get_number(json_snapshot_value_t value);
+int64_t json_snapshot_get_int64(json_snapshot_value_t value);
+const char *json_snapshot_get_string(json_snapshot_value_t value);
+bool json_snapshot_get_boolean(json_snapshot_value_t value);
+
+int json_snapshot_array_len(json_snapshot_value_t value);
+json_snapshot_value_t json_snapshot_array_get(json_snapshot_value_t value,
+                                              int index);
+
+// Missing keys yield a null value, same as json_dict_get().
+json_snapshot_value_t json_snapshot_dict_get(json_snapshot_value_t value,
+                                             const char *key);
+bool json_snapshot_dict_has_key(json_snapshot_value_t value, const char *key);
+int json_snapshot_dict_len(json_snapshot_value_t value);
+const char *json_snapshot_dict_get_key(json_snapshot_value_t value, int i);
+
+// Looking a key up in the key table once and then using its id avoids the
+// string search when the same key is read from many dicts.
+// Returns -1 if no dict in the snapshot has the key.
+int json_snapshot_key_id(const json_snapshot_t *snapshot, const char *key);
+json_snapshot_value_t json_snapshot_dict_get_id(json_snapshot_value_t value,
+                                                int key_id);
+
+#endif // JSON_SNAPSHOT_H_
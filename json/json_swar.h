@@ -0,0 +1,49 @@
+#ifndef JSON_SWAR_H_
+#define JSON_SWAR_H_
+
+// SIMD-within-a-register helpers that look at 8 bytes of input at once.
+// Words are loaded with memcpy() in native byte order, which is assumed to be
+// little-endian: the first byte of the input is the lowest byte of the word.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define JSON_SWAR_ONES 0x0101010101010101ULL
+#define JSON_SWAR_HIGHS 0x8080808080808080ULL
+
+static inline uint64_t json_swar_load(const void *p) {
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+// The usual bit tricks: both may report false positives, but only in bytes
+// above a true positive, so they can tell whether there is a match but not
+// reliably where it is.
+static inline uint64_t json_swar_has_zero_byte(uint64_t v) {
+  return (v - JSON_SWAR_ONES) & ~v & JSON_SWAR_HIGHS;
+}
+
+static inline uint64_t json_swar_has_byte_less_than(uint64_t v, uint8_t n) {
+  return (v - JSON_SWAR_ONES * n) & ~v & JSON_SWAR_HIGHS;
+}
+
+// True if all 8 bytes in w are ASCII digits. Bytes below '0' borrow into
+// their high bit, bytes above '9' carry into it.
+static inline bool json_swar_all_digits(uint64_t w) {
+  return (((w - JSON_SWAR_ONES * '0') | (w + JSON_SWAR_ONES * (0x7F - '9')) |
+           w) &
+          JSON_SWAR_HIGHS) == 0;
+}
+
+// Converts 8 ASCII digits into their value, combining neighbouring digits
+// into pairs, then pairs into groups of four, then the two halves.
+static inline uint32_t json_swar_parse_eight_digits(uint64_t w) {
+  w = (w & 0x0F0F0F0F0F0F0F0FULL) * ((10 << 8) + 1) >> 8;
+  w = (w & 0x00FF00FF00FF00FFULL) * ((100 << 16) + 1) >> 16;
+  return (uint32_t)((w & 0x0000FFFF0000FFFFULL) * ((10000ULL << 32) + 1) >>
+                    32);
+}
+
+#endif // JSON_SWAR_H_
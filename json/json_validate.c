@@ -0,0 +1,321 @@
+#include "json_validate.h"
+
+#include <stdint.h>
+
+#include "json_kernels.h"
+
+typedef const unsigned char *cursor_t;
+
+static bool is_whitespace(unsigned char ch) {
+  return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
+}
+
+static bool is_digit(unsigned char ch) { return '0' <= ch && ch <= '9'; }
+
+static bool is_hex_digit(unsigned char ch) {
+  return is_digit(ch) || ('a' <= ch && ch <= 'f') || ('A' <= ch && ch <= 'F');
+}
+
+static cursor_t skip_whitespace(cursor_t p, cursor_t end) {
+  while (p < end && is_whitespace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+// All the validate_* functions below take a cursor pointing at the first
+// byte of the construct. On success they move it past the construct, on
+// failure they leave it at the offending byte.
+
+// Well-formed UTF-8 sequences as per table 3-7 of the Unicode standard:
+// no overlong encodings, no surrogates, nothing above U+10FFFF.
+static bool validate_utf8_char(cursor_t *pp, cursor_t end) {
+  cursor_t p = *pp;
+  unsigned char lead = *p;
+  unsigned char lo = 0x80;
+  unsigned char hi = 0xBF;
+  int continuation_bytes;
+
+  if (0xC2 <= lead && lead <= 0xDF) {
+    continuation_bytes = 1;
+  } else if (0xE0 <= lead && lead <= 0xEF) {
+    continuation_bytes = 2;
+    if (lead == 0xE0) {
+      lo = 0xA0;
+    } else if (lead == 0xED) {
+      hi = 0x9F;
+    }
+  } else if (0xF0 <= lead && lead <= 0xF4) {
+    continuation_bytes = 3;
+    if (lead == 0xF0) {
+      lo = 0x90;
+    } else if (lead == 0xF4) {
+      hi = 0x8F;
+    }
+  } else {
+    return false;
+  }
+
+  p++;
+  if (p == end || *p < lo || *p > hi) {
+    *pp = p;
+    return false;
+  }
+
+  for (int i = 1; i < continuation_bytes; i++) {
+    p++;
+    if (p == end || (*p & 0xC0) != 0x80) {
+      *pp = p;
+      return false;
+    }
+  }
+
+  *pp = p + 1;
+  return true;
+}
+
+static bool validate_string(cursor_t *pp, cursor_t end) {
+  cursor_t p = *pp + 1; // opening quote
+
+  while (true) {
+    p += json_kernels.scan_string((const char *)p, end - p);
+
+    if (p == end) {
+      break;
+    }
+
+    unsigned char ch = *p;
+    if (ch == '"') {
+      *pp = p + 1;
+      return true;
+    }
+
+    if (ch == '\\') {
+      p++;
+      if (p == end) {
+        break;
+      }
+
+      switch (*p) {
+      case '"':
+      case '\\':
+      case '/':
+      case 'b':
+      case 'f':
+      case 'n':
+      case 'r':
+      case 't':
+        p++;
+        break;
+      case 'u':
+        p++;
+        for (int i = 0; i < 4; i++) {
+          if (p == end || !is_hex_digit(*p)) {
+            *pp = p;
+            return false;
+          }
+          p++;
+        }
+        break;
+      default:
+        *pp = p;
+        return false;
+      }
+    } else if (ch < 0x20) {
+      break;
+    } else if (ch < 0x80) {
+      p++;
+    } else if (!validate_utf8_char(&p, end)) {
+      break;
+    }
+  }
+
+  *pp = p;
+  return false;
+}
+
+static bool validate_digits(cursor_t *pp, cursor_t end) {
+  cursor_t p = *pp;
+  if (p == end || !is_digit(*p)) {
+    return false;
+  }
+  *pp = p + json_kernels.scan_digits((const char *)p, end - p);
+  return true;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool validate_number(cursor_t *pp, cursor_t end) {
+  cursor_t p = *pp;
+
+  if (*p == '-') {
+    p++;
+  }
+
+  if (p < end && *p == '0') {
+    p++;
+  } else if (!validate_digits(&p, end)) {
+    *pp = p;
+    return false;
+  }
+
+  if (p < end && *p == '.') {
+    p++;
+    if (!validate_digits(&p, end)) {
+      *pp = p;
+      return false;
+    }
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    if (p < end && (*p == '+' || *p == '-')) {
+      p++;
+    }
+    if (!validate_digits(&p, end)) {
+      *pp = p;
+      return false;
+    }
+  }
+
+  *pp = p;
+  return true;
+}
+
+static bool validate_literal(cursor_t *pp, cursor_t end, const char *literal) {
+  cursor_t p = *pp;
+  for (; *literal; literal++, p++) {
+    if (p == end || *p != (unsigned char)*literal) {
+      *pp = p;
+      return false;
+    }
+  }
+  *pp = p;
+  return true;
+}
+
+// Open containers are kept as a bit stack: set for dicts, clear for arrays.
+typedef struct {
+  uint64_t bits[JSON_VALIDATE_MAX_DEPTH / 64];
+  int depth;
+} container_stack_t;
+
+static bool push_container(container_stack_t *stack, bool is_dict) {
+  if (stack->depth == JSON_VALIDATE_MAX_DEPTH) {
+    return false;
+  }
+  uint64_t mask = 1ULL << (stack->depth % 64);
+  if (is_dict) {
+    stack->bits[stack->depth / 64] |= mask;
+  } else {
+    stack->bits[stack->depth / 64] &= ~mask;
+  }
+  stack->depth++;
+  return true;
+}
+
+static bool in_dict(const container_stack_t *stack) {
+  int top = stack->depth - 1;
+  return (stack->bits[top / 64] >> (top % 64)) & 1;
+}
+
+bool json_validate(const char *buf, size_t len, size_t *error_offset) {
+  cursor_t start = (cursor_t)buf;
+  cursor_t end = start + len;
+  cursor_t p = start;
+  container_stack_t stack;
+  stack.depth = 0;
+
+value:
+  p = skip_whitespace(p, end);
+  if (p == end) {
+    goto fail;
+  }
+
+  switch (*p) {
+  case '{':
+  case '[':
+    if (!push_container(&stack, *p == '{')) {
+      goto fail;
+    }
+    p = skip_whitespace(p + 1, end);
+    if (p < end && (*p == '}' || *p == ']')) {
+      // Empty container, the closing bracket is checked against its kind.
+      goto close;
+    }
+    if (in_dict(&stack)) {
+      goto key;
+    }
+    goto value;
+  case '"':
+    if (!validate_string(&p, end)) {
+      goto fail;
+    }
+    break;
+  case 't':
+    if (!validate_literal(&p, end, "true")) {
+      goto fail;
+    }
+    break;
+  case 'f':
+    if (!validate_literal(&p, end, "false")) {
+      goto fail;
+    }
+    break;
+  case 'n':
+    if (!validate_literal(&p, end, "null")) {
+      goto fail;
+    }
+    break;
+  default:
+    if (*p != '-' && !is_digit(*p)) {
+      goto fail;
+    }
+    if (!validate_number(&p, end)) {
+      goto fail;
+    }
+    break;
+  }
+
+after_value:
+  p = skip_whitespace(p, end);
+  if (stack.depth == 0) {
+    if (p != end) {
+      goto fail;
+    }
+    return true;
+  }
+
+  if (p < end && *p == ',') {
+    p++;
+    if (in_dict(&stack)) {
+      goto key;
+    }
+    goto value;
+  }
+
+close:
+  if (p == end || *p != (in_dict(&stack) ? '}' : ']')) {
+    goto fail;
+  }
+  p++;
+  stack.depth--;
+  goto after_value;
+
+key:
+  p = skip_whitespace(p, end);
+  if (p == end || *p != '"' || !validate_string(&p, end)) {
+    goto fail;
+  }
+  p = skip_whitespace(p, end);
+  if (p == end || *p != ':') {
+    goto fail;
+  }
+  p++;
+  goto value;
+
+fail:
+  if (error_offset != NULL) {
+    *error_offset = (size_t)(p - start);
+  }
+  return false;
+}
@@ -0,0 +1,18 @@
+#ifndef JSON_VALIDATE_H_
+#define JSON_VALIDATE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Deeper documents are rejected, which lets the validator keep its
+// container stack on the C stack.
+#define JSON_VALIDATE_MAX_DEPTH 1024
+
+// Checks that buf holds exactly one JSON value as specified by RFC 8259,
+// surrounded by optional whitespace. This includes the number grammar and
+// UTF-8 well-formedness of strings. Nothing is allocated.
+// Returns true if the input is valid. Otherwise, if error_offset is not NULL,
+// it receives the offset of the first byte that could not be accepted.
+bool json_validate(const char *buf, size_t len, size_t *error_offset);
+
+#endif // JSON_VALIDATE_H_
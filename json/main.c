@@ -1,69 +1,56 @@
-#include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "distance_matrix.h"
+#include "distance_stats.h"
+#include "file_reader.h"
 #include "harvestine.h"
+#include "input.h"
+#include "isa.h"
 #include "json.h"
+#include "json_kernels.h"
+#include "json_snapshot.h"
+#include "json_validate.h"
+#include "page_alloc.h"
+#include "pairs.h"
+#include "pairs_file.h"
+#include "pairs_parser.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "spatial_index.h"
 #include "stopwatch.h"
+#include "verify.h"
 
-typedef struct {
-  double x0;
-  double y0;
-  double x1;
-  double y1;
-} coordinate_pair_t;
-
-char *slurp(const char *filename) {
-  FILE *file = fopen(filename, "r");
-  if (file == NULL) {
-    return NULL;
-  }
-
-  fseek(file, 0, SEEK_END);
-  long length = ftell(file);
-  fseek(file, 0, SEEK_SET);
-
-  char *buffer = (char *)malloc(length + 1);
-  fread(buffer, length, 1, file);
-
-  fclose(file);
-  return buffer;
-}
-
-bool load_input(const char *input, coordinate_pair_t **out_pairs,
-                int *out_pairs_len) {
-  bool success = false;
-  json_object_t obj = json_new_null();
-
-  if (!json_parse(input, &obj)) {
-    fprintf(stderr, "Could not parse JSON input\n");
-    goto exit;
-  }
-
+bool load_input(json_object_t obj, pairs_t *out_pairs) {
   if (!json_dict_has_key(obj, "pairs")) {
     fprintf(stderr, "load error: \"pairs\" not found\n");
-    goto exit;
+    return false;
   }
 
   json_object_t pairs = json_dict_get(obj, "pairs");
   if (!json_is_array(pairs)) {
     fprintf(stderr, "load error: \"pairs\" expected to be an array\n");
-    goto exit;
+    return false;
   }
 
-  *out_pairs_len = json_array_len(pairs);
-  *out_pairs =
-      (coordinate_pair_t *)malloc(sizeof(coordinate_pair_t) * (*out_pairs_len));
+  if (!pairs_init(out_pairs, json_array_len(pairs))) {
+    fprintf(stderr, "load error: out of memory\n");
+    return false;
+  }
 
-  for (int i = 0; i < *out_pairs_len; i++) {
+  for (int i = 0; i < out_pairs->count; i++) {
     json_object_t pair = json_array_get(pairs, i);
 
     if (!json_dict_has_key(pair, "x0") || !json_dict_has_key(pair, "y0") ||
         !json_dict_has_key(pair, "x1") || !json_dict_has_key(pair, "y1")) {
       fprintf(stderr,
               "load error: one of x0, y0, x1, y1 is missing in pair %d\n", i);
-      goto exit;
+      pairs_free(out_pairs);
+      return false;
     }
 
     json_object_t x0 = json_dict_get(pair, "x0");
@@ -71,70 +58,1035 @@ bool load_input(const char *input, coordinate_pair_t **out_pairs,
     json_object_t x1 = json_dict_get(pair, "x1");
     json_object_t y1 = json_dict_get(pair, "y1");
 
-    coordinate_pair_t coord_pair = {
-        .x0 = json_get_number(x0),
-        .y0 = json_get_number(y0),
-        .x1 = json_get_number(x1),
-        .y1 = json_get_number(y1),
+    pairs_set(out_pairs, i, json_get_number(x0), json_get_number(y0),
+              json_get_number(x1), json_get_number(y1));
+  }
+
+  return true;
+}
+
+// Same as load_input() but reads a mapped snapshot of the input instead.
+bool load_snapshot(const json_snapshot_t *snapshot, pairs_t *out_pairs) {
+  json_snapshot_value_t root = json_snapshot_root(snapshot);
+  if (!json_snapshot_is_dict(root) ||
+      !json_snapshot_dict_has_key(root, "pairs")) {
+    fprintf(stderr, "load error: \"pairs\" not found\n");
+    return false;
+  }
+
+  json_snapshot_value_t pairs = json_snapshot_dict_get(root, "pairs");
+  if (!json_snapshot_is_array(pairs)) {
+    fprintf(stderr, "load error: \"pairs\" expected to be an array\n");
+    return false;
+  }
+
+  int x0 = json_snapshot_key_id(snapshot, "x0");
+  int y0 = json_snapshot_key_id(snapshot, "y0");
+  int x1 = json_snapshot_key_id(snapshot, "x1");
+  int y1 = json_snapshot_key_id(snapshot, "y1");
+
+  if (!pairs_init(out_pairs, json_snapshot_array_len(pairs))) {
+    fprintf(stderr, "load error: out of memory\n");
+    return false;
+  }
+
+  for (int i = 0; i < out_pairs->count; i++) {
+    json_snapshot_value_t pair = json_snapshot_array_get(pairs, i);
+    json_snapshot_value_t values[4] = {
+        json_snapshot_dict_get_id(pair, x0),
+        json_snapshot_dict_get_id(pair, y0),
+        json_snapshot_dict_get_id(pair, x1),
+        json_snapshot_dict_get_id(pair, y1),
     };
 
-    (*out_pairs)[i] = coord_pair;
+    for (int j = 0; j < 4; j++) {
+      if (!json_snapshot_is_number(values[j])) {
+        fprintf(stderr,
+                "load error: one of x0, y0, x1, y1 is missing in pair %d\n",
+                i);
+        pairs_free(out_pairs);
+        return false;
+      }
+    }
+
+    pairs_set(out_pairs, i, json_snapshot_get_number(values[0]),
+              json_snapshot_get_number(values[1]),
+              json_snapshot_get_number(values[2]),
+              json_snapshot_get_number(values[3]));
+  }
+
+  return true;
+}
+
+static double gb_per_second(size_t bytes, uint64_t ns) {
+  return (double)bytes / (double)ns;
+}
+
+typedef struct {
+  const char *filename;
+  const char *snapshot_filename;
+  bool validate;
+  const char *force_isa;
+  bool libm;
+  int threads;
+  bool scaling;
+  summation_t summation;
+  bool pipeline;
+  size_t pipeline_memory;
+  bool fused;
+  input_mode_t input_mode;
+  bool populate;
+  bool async_read;
+  page_options_t pages;
+  int repeat;
+  // The input is a pairs file rather than JSON.
+  bool pairs_file;
+  const char *save_pairs_filename;
+  const char *verify_filename;
+  double verify_tolerance;
+  pairs_storage_t storage;
+  bool stats;
+  // Where to write every distance, in the layout of the answer file.
+  const char *emit_filename;
+  // How many of the start points to find the nearest end point for, 0 for
+  // none.
+  int nearest;
+  // Queries of an index of the end points around every start point, within
+  // radius km if not 0 and the k nearest if not 0.
+  double within;
+  int knn;
+} options_t;
+
+// Where the time of a phase went besides computing, for the big buffers.
+static void print_faults(page_faults_t start) {
+  page_faults_t faults = page_faults_since(start);
+  printf("   Page faults. %llu minor, %llu major\n",
+         (unsigned long long)faults.minor, (unsigned long long)faults.major);
+}
+
+// Phase 1 for the JSON input.
+static bool open_input(const options_t *options, stopwatch_t *stopwatch,
+                       input_t *input) {
+  page_faults_t faults = page_faults();
+  stopwatch_start(stopwatch);
+  if (!input_open(input, options->filename, options->input_mode,
+                  options->populate)) {
+    perror(options->filename);
+    return false;
+  }
+  uint64_t ns = stopwatch_end(stopwatch);
+
+  printf("1. %s JSON from disk. %lf ms (%.2lf GB/s)\n",
+         options->input_mode == INPUT_MMAP ? "Map" : "Read", ns / 1000000.0,
+         gb_per_second(input->len, ns));
+  print_faults(faults);
+  return true;
+}
+
+// Phases 1 and 2 from a snapshot. Returns false if there is no usable
+// snapshot, in which case nothing has been loaded.
+static bool read_snapshot(const options_t *options, stopwatch_t *stopwatch,
+                          pairs_t *pairs) {
+  if (options->snapshot_filename == NULL) {
+    return false;
+  }
+
+  stopwatch_start(stopwatch);
+  json_snapshot_t snapshot;
+  if (!json_snapshot_open(&snapshot, options->snapshot_filename)) {
+    return false;
+  }
+  // Only used if taken of the input as it is now.
+  if (!json_snapshot_is_fresh(&snapshot, options->filename)) {
+    json_snapshot_close(&snapshot);
+    return false;
+  }
+  uint64_t ns = stopwatch_end(stopwatch);
+  printf("1. Map snapshot from disk. %lf ms\n", ns / 1000000.0);
+
+  page_faults_t faults = page_faults();
+  stopwatch_start(stopwatch);
+  bool loaded = load_snapshot(&snapshot, pairs);
+  ns = stopwatch_end(stopwatch);
+  json_snapshot_close(&snapshot);
+  if (!loaded) {
+    fprintf(stderr, "could not load input from snapshot %s, ignoring it\n",
+            options->snapshot_filename);
+    return false;
+  }
+
+  printf("2. Load snapshot. %lf ms\n", ns / 1000000.0);
+  print_faults(faults);
+  return true;
+}
+
+// Phases 1 and 2 from the JSON input.
+static bool read_json(const options_t *options, stopwatch_t *stopwatch,
+                      pairs_t *pairs) {
+  // Before reading, so that changes made while reading make the snapshot
+  // stale rather than being missed.
+  json_snapshot_source_t source;
+  bool have_source = options->snapshot_filename != NULL &&
+                     json_snapshot_source_of(options->filename, &source);
+  input_t input;
+  if (!open_input(options, stopwatch, &input)) {
+    return false;
+  }
+  uint64_t ns;
+
+  if (options->validate) {
+    stopwatch_start(stopwatch);
+    size_t error_offset;
+    bool valid = json_validate(input.data, input.len, &error_offset);
+    ns = stopwatch_end(stopwatch);
+
+    printf("   Validate JSON. %lf ms (%.2lf GB/s)\n", ns / 1000000.0,
+           gb_per_second(input.len, ns));
+    if (!valid) {
+      fprintf(stderr, "invalid JSON in %s at offset %zu\n", options->filename,
+              error_offset);
+      input_close(&input);
+      return false;
+    }
+  }
+
+  bool success = false;
+  json_object_t obj = json_new_null();
+  // With page_alloc() configured, the document goes into an arena backed by
+  // it rather than into one malloc per value.
+  bool arena = page_alloc_options()->pages != PAGES_MALLOC;
+  json_parser_t parser;
+  if (arena) {
+    json_parser_init_with_allocator(&parser, &page_json_allocator);
+    parser.arena.block_size = PAGE_ALLOC_HUGE_SIZE;
   }
 
+  page_faults_t faults = page_faults();
+  stopwatch_start(stopwatch);
+  if (arena ? !json_parser_parse_len(&parser, input.data, input.len, &obj)
+            : !json_parse_len(input.data, input.len, &obj)) {
+    fprintf(stderr, "Could not parse JSON input\n");
+    goto exit;
+  }
+  if (!load_input(obj, pairs)) {
+    goto exit;
+  }
+  ns = stopwatch_end(stopwatch);
+
+  printf("2. Parse JSON. %lf ms (%.2lf GB/s)\n", ns / 1000000.0,
+         gb_per_second(input.len, ns));
+  print_faults(faults);
   success = true;
 
+  if (options->snapshot_filename != NULL) {
+    stopwatch_start(stopwatch);
+    bool saved = json_snapshot_save(options->snapshot_filename, obj,
+                                    have_source ? &source : NULL);
+    ns = stopwatch_end(stopwatch);
+    if (saved) {
+      printf("   Save snapshot. %lf ms\n", ns / 1000000.0);
+    } else {
+      fprintf(stderr, "could not save snapshot to %s\n",
+              options->snapshot_filename);
+    }
+  }
+
 exit:
-  json_free(obj);
+  if (arena) {
+    json_parser_free(&parser);
+  } else {
+    json_free(obj);
+  }
+  input_close(&input);
   return success;
 }
 
-double average_harvestine(coordinate_pair_t *pairs, int count) {
+// One per online CPU.
+static int default_threads(void) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus < 1) {
+    return 1;
+  }
+  return cpus < PARALLEL_MAX_THREADS ? (int)cpus : PARALLEL_MAX_THREADS;
+}
+
+// Phase 3 with 1 to max_threads threads, to see how the computation scales.
+static void print_scaling(const pairs_t *pairs, const options_t *options,
+                          stopwatch_t *stopwatch) {
+  uint64_t single_ns = 0;
+  for (int threads = 1; threads <= options->threads; threads++) {
+    stopwatch_start(stopwatch);
+    average_harvestine(pairs, threads, options->summation);
+    uint64_t ns = stopwatch_end(stopwatch);
+    if (threads == 1) {
+      single_ns = ns;
+    }
+    printf("   %d threads. %lf ms (%.2lfx)\n", threads, ns / 1000000.0,
+           (double)single_ns / (double)ns);
+  }
+}
+
+static void accumulate_pair(void *ctx, double x0, double y0, double x1,
+                            double y1) {
+  pairs_accumulator_add((pairs_accumulator_t *)ctx, x0, y0, x1, y1);
+}
+
+static void print_fused_answer(const options_t *options, double answer) {
+  if (options->summation == SUMMATION_DETERMINISTIC) {
+    printf("Answer: %lf (%a)\n", answer, answer);
+  } else {
+    printf("Answer: %lf\n", answer);
+  }
+}
+
+// Like run_fused() below, with the file read on a background thread while
+// the parser works on the part that has arrived.
+static bool run_fused_async(const options_t *options, stopwatch_t *stopwatch) {
+  pairs_accumulator_t acc;
+  pairs_accumulator_init(&acc, options->summation);
+  pairs_parser_t parser;
+  pairs_parser_init(&parser, accumulate_pair, &acc);
+
+  page_faults_t faults = page_faults();
+  stopwatch_start(stopwatch);
+  file_reader_t reader;
+  if (!file_reader_open(&reader, options->filename,
+                        FILE_READER_DEFAULT_BUFFER,
+                        FILE_READER_DEFAULT_BUFFERS)) {
+    perror(options->filename);
+    pairs_parser_free(&parser);
+    return false;
+  }
+  bool parsed = pairs_parser_read(&parser, &reader) == PAIRS_PARSER_DONE;
+  double answer = pairs_accumulator_average(&acc);
+  file_reader_close(&reader);
+  uint64_t ns = stopwatch_end(stopwatch);
+
+  pairs_parser_free(&parser);
+  if (!parsed) {
+    return false;
+  }
+
+  printf("1-3. Read, parse and calculate Harvestine. %lf ms (%.2lf GB/s)\n",
+         ns / 1000000.0, gb_per_second(reader.len, ns));
+  printf("   Read. %lf ms busy, %lf ms waited for\n",
+         reader.read_ns / 1000000.0, reader.wait_ns / 1000000.0);
+  print_faults(faults);
+  print_fused_answer(options, answer);
+  return true;
+}
+
+// Phases 2 and 3 in a single pass: every pair goes to the accumulator as
+// soon as it has been parsed, with no document and no pairs_t in between.
+static bool run_fused(const options_t *options, stopwatch_t *stopwatch) {
+  input_t input;
+  if (!open_input(options, stopwatch, &input)) {
+    return false;
+  }
+
+  pairs_accumulator_t acc;
+  pairs_accumulator_init(&acc, options->summation);
+  pairs_parser_t parser;
+  pairs_parser_init(&parser, accumulate_pair, &acc);
+
+  page_faults_t faults = page_faults();
+  stopwatch_start(stopwatch);
+  size_t consumed;
+  bool parsed = pairs_parser_feed(&parser, input.data, input.len, true,
+                                  &consumed) == PAIRS_PARSER_DONE;
+  double answer = pairs_accumulator_average(&acc);
+  uint64_t ns = stopwatch_end(stopwatch);
+
+  size_t input_len = input.len;
+  pairs_parser_free(&parser);
+  input_close(&input);
+  if (!parsed) {
+    return false;
+  }
+
+  printf("2-3. Parse and calculate Harvestine. %lf ms (%.2lf GB/s)\n",
+         ns / 1000000.0, gb_per_second(input_len, ns));
+  print_faults(faults);
+  print_fused_answer(options, answer);
+  return true;
+}
+
+// Phases 1 to 3 at once, see pipeline.h.
+static bool run_pipeline(const options_t *options, stopwatch_t *stopwatch) {
+  pipeline_options_t pipeline_options;
+  pipeline_options_init(&pipeline_options);
+  pipeline_options.threads = options->threads;
+  pipeline_options.summation = options->summation;
+  if (options->pipeline_memory != 0) {
+    pipeline_options.memory = options->pipeline_memory;
+  }
+
+  page_faults_t faults = page_faults();
+  stopwatch_start(stopwatch);
+  pipeline_result_t result;
+  if (!pipeline_run(options->filename, &pipeline_options, &result)) {
+    return false;
+  }
+  uint64_t ns = stopwatch_end(stopwatch);
+
+  printf("1-3. Pipeline. %lf ms (%.2lf GB/s, %d threads, %.1lf MB buffers)\n",
+         ns / 1000000.0, gb_per_second(result.input_len, ns), options->threads,
+         result.memory / 1048576.0);
+  printf("   Read. %lf ms busy\n", result.read_ns / 1000000.0);
+  printf("   Parse. %lf ms busy\n", result.parse_ns / 1000000.0);
+  printf("   Calculate Harvestine. %lf ms busy\n",
+         result.compute_ns / 1000000.0);
+  print_faults(faults);
+  if (options->summation == SUMMATION_DETERMINISTIC) {
+    printf("Answer: %lf (%a)\n", result.answer, result.answer);
+  } else {
+    printf("Answer: %lf\n", result.answer);
+  }
+  return true;
+}
+
+// Phases 1 and 2 from a pairs file, which is only mapped: the pairs are
+// used where they are.
+static bool read_pairs_file(const options_t *options, stopwatch_t *stopwatch,
+                            pairs_file_t *file) {
+  page_faults_t faults = page_faults();
+  stopwatch_start(stopwatch);
+  pairs_file_status_t status = pairs_file_open(file, options->filename, true);
+  uint64_t ns = stopwatch_end(stopwatch);
+  if (status != PAIRS_FILE_OK) {
+    fprintf(stderr, "load error: %s: %s\n", options->filename,
+            pairs_file_status_name(status));
+    return false;
+  }
+
+  printf("1-2. Map pairs file and verify checksum. %lf ms (%.2lf GB/s)\n",
+         ns / 1000000.0, gb_per_second(file->size, ns));
+  print_faults(faults);
+  return true;
+}
+
+static void save_pairs(const options_t *options, stopwatch_t *stopwatch,
+                       const pairs_t *pairs) {
+  stopwatch_start(stopwatch);
+  bool saved = pairs_file_save(options->save_pairs_filename, pairs);
+  uint64_t ns = stopwatch_end(stopwatch);
+  if (saved) {
+    printf("   Save pairs. %lf ms\n", ns / 1000000.0);
+  } else {
+    perror(options->save_pairs_filename);
+  }
+}
+
+// Phase 4, every distance against the generator's answers.
+static bool verify(const options_t *options, stopwatch_t *stopwatch,
+                   const pairs_t *pairs, double answer) {
+  answers_t answers;
+  if (!answers_open(&answers, options->verify_filename)) {
+    perror(options->verify_filename);
+    return false;
+  }
+  if (answers.count != pairs->count) {
+    fprintf(stderr, "verify error: %s has %d distances for %d pairs\n",
+            options->verify_filename, answers.count, pairs->count);
+    answers_close(&answers);
+    return false;
+  }
+
+  stopwatch_start(stopwatch);
+  verify_result_t result;
+  bool verified = verify_distances(pairs, &answers, options->threads,
+                                   options->verify_tolerance, &result);
+  uint64_t ns = stopwatch_end(stopwatch);
+  double expected = answers.average;
+  answers_close(&answers);
+  if (!verified) {
+    fprintf(stderr, "verify error: out of memory\n");
+    return false;
+  }
+
+  printf("4. Verify distances. %lf ms (%d threads)\n", ns / 1000000.0,
+         options->threads);
+  printf("   Error. max %g km at pair %d, mean %g, p50 %g, p99 %g, "
+         "p99.9 %g\n",
+         result.max_error, result.max_index, result.mean_error,
+         result.p50_error, result.p99_error, result.p999_error);
+  if (result.mismatches > 0) {
+    printf("   Mismatches. %d over %g km, first at pair %d\n",
+           result.mismatches, options->verify_tolerance,
+           result.first_mismatch);
+  } else {
+    printf("   Mismatches. none over %g km\n", options->verify_tolerance);
+  }
+  printf("   Answer error. %g km (expected %lf)\n", fabs(answer - expected),
+         expected);
+  return true;
+}
+
+// Phase 5, the nearest end point of every one of the first options->nearest
+// start points, out of all of them.
+static bool nearest(const options_t *options, stopwatch_t *stopwatch,
+                    const pairs_t *pairs) {
+  int rows = options->nearest < pairs->count ? options->nearest : pairs->count;
+  haversine_points_t starts, ends;
+  int *nearest = malloc((size_t)rows * sizeof(int));
+  double *distance = malloc((size_t)rows * sizeof(double));
+  stopwatch_start(stopwatch);
+  bool ok = nearest != NULL && distance != NULL &&
+            haversine_points_init(&starts, pairs->x0, pairs->y0, rows);
+  if (ok && !haversine_points_init(&ends, pairs->x1, pairs->y1,
+                                   pairs->count)) {
+    haversine_points_free(&starts);
+    ok = false;
+  }
+  if (!ok) {
+    fprintf(stderr, "nearest error: out of memory\n");
+    free(nearest);
+    free(distance);
+    return false;
+  }
+  uint64_t prepare_ns = stopwatch_end(stopwatch);
+
+  stopwatch_start(stopwatch);
+  distance_matrix_nearest(&starts, &ends, options->threads,
+                          REFERENCE_EARTH_RADIUS, nearest, distance);
+  uint64_t ns = stopwatch_end(stopwatch);
+
   double sum = 0;
-  for (int i = 0; i < count; i++) {
-    sum += reference_haversine(pairs[i].x0, pairs[i].y0, pairs[i].x1,
-                               pairs[i].y1, REFERENCE_EARTH_RADIUS);
+  double max = 0;
+  int own = 0;
+  for (int i = 0; i < rows; i++) {
+    sum += distance[i];
+    max = distance[i] > max ? distance[i] : max;
+    own += nearest[i] == i;
   }
-  return sum / count;
+  printf("5. Nearest end points. %lf ms (%d x %d, %.2lf G distances/s, %d "
+         "threads)\n",
+         ns / 1000000.0, rows, pairs->count,
+         (double)rows * pairs->count / (ns > 0 ? ns : 1), options->threads);
+  printf("   Prepare points. %lf ms\n", prepare_ns / 1000000.0);
+  printf("   Nearest. mean %g km, max %g, %d of their own end point\n",
+         rows > 0 ? sum / rows : 0, max, own);
+
+  haversine_points_free(&starts);
+  haversine_points_free(&ends);
+  free(nearest);
+  free(distance);
+  return true;
+}
+
+// Phase 6, the end points around every start point by spatial index.
+static bool query_index(const options_t *options, stopwatch_t *stopwatch,
+                        const pairs_t *pairs) {
+  int n = pairs->count;
+  spatial_index_t index;
+  stopwatch_start(stopwatch);
+  if (!spatial_index_init(&index, pairs->x1, pairs->y1, n,
+                          REFERENCE_EARTH_RADIUS)) {
+    fprintf(stderr, "index error: out of memory\n");
+    return false;
+  }
+  uint64_t build_ns = stopwatch_end(stopwatch);
+  printf("6. Index end points. %lf ms (%d x %d cells of %g degrees)\n",
+         build_ns / 1000000.0, index.bands, index.columns,
+         index.cell_degrees);
+
+  bool ok = true;
+  if (options->within > 0) {
+    spatial_matches_t *results = malloc((size_t)n * sizeof(*results));
+    ok = results != NULL;
+    if (ok) {
+      for (int i = 0; i < n; i++) {
+        spatial_matches_init(&results[i]);
+      }
+      stopwatch_start(stopwatch);
+      ok = spatial_index_within_batch(&index, pairs->x0, pairs->y0, n,
+                                      options->within, options->threads,
+                                      results);
+      uint64_t ns = stopwatch_end(stopwatch);
+      uint64_t matches = 0;
+      int most = 0;
+      for (int i = 0; i < n; i++) {
+        matches += results[i].count;
+        most = results[i].count > most ? results[i].count : most;
+        spatial_matches_free(&results[i]);
+      }
+      if (ok) {
+        printf("   Within %g km. %lf ms (%.2lf us per query, %d threads)\n",
+               options->within, ns / 1000000.0, ns / 1000.0 / n,
+               options->threads);
+        printf("   Matches. mean %.2lf, most %d\n", (double)matches / n,
+               most);
+      }
+    }
+    free(results);
+  }
+  if (ok && options->knn > 0) {
+    spatial_match_t *matches =
+        malloc((size_t)n * options->knn * sizeof(spatial_match_t));
+    int *found = malloc((size_t)n * sizeof(int));
+    ok = matches != NULL && found != NULL;
+    if (ok) {
+      stopwatch_start(stopwatch);
+      ok = spatial_index_nearest_batch(&index, pairs->x0, pairs->y0, n,
+                                       options->knn, options->threads,
+                                       matches, found);
+      uint64_t ns = stopwatch_end(stopwatch);
+      double sum = 0;
+      for (int i = 0; i < n; i++) {
+        if (found[i] > 0) {
+          sum += matches[(size_t)i * options->knn + found[i] - 1].distance;
+        }
+      }
+      if (ok) {
+        printf("   Nearest %d. %lf ms (%.2lf us per query, %d threads)\n",
+               options->knn, ns / 1000000.0, ns / 1000.0 / n,
+               options->threads);
+        printf("   Farthest of them. mean %g km\n", n > 0 ? sum / n : 0);
+      }
+    }
+    free(matches);
+    free(found);
+  }
+  if (!ok) {
+    fprintf(stderr, "index error: out of memory\n");
+  }
+  spatial_index_free(&index);
+  return ok;
+}
+
+// Mean distance by reference_haversine(), what compact storage drifts from.
+static double reference_average(const pairs_t *pairs) {
+  double sum = haversine_kernels_libm.batch(pairs->x0, pairs->y0, pairs->x1,
+                                            pairs->y1, pairs->count,
+                                            REFERENCE_EARTH_RADIUS, NULL);
+  return sum / pairs->count;
+}
+
+// Replaces the loaded pairs with a copy in compact storage.
+static bool convert_pairs(const options_t *options, stopwatch_t *stopwatch,
+                          const pairs_t *pairs, pairs_t *converted) {
+  stopwatch_start(stopwatch);
+  bool success = pairs_init_converted(converted, pairs, options->storage);
+  uint64_t ns = stopwatch_end(stopwatch);
+  if (!success) {
+    fprintf(stderr, "load error: could not store pairs as %s\n",
+            pairs_storage_name(options->storage));
+    return false;
+  }
+  printf("   Store pairs as %s. %lf ms (%.1lf MB, was %.1lf MB)\n",
+         pairs_storage_name(options->storage), ns / 1000000.0,
+         pairs_bytes(converted) / 1048576.0, pairs_bytes(pairs) / 1048576.0);
+  return true;
+}
+
+// What --stats adds to the answer. The histogram is shown an octave per
+// line, only the ones with distances in them.
+static bool print_stats(const distance_stats_t *stats) {
+  const double fractions[] = {0.5, 0.9, 0.99, 0.999};
+  double quantiles[4];
+  if (!distance_stats_quantiles(stats, fractions, 4, quantiles)) {
+    fprintf(stderr, "stats error: out of memory\n");
+    return false;
+  }
+  printf("   Distances. min %g km, max %g, mean %g, stddev %g",
+         stats->min, stats->max, stats->mean,
+         sqrt(distance_stats_variance(stats)));
+  if (stats->nans > 0) {
+    printf(", %llu NaN", (unsigned long long)stats->nans);
+  }
+  printf("\n   Quantiles. p50 %g km, p90 %g, p99 %g, p99.9 %g\n",
+         quantiles[0], quantiles[1], quantiles[2], quantiles[3]);
+
+  printf("   Histogram.\n");
+  int bin = 0;
+  while (bin < DISTANCE_STATS_BINS) {
+    // Bin 0 and the last bin stand alone, the rest go by octave.
+    int end = bin == 0 || bin == DISTANCE_STATS_BINS - 1
+                  ? bin + 1
+                  : bin + DISTANCE_STATS_BINS_PER_OCTAVE;
+    uint64_t count = 0;
+    for (int b = bin; b < end; b++) {
+      count += stats->histogram[b];
+    }
+    if (count > 0) {
+      char range[64];
+      snprintf(range, sizeof(range), "[%g, %g) km",
+               distance_stats_bin_bound(bin), distance_stats_bin_bound(end));
+      printf("     %-20s %10llu  %5.1f%%\n", range, (unsigned long long)count,
+             100.0 * count / stats->count);
+    }
+    bin = end;
+  }
+  return true;
+}
+
+// Phases 1 to 3 one after the other.
+static bool run_phases(const options_t *options, stopwatch_t *stopwatch) {
+  pairs_t pairs;
+  pairs_file_t file;
+  // Whether pairs points into file rather than memory of its own.
+  bool mapped = options->pairs_file;
+
+  if (options->pairs_file) {
+    if (!read_pairs_file(options, stopwatch, &file)) {
+      return false;
+    }
+    pairs = file.pairs;
+  } else if (!read_snapshot(options, stopwatch, &pairs) &&
+             !read_json(options, stopwatch, &pairs)) {
+    fprintf(stderr, "could not load input from file %s\n",
+            options->filename);
+    return false;
+  }
+  if (options->save_pairs_filename != NULL) {
+    save_pairs(options, stopwatch, &pairs);
+  }
+
+  double reference = 0;
+  if (options->storage != PAIRS_F64) {
+    reference = reference_average(&pairs);
+    pairs_t converted;
+    bool success = convert_pairs(options, stopwatch, &pairs, &converted);
+    if (mapped) {
+      pairs_file_close(&file);
+    } else {
+      pairs_free(&pairs);
+    }
+    if (!success) {
+      return false;
+    }
+    pairs = converted;
+    mapped = false;
+  }
+
+  // The statistics are too large for the stack.
+  pairs_outputs_t outputs = {NULL, NULL};
+  answers_writer_t emitted;
+  uint64_t emit_ns = 0;
+  bool ok = true;
+  if (options->stats) {
+    outputs.stats = malloc(sizeof(distance_stats_t));
+    ok = outputs.stats != NULL;
+    if (ok) {
+      distance_stats_init(outputs.stats);
+    } else {
+      fprintf(stderr, "stats error: out of memory\n");
+    }
+  }
+  if (ok && options->emit_filename != NULL) {
+    stopwatch_start(stopwatch);
+    ok = answers_create(&emitted, options->emit_filename, pairs.count);
+    emit_ns = stopwatch_end(stopwatch);
+    if (ok) {
+      outputs.distances = emitted.distances;
+    } else {
+      perror(options->emit_filename);
+    }
+  }
+
+  page_faults_t faults = page_faults();
+  stopwatch_start(stopwatch);
+  double answer = 0;
+  if (ok && (outputs.stats != NULL || outputs.distances != NULL)) {
+    ok = average_harvestine_into(&pairs, options->threads, options->summation,
+                                 &answer, &outputs);
+    if (!ok) {
+      fprintf(stderr, "stats error: out of memory\n");
+    }
+  } else if (ok) {
+    answer = average_harvestine(&pairs, options->threads, options->summation);
+  }
+  uint64_t ns = stopwatch_end(stopwatch);
+
+  if (ok) {
+    printf("3. Calculate Harvestine. %lf ms (%d threads%s%s)\n",
+           ns / 1000000.0, options->threads,
+           outputs.stats != NULL ? ", with statistics" : "",
+           outputs.distances != NULL ? ", emitting distances" : "");
+    print_faults(faults);
+    if (options->scaling) {
+      print_scaling(&pairs, options, stopwatch);
+    }
+    if (options->summation == SUMMATION_DETERMINISTIC) {
+      // Exact, to compare with other machines.
+      printf("Answer: %lf (%a)\n", answer, answer);
+    } else {
+      printf("Answer: %lf\n", answer);
+    }
+    if (options->storage != PAIRS_F64) {
+      printf("   Drift. %g km from reference_haversine() on f64 (%.3g "
+             "relative)\n",
+             fabs(answer - reference), fabs(answer - reference) / reference);
+    }
+    if (outputs.stats != NULL) {
+      ok = print_stats(outputs.stats);
+    }
+  }
+  if (outputs.distances != NULL) {
+    stopwatch_start(stopwatch);
+    size_t bytes = emitted.size;
+    answers_finish(&emitted, answer);
+    emit_ns += stopwatch_end(stopwatch);
+    if (!ok) {
+      // Not all of them are in it.
+      unlink(options->emit_filename);
+    } else {
+      printf("   Emit distances. %lf ms besides the calculation (%.1lf MB to "
+             "%s)\n",
+             emit_ns / 1000000.0, bytes / 1048576.0, options->emit_filename);
+    }
+  }
+  free(outputs.stats);
+  ok = ok && (options->verify_filename == NULL ||
+              verify(options, stopwatch, &pairs, answer));
+  ok = ok && (options->nearest == 0 || nearest(options, stopwatch, &pairs));
+  ok = ok && ((options->within == 0 && options->knn == 0) ||
+              query_index(options, stopwatch, &pairs));
+
+  if (mapped) {
+    pairs_file_close(&file);
+  } else {
+    pairs_free(&pairs);
+  }
+  return ok;
+}
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [--validate] [--snapshot CACHE] [--force-isa ISA] "
+          "[--libm] [--threads N] [--scaling] [--deterministic] "
+          "[--pipeline] [--pipeline-memory MB] [--fused] [--mmap] "
+          "[--populate] [--async-read] [--pages PAGES] [--prefault] "
+          "[--repeat N] [--save-pairs PAIRS] [--verify ANSWERS] "
+          "[--verify-tolerance KM] [--storage STORAGE] [--stats] "
+          "[--emit-distances OUT] [--nearest ROWS] [--within KM] "
+          "[--knn K] FILE\n",
+          program);
+  fprintf(stderr, "ISA is one of:");
+  for (int i = 0; i < ISA_COUNT; i++) {
+    fprintf(stderr, " %s", isa_name((isa_t)i));
+  }
+  fprintf(stderr, "\nFILE is JSON or a pairs file written by --save-pairs"
+                  "\nPAGES is one of:");
+  for (int i = 0; i < PAGES_COUNT; i++) {
+    fprintf(stderr, " %s", pages_name((pages_t)i));
+  }
+  fprintf(stderr, "\nSTORAGE is one of:");
+  for (int i = 0; i < PAIRS_STORAGE_COUNT; i++) {
+    fprintf(stderr, " %s", pairs_storage_name((pairs_storage_t)i));
+  }
+  fprintf(stderr, "\n");
 }
 
 int main(int argc, char **argv) {
-  if (argc < 2) {
-    fprintf(stderr, "Usage: %s FILE\n", argv[0]);
+  options_t options = {0};
+  options.threads = default_threads();
+  options.repeat = 1;
+  options.verify_tolerance = VERIFY_DEFAULT_TOLERANCE;
+  bool prefault = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--validate") == 0) {
+      options.validate = true;
+    } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+      options.snapshot_filename = argv[++i];
+    } else if (strcmp(argv[i], "--force-isa") == 0 && i + 1 < argc) {
+      options.force_isa = argv[++i];
+    } else if (strcmp(argv[i], "--libm") == 0) {
+      options.libm = true;
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      options.threads = atoi(argv[++i]);
+      if (options.threads < 1 || options.threads > PARALLEL_MAX_THREADS) {
+        fprintf(stderr, "--threads must be between 1 and %d\n",
+                PARALLEL_MAX_THREADS);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--scaling") == 0) {
+      options.scaling = true;
+    } else if (strcmp(argv[i], "--deterministic") == 0) {
+      options.summation = SUMMATION_DETERMINISTIC;
+    } else if (strcmp(argv[i], "--mmap") == 0) {
+      options.input_mode = INPUT_MMAP;
+    } else if (strcmp(argv[i], "--populate") == 0) {
+      options.input_mode = INPUT_MMAP;
+      options.populate = true;
+    } else if (strcmp(argv[i], "--async-read") == 0) {
+      options.async_read = true;
+    } else if (strcmp(argv[i], "--pages") == 0 && i + 1 < argc) {
+      if (!pages_from_name(argv[++i], &options.pages.pages)) {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--save-pairs") == 0 && i + 1 < argc) {
+      options.save_pairs_filename = argv[++i];
+    } else if (strcmp(argv[i], "--verify") == 0 && i + 1 < argc) {
+      options.verify_filename = argv[++i];
+    } else if (strcmp(argv[i], "--verify-tolerance") == 0 && i + 1 < argc) {
+      options.verify_tolerance = atof(argv[++i]);
+      if (!(options.verify_tolerance >= 0)) {
+        fprintf(stderr, "--verify-tolerance must not be negative\n");
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--storage") == 0 && i + 1 < argc) {
+      if (!pairs_storage_from_name(argv[++i], &options.storage)) {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--emit-distances") == 0 && i + 1 < argc) {
+      options.emit_filename = argv[++i];
+    } else if (strcmp(argv[i], "--nearest") == 0 && i + 1 < argc) {
+      options.nearest = atoi(argv[++i]);
+      if (options.nearest < 1) {
+        fprintf(stderr, "--nearest must be at least 1\n");
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--within") == 0 && i + 1 < argc) {
+      options.within = atof(argv[++i]);
+      if (!(options.within > 0)) {
+        fprintf(stderr, "--within must be positive\n");
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--knn") == 0 && i + 1 < argc) {
+      options.knn = atoi(argv[++i]);
+      if (options.knn < 1) {
+        fprintf(stderr, "--knn must be at least 1\n");
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      options.stats = true;
+    } else if (strcmp(argv[i], "--prefault") == 0) {
+      prefault = true;
+    } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      options.repeat = atoi(argv[++i]);
+      if (options.repeat < 1) {
+        fprintf(stderr, "--repeat must be at least 1\n");
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--fused") == 0) {
+      options.fused = true;
+    } else if (strcmp(argv[i], "--pipeline") == 0) {
+      options.pipeline = true;
+    } else if (strcmp(argv[i], "--pipeline-memory") == 0 && i + 1 < argc) {
+      int mb = atoi(argv[++i]);
+      if (mb < 1) {
+        fprintf(stderr, "--pipeline-memory must be at least 1 MB\n");
+        return 1;
+      }
+      options.pipeline_memory = (size_t)mb << 20;
+    } else if (options.filename == NULL) {
+      options.filename = argv[i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (options.filename == NULL) {
+    usage(argv[0]);
     return 1;
   }
 
-  stopwatch_t stopwatch;
-  stopwatch_init(&stopwatch);
+  if (options.force_isa != NULL) {
+    isa_t isa;
+    if (!isa_from_name(options.force_isa, &isa)) {
+      usage(argv[0]);
+      return 1;
+    }
+    if (!isa_supported(isa)) {
+      fprintf(stderr, "%s is not supported by this CPU\n", options.force_isa);
+      return 1;
+    }
+    json_kernels_select(isa);
+    haversine_kernels_select(isa);
+  }
+  if (options.libm) {
+    haversine_kernels = haversine_kernels_libm;
+  }
 
-  coordinate_pair_t *pairs;
-  int npairs;
+  printf("ISA: %s, haversine %s (detected %s)\n", isa_name(json_kernels.isa),
+         haversine_kernels.name, isa_name(isa_detect()));
 
-  stopwatch_start(&stopwatch);
-  const char *filename = argv[1];
-  char *input = slurp(filename);
-  assert(input);
+  stopwatch_t stopwatch;
+  stopwatch_init(&stopwatch);
 
-  uint64_t ns = stopwatch_end(&stopwatch);
-  printf("1. Read JSON from disk. %lf ms\n", ns / 1000000.0);
+  if (prefault) {
+    if (options.pages.pages == PAGES_MALLOC) {
+      fprintf(stderr, "--prefault needs --pages other than malloc\n");
+      return 1;
+    }
+    options.pages.prefault_threads = options.threads;
+  }
+  page_alloc_configure(&options.pages);
 
-  stopwatch_start(&stopwatch);
-  if (!load_input(input, &pairs, &npairs)) {
-    fprintf(stderr, "could not load input from file %s\n", filename);
+  options.pairs_file = pairs_file_detect(options.filename);
+  if (options.pairs_file &&
+      (options.pipeline || options.fused || options.validate ||
+       options.snapshot_filename != NULL)) {
+    fprintf(stderr, "%s is a pairs file, which doesn't need --pipeline, "
+                    "--fused, --validate or --snapshot\n",
+            options.filename);
     return 1;
   }
-  ns = stopwatch_end(&stopwatch);
 
-  printf("2. Parse JSON. %lf ms\n", ns / 1000000.0);
+  if (options.async_read &&
+      (!options.fused || options.input_mode == INPUT_MMAP)) {
+    fprintf(stderr, "--async-read only works with --fused, without --mmap "
+                    "or --populate\n");
+    return 1;
+  }
 
-  stopwatch_start(&stopwatch);
-  double answer = average_harvestine(pairs, npairs);
-  ns = stopwatch_end(&stopwatch);
+  if ((options.nearest > 0 || options.within > 0 || options.knn > 0) &&
+      options.storage != PAIRS_F64) {
+    fprintf(stderr, "--nearest, --within and --knn need --storage f64\n");
+    return 1;
+  }
 
-  printf("3. Calculate Harvestine. %lf ms\n", ns / 1000000.0);
-  printf("Answer: %lf\n", answer);
+  if (options.pipeline || options.fused) {
+    if (options.pipeline && options.fused) {
+      fprintf(stderr, "--pipeline and --fused are mutually exclusive\n");
+      return 1;
+    }
+    if (options.pipeline && options.input_mode == INPUT_MMAP) {
+      fprintf(stderr, "--pipeline reads the input itself, it doesn't support "
+                      "--mmap or --populate\n");
+      return 1;
+    }
+    if (options.validate || options.snapshot_filename != NULL ||
+        options.scaling || options.repeat > 1 ||
+        options.verify_filename != NULL || options.storage != PAIRS_F64 ||
+        options.stats || options.emit_filename != NULL ||
+        options.nearest > 0 || options.within > 0 || options.knn > 0) {
+      fprintf(stderr, "%s doesn't support --validate, --snapshot, "
+                      "--scaling, --repeat, --verify, --storage, --stats, "
+                      "--emit-distances, --nearest, --within or --knn\n",
+              options.pipeline ? "--pipeline" : "--fused");
+      return 1;
+    }
+    bool ok;
+    if (options.pipeline) {
+      ok = run_pipeline(&options, &stopwatch);
+    } else if (options.async_read) {
+      ok = run_fused_async(&options, &stopwatch);
+    } else {
+      ok = run_fused(&options, &stopwatch);
+    }
+    if (!ok) {
+      fprintf(stderr, "could not load input from file %s\n",
+              options.filename);
+      return 1;
+    }
+    return 0;
+  }
 
-  free(pairs);
-  free(input);
+  for (int run = 1; run <= options.repeat; run++) {
+    if (options.repeat > 1) {
+      printf("Run %d of %d\n", run, options.repeat);
+    }
+    if (!run_phases(&options, &stopwatch)) {
+      return 1;
+    }
+  }
+  page_alloc_trim();
 
   return 0;
 }
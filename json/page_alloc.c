@@ -0,0 +1,315 @@
+#include "page_alloc.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// In front of every allocation, so that page_free() knows where it came
+// from. Keeps the payload on a cache line.
+#define HEADER_SIZE 64
+#define MAX_PREFAULT_THREADS 64
+
+typedef struct {
+  // What the options asked for when the buffer was allocated. Mappings of
+  // PAGES_HUGETLB may have fallen back to PAGES_HUGE.
+  pages_t pages;
+  size_t size;     // asked for
+  size_t capacity; // usable, from the header to the end
+  size_t mapped;   // including the header, 0 for malloc
+} header_t;
+
+_Static_assert(sizeof(header_t) <= HEADER_SIZE, "header too large");
+
+static page_options_t options = {PAGES_MALLOC, 0};
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Oldest first.
+static header_t *cache[PAGE_ALLOC_CACHE];
+static int cache_len = 0;
+
+static const char *const names[PAGES_COUNT] = {"malloc", "normal", "huge",
+                                               "hugetlb"};
+
+void page_alloc_configure(const page_options_t *new_options) {
+  options = *new_options;
+  if (options.prefault_threads > MAX_PREFAULT_THREADS) {
+    options.prefault_threads = MAX_PREFAULT_THREADS;
+  }
+}
+
+const page_options_t *page_alloc_options(void) { return &options; }
+
+const char *pages_name(pages_t pages) {
+  return pages < PAGES_COUNT ? names[pages] : "unknown";
+}
+
+bool pages_from_name(const char *name, pages_t *pages) {
+  for (int i = 0; i < PAGES_COUNT; i++) {
+    if (strcmp(name, names[i]) == 0) {
+      *pages = (pages_t)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static size_t round_up(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+static void *payload(header_t *header) { return (char *)header + HEADER_SIZE; }
+
+static header_t *header_of(void *ptr) {
+  return (header_t *)((char *)ptr - HEADER_SIZE);
+}
+
+typedef struct {
+  volatile char *start;
+  size_t len;
+  size_t page;
+} prefault_range_t;
+
+static void *prefault_range(void *arg) {
+  prefault_range_t *range = (prefault_range_t *)arg;
+  for (size_t offset = 0; offset < range->len; offset += range->page) {
+    range->start[offset] = 0;
+  }
+  return NULL;
+}
+
+// Writes to every page, split between the threads, so that the faults are
+// taken in parallel now rather than one by one by whoever touches the
+// buffer first. Zeros are what a new anonymous page holds anyway.
+static void prefault(char *base, size_t len, int threads) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t pages = len / page;
+  if ((size_t)threads > pages) {
+    threads = pages > 0 ? (int)pages : 1;
+  }
+
+  prefault_range_t ranges[MAX_PREFAULT_THREADS];
+  pthread_t workers[MAX_PREFAULT_THREADS];
+  bool started[MAX_PREFAULT_THREADS];
+  for (int i = 0; i < threads; i++) {
+    size_t first = pages * i / threads;
+    size_t end = pages * (i + 1) / threads;
+    ranges[i].start = base + first * page;
+    ranges[i].len = (end - first) * page;
+    ranges[i].page = page;
+  }
+  // The calling thread takes the first range. If a thread can't be
+  // started, it takes that one too.
+  for (int i = 1; i < threads; i++) {
+    started[i] =
+        pthread_create(&workers[i], NULL, prefault_range, &ranges[i]) == 0;
+  }
+  prefault_range(&ranges[0]);
+  for (int i = 1; i < threads; i++) {
+    if (started[i]) {
+      pthread_join(workers[i], NULL);
+    } else {
+      prefault_range(&ranges[i]);
+    }
+  }
+}
+
+// Maps len bytes starting on a huge page boundary, by mapping one huge page
+// more than needed and cutting off the ends.
+static char *map_aligned(size_t len) {
+  size_t padded = len + PAGE_ALLOC_HUGE_SIZE;
+  char *raw = mmap(NULL, padded, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) {
+    return NULL;
+  }
+  char *base = (char *)round_up((uintptr_t)raw, PAGE_ALLOC_HUGE_SIZE);
+  if (base > raw) {
+    munmap(raw, base - raw);
+  }
+  size_t tail = (raw + padded) - (base + len);
+  if (tail > 0) {
+    munmap(base + len, tail);
+  }
+  return base;
+}
+
+static header_t *map_pages(size_t size, pages_t pages) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t mapped = HEADER_SIZE + size;
+  char *base = NULL;
+
+#ifdef MAP_HUGETLB
+  if (pages == PAGES_HUGETLB) {
+    mapped = round_up(mapped, PAGE_ALLOC_HUGE_SIZE);
+    base = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (base == MAP_FAILED) {
+      base = NULL;
+    }
+  }
+#endif
+
+  if (base == NULL && pages == PAGES_NORMAL) {
+    mapped = round_up(mapped, page);
+    base = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+      return NULL;
+    }
+  } else if (base == NULL) {
+    mapped = round_up(mapped, PAGE_ALLOC_HUGE_SIZE);
+    base = map_aligned(mapped);
+    if (base == NULL) {
+      return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    // Only a hint, without THP the pages are just regular ones.
+    madvise(base, mapped, MADV_HUGEPAGE);
+#endif
+  }
+
+  if (options.prefault_threads > 0) {
+    prefault(base, mapped, options.prefault_threads);
+  }
+
+  header_t *header = (header_t *)base;
+  header->pages = pages;
+  header->capacity = mapped - HEADER_SIZE;
+  header->mapped = mapped;
+  return header;
+}
+
+// The smallest cached buffer that fits, removed from the cache.
+static header_t *take_cached(size_t size, pages_t pages) {
+  pthread_mutex_lock(&cache_mutex);
+  int best = -1;
+  for (int i = 0; i < cache_len; i++) {
+    if (cache[i]->pages == pages && cache[i]->capacity >= size &&
+        (best < 0 || cache[i]->capacity < cache[best]->capacity)) {
+      best = i;
+    }
+  }
+  header_t *header = NULL;
+  if (best >= 0) {
+    header = cache[best];
+    memmove(&cache[best], &cache[best + 1],
+            (cache_len - best - 1) * sizeof(cache[0]));
+    cache_len--;
+  }
+  pthread_mutex_unlock(&cache_mutex);
+  return header;
+}
+
+void *page_alloc(size_t size) {
+  pages_t pages = options.pages;
+  header_t *header;
+
+  if (pages == PAGES_MALLOC || size < PAGE_ALLOC_MIN_SIZE) {
+    size_t capacity = round_up(size, HEADER_SIZE);
+    header = aligned_alloc(HEADER_SIZE, HEADER_SIZE + capacity);
+    if (header == NULL) {
+      return NULL;
+    }
+    header->pages = PAGES_MALLOC;
+    header->capacity = capacity;
+    header->mapped = 0;
+  } else {
+    header = take_cached(size, pages);
+    if (header == NULL) {
+      header = map_pages(size, pages);
+    }
+    if (header == NULL) {
+      return NULL;
+    }
+  }
+
+  header->size = size;
+  return payload(header);
+}
+
+void page_free(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  header_t *header = header_of(ptr);
+  if (header->mapped == 0) {
+    free(header);
+    return;
+  }
+
+  pthread_mutex_lock(&cache_mutex);
+  header_t *evicted = NULL;
+  if (cache_len == PAGE_ALLOC_CACHE) {
+    evicted = cache[0];
+    memmove(&cache[0], &cache[1], (cache_len - 1) * sizeof(cache[0]));
+    cache_len--;
+  }
+  cache[cache_len++] = header;
+  pthread_mutex_unlock(&cache_mutex);
+
+  if (evicted != NULL) {
+    munmap(evicted, evicted->mapped);
+  }
+}
+
+void page_alloc_trim(void) {
+  pthread_mutex_lock(&cache_mutex);
+  for (int i = 0; i < cache_len; i++) {
+    munmap(cache[i], cache[i]->mapped);
+  }
+  cache_len = 0;
+  pthread_mutex_unlock(&cache_mutex);
+}
+
+static void *json_page_alloc(void *ctx, size_t size) {
+  (void)ctx;
+  return page_alloc(size);
+}
+
+static void *json_page_realloc(void *ctx, void *ptr, size_t size) {
+  (void)ctx;
+  if (ptr == NULL) {
+    return page_alloc(size);
+  }
+  header_t *header = header_of(ptr);
+  if (size <= header->capacity) {
+    header->size = size;
+    return ptr;
+  }
+  void *new_ptr = page_alloc(size);
+  if (new_ptr == NULL) {
+    return NULL;
+  }
+  memcpy(new_ptr, ptr, header->size);
+  page_free(ptr);
+  return new_ptr;
+}
+
+static void json_page_free(void *ctx, void *ptr) {
+  (void)ctx;
+  page_free(ptr);
+}
+
+const json_allocator_t page_json_allocator = {
+    .alloc = json_page_alloc,
+    .realloc = json_page_realloc,
+    .free = json_page_free,
+    .ctx = NULL,
+};
+
+page_faults_t page_faults(void) {
+  page_faults_t faults = {0, 0};
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    faults.minor = (uint64_t)usage.ru_minflt;
+    faults.major = (uint64_t)usage.ru_majflt;
+  }
+  return faults;
+}
+
+page_faults_t page_faults_since(page_faults_t start) {
+  page_faults_t now = page_faults();
+  page_faults_t faults = {now.minor - start.minor, now.major - start.major};
+  return faults;
+}
@@ -0,0 +1,73 @@
+#ifndef PAGE_ALLOC_H_
+#define PAGE_ALLOC_H_
+
+// Memory for the few big buffers of a run: the input, the pair columns and
+// the parser's arena. Fresh pages fault one at a time on first touch, which
+// for a file of a few hundred MB costs as much as copying it. This
+// allocator can back such buffers with huge pages instead, fault them in
+// on several threads up front, and keep them around after they are freed
+// so that the next run of the same size starts with its pages in place.
+//
+// Allocations under PAGE_ALLOC_MIN_SIZE always come from malloc.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "json_alloc.h"
+
+#define PAGE_ALLOC_MIN_SIZE (1 << 20)
+#define PAGE_ALLOC_HUGE_SIZE (2 << 20)
+// Freed buffers kept for reuse, the most recent ones.
+#define PAGE_ALLOC_CACHE 4
+
+typedef enum {
+  // Everything from malloc, the default.
+  PAGES_MALLOC,
+  // Anonymous mappings of regular pages.
+  PAGES_NORMAL,
+  // Anonymous mappings aligned to PAGE_ALLOC_HUGE_SIZE and marked
+  // MADV_HUGEPAGE, for the kernel to back with transparent huge pages.
+  PAGES_HUGE,
+  // MAP_HUGETLB, from the reserved huge page pool. Falls back to
+  // PAGES_HUGE when the pool is empty or missing.
+  PAGES_HUGETLB,
+  PAGES_COUNT,
+} pages_t;
+
+typedef struct {
+  pages_t pages;
+  // Threads to fault in new mappings with, 0 to leave it to first touch.
+  int prefault_threads;
+} page_options_t;
+
+// Applies to allocations made from then on, from any thread. Not thread
+// safe itself.
+void page_alloc_configure(const page_options_t *options);
+const page_options_t *page_alloc_options(void);
+
+const char *pages_name(pages_t pages);
+// Accepts the names returned by pages_name().
+bool pages_from_name(const char *name, pages_t *pages);
+
+// Aligned to 64 bytes, contents undefined. Returns NULL if out of memory.
+void *page_alloc(size_t size);
+// Takes anything page_alloc() returned, whatever the options were then.
+void page_free(void *ptr);
+// Unmaps the buffers kept for reuse.
+void page_alloc_trim(void);
+
+// Forwards to page_alloc() and page_free(), for a json_parser_t arena.
+extern const json_allocator_t page_json_allocator;
+
+typedef struct {
+  uint64_t minor; // satisfied without I/O, mostly zeroing a new page
+  uint64_t major;
+} page_faults_t;
+
+// Page faults of the whole process so far.
+page_faults_t page_faults(void);
+// Since an earlier page_faults().
+page_faults_t page_faults_since(page_faults_t start);
+
+#endif // PAGE_ALLOC_H_
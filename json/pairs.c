@@ -0,0 +1,263 @@
+#include "pairs.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harvestine.h"
+#include "page_alloc.h"
+
+// Pairs per haversine_batch() call. Also the block of the deterministic
+// summation, so that both modes split the work the same way.
+#define HARVESTINE_BLOCK SUMMATION_BLOCK
+
+bool pairs_init(pairs_t *pairs, int count) {
+  size_t capacity = pairs_capacity(count);
+  // A single allocation. Every column is a multiple of the padding long,
+  // so all of them start on a cache line.
+  _Static_assert(PAIRS_ALIGNMENT <= 64, "page_alloc() aligns to 64 bytes");
+  size_t size = 4 * capacity * sizeof(double);
+  double *columns = page_alloc(size);
+  if (columns == NULL) {
+    return false;
+  }
+  memset(columns, 0, size);
+
+  pairs->x0 = columns;
+  pairs->y0 = columns + capacity;
+  pairs->x1 = columns + 2 * capacity;
+  pairs->y1 = columns + 3 * capacity;
+  pairs->count = count;
+  pairs->storage = PAIRS_F64;
+  return true;
+}
+
+void pairs_free(pairs_t *pairs) {
+  page_free(pairs->x0);
+  pairs->x0 = pairs->y0 = pairs->x1 = pairs->y1 = NULL;
+  pairs->count = 0;
+}
+
+static const char *const storage_names[PAIRS_STORAGE_COUNT] = {
+    "f64", "f32", "microdegrees"};
+
+const char *pairs_storage_name(pairs_storage_t storage) {
+  return storage < PAIRS_STORAGE_COUNT ? storage_names[storage] : "unknown";
+}
+
+bool pairs_storage_from_name(const char *name, pairs_storage_t *storage) {
+  for (int i = 0; i < PAIRS_STORAGE_COUNT; i++) {
+    if (strcmp(name, storage_names[i]) == 0) {
+      *storage = (pairs_storage_t)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Rounds to the nearest microdegree. The range check is written so that
+// NaN fails it too.
+static bool to_microdegrees(double degrees, int32_t *out) {
+  double micro = nearbyint(degrees * HARVESTINE_MICRODEGREES);
+  if (!(micro >= INT32_MIN && micro <= INT32_MAX)) {
+    return false;
+  }
+  *out = (int32_t)micro;
+  return true;
+}
+
+bool pairs_init_converted(pairs_t *pairs, const pairs_t *from,
+                          pairs_storage_t storage) {
+  assert(from->storage == PAIRS_F64);
+
+  // The columns are converted one after the other, padding included, which
+  // converts to zero as well.
+  size_t capacity = pairs_capacity(from->count);
+  size_t column_bytes = pairs_column_bytes(from->count, storage);
+  size_t used_bytes = capacity * pairs_storage_size(storage);
+  char *base = page_alloc(4 * column_bytes);
+  if (base == NULL) {
+    return false;
+  }
+  const double *columns[4] = {from->x0, from->y0, from->x1, from->y1};
+  for (int c = 0; c < 4; c++) {
+    void *to = base + c * column_bytes;
+    for (size_t i = 0; i < capacity; i++) {
+      if (storage == PAIRS_F64) {
+        ((double *)to)[i] = columns[c][i];
+      } else if (storage == PAIRS_F32) {
+        ((float *)to)[i] = (float)columns[c][i];
+      } else if (!to_microdegrees(columns[c][i], &((int32_t *)to)[i])) {
+        page_free(base);
+        return false;
+      }
+    }
+    memset((char *)to + used_bytes, 0, column_bytes - used_bytes);
+  }
+
+  pairs->x0 = (double *)base;
+  pairs->y0 = (double *)(base + column_bytes);
+  pairs->x1 = (double *)(base + 2 * column_bytes);
+  pairs->y1 = (double *)(base + 3 * column_bytes);
+  pairs->count = from->count;
+  pairs->storage = storage;
+  return true;
+}
+
+void pairs_accumulator_init(pairs_accumulator_t *acc, summation_t summation) {
+  acc->len = 0;
+  acc->blocks = 0;
+  acc->summation = summation;
+  acc->sum = 0;
+  summation_tree_init(&acc->tree);
+}
+
+void pairs_accumulator_flush(pairs_accumulator_t *acc) {
+  if (acc->len == 0) {
+    return;
+  }
+  pairs_t block = {acc->x0, acc->y0, acc->x1, acc->y1, acc->len, PAIRS_F64};
+  acc->sum += pairs_sum_blocks(&block, 0, 1, acc->summation, acc->blocks,
+                               &acc->tree, NULL);
+  acc->blocks++;
+  acc->len = 0;
+}
+
+double pairs_accumulator_average(pairs_accumulator_t *acc) {
+  // The last block is the only one that can be partial.
+  uint64_t count = (uint64_t)acc->blocks * SUMMATION_BLOCK + acc->len;
+  pairs_accumulator_flush(acc);
+  if (acc->summation == SUMMATION_DETERMINISTIC) {
+    return summation_tree_total(&acc->tree) / count;
+  }
+  return acc->sum / count;
+}
+
+// One thread's share: the blocks [first_block, end_block). Each one sits on
+// its own cache line so that threads writing their results don't invalidate
+// each other's lines.
+typedef struct {
+  _Alignas(64) const pairs_t *pairs;
+  int first_block;
+  int end_block;
+  summation_t summation;
+  // SUMMATION_FAST: the sum of the share.
+  double sum;
+  // SUMMATION_DETERMINISTIC: the pairwise sums of its blocks.
+  summation_tree_t tree;
+  // Its part of the outputs, NULL if there are none.
+  pairs_outputs_t *outputs;
+} share_t;
+
+double pairs_sum_blocks(const pairs_t *pairs, int first_block, int end_block,
+                        summation_t summation, uint32_t block_base,
+                        summation_tree_t *tree,
+                        const pairs_outputs_t *outputs) {
+  double block[HARVESTINE_BLOCK];
+  distance_stats_t *stats = outputs != NULL ? outputs->stats : NULL;
+  double *all = outputs != NULL ? outputs->distances : NULL;
+  // The distances themselves are only stored if something needs them, and
+  // straight to where they are wanted.
+  bool store =
+      summation == SUMMATION_DETERMINISTIC || stats != NULL || all != NULL;
+
+  double sum = 0;
+  for (int b = first_block; b < end_block; b++) {
+    int i = b * HARVESTINE_BLOCK;
+    int n = pairs->count - i < HARVESTINE_BLOCK ? pairs->count - i
+                                                : HARVESTINE_BLOCK;
+    double *distances = all != NULL ? all + i : block;
+    double block_sum = pairs_distances(pairs, i, n, store ? distances : NULL);
+    if (stats != NULL) {
+      distance_stats_add(stats, distances, n);
+    }
+    if (summation == SUMMATION_DETERMINISTIC) {
+      summation_tree_add(tree, block_base + b, pairwise_sum(distances, n));
+    } else {
+      sum += block_sum;
+    }
+  }
+  return sum;
+}
+
+static void *run_share(void *arg) {
+  share_t *share = (share_t *)arg;
+  share->sum =
+      pairs_sum_blocks(share->pairs, share->first_block, share->end_block,
+                       share->summation, 0, &share->tree, share->outputs);
+  return NULL;
+}
+
+// average_harvestine() with the outputs of thread t going to outputs[t],
+// or without them if outputs is NULL.
+static double average_shares(const pairs_t *pairs, int threads,
+                             summation_t summation, pairs_outputs_t *outputs) {
+  assert(1 <= threads && threads <= PARALLEL_MAX_THREADS);
+  share_t shares[PARALLEL_MAX_THREADS];
+  int blocks = pairs_blocks(pairs);
+  for (int t = 0; t < threads; t++) {
+    share_t *share = &shares[t];
+    share->pairs = pairs;
+    share->first_block = parallel_split(blocks, threads, t);
+    share->end_block = parallel_split(blocks, threads, t + 1);
+    share->summation = summation;
+    share->sum = 0;
+    summation_tree_init(&share->tree);
+    share->outputs = outputs != NULL ? &outputs[t] : NULL;
+  }
+  run_parallel(shares, sizeof(share_t), threads, run_share);
+
+  double sum = shares[0].sum;
+  for (int t = 1; t < threads; t++) {
+    sum += shares[t].sum;
+  }
+
+  if (summation == SUMMATION_DETERMINISTIC) {
+    for (int t = 1; t < threads; t++) {
+      summation_tree_append(&shares[0].tree, &shares[t].tree);
+    }
+    sum = summation_tree_total(&shares[0].tree);
+  }
+  return sum / pairs->count;
+}
+
+double average_harvestine(const pairs_t *pairs, int threads,
+                          summation_t summation) {
+  return average_shares(pairs, threads, summation, NULL);
+}
+
+bool average_harvestine_into(const pairs_t *pairs, int threads,
+                             summation_t summation, double *average,
+                             const pairs_outputs_t *outputs) {
+  // The first thread gathers into the statistics in outputs itself, the
+  // others into statistics of their own, which are too large for the
+  // stack. Merged in thread order, so the same thread count gives the same
+  // statistics.
+  distance_stats_t *others = NULL;
+  if (outputs->stats != NULL && threads > 1) {
+    others = malloc((threads - 1) * sizeof(distance_stats_t));
+    if (others == NULL) {
+      return false;
+    }
+  }
+  pairs_outputs_t shares[PARALLEL_MAX_THREADS];
+  for (int t = 0; t < threads; t++) {
+    shares[t] = *outputs;
+    if (others != NULL && t > 0) {
+      shares[t].stats = &others[t - 1];
+      distance_stats_init(shares[t].stats);
+    }
+  }
+
+  *average = average_shares(pairs, threads, summation, shares);
+
+  if (others != NULL) {
+    for (int t = 1; t < threads; t++) {
+      distance_stats_merge(outputs->stats, shares[t].stats);
+    }
+  }
+  free(others);
+  return true;
+}
@@ -0,0 +1,197 @@
+#ifndef PAIRS_H_
+#define PAIRS_H_
+
+// The coordinate pairs the program computes distances for, and the
+// computation itself.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "distance_stats.h"
+#include "harvestine.h"
+#include "parallel.h"
+#include "summation.h"
+
+// Columns are padded to a multiple of this many pairs, the widest vector
+// the kernels use, and aligned to a cache line.
+#define PAIRS_PADDING 8
+#define PAIRS_ALIGNMENT 64
+
+// How the coordinates are stored. The compact ones halve the memory the
+// computation has to stream through, and the kernels widen them to double
+// as they load them.
+typedef enum {
+  PAIRS_F64,
+  PAIRS_F32,
+  // int32 millionths of a degree, about 0.1 m of resolution.
+  PAIRS_MICRODEGREES,
+  PAIRS_STORAGE_COUNT,
+} pairs_storage_t;
+
+// Pairs stored as four columns, so that the batch kernels can load them
+// directly. The padding past count is zero, distance 0 from (0, 0) to
+// itself, so whole vectors can be read from any block.
+//
+// With compact storage the columns hold floats or int32s, and the
+// pointers have to be cast before use.
+//
+// There is no array of {x0, y0, x1, y1} structs to pick instead. Every
+// reader of the pairs, from the kernels to pairs files and verify.c, takes
+// columns, and the structs would only bring back the shuffles to gather
+// them.
+typedef struct {
+  double *x0;
+  double *y0;
+  double *x1;
+  double *y1;
+  int count;
+  pairs_storage_t storage;
+} pairs_t;
+
+const char *pairs_storage_name(pairs_storage_t storage);
+// Accepts the names returned by pairs_storage_name().
+bool pairs_storage_from_name(const char *name, pairs_storage_t *storage);
+
+static inline size_t pairs_storage_size(pairs_storage_t storage) {
+  return storage == PAIRS_F64 ? sizeof(double) : sizeof(float);
+}
+
+// Length of every column for count pairs, padding included.
+static inline size_t pairs_capacity(int count) {
+  size_t capacity =
+      ((size_t)count + PAIRS_PADDING - 1) / PAIRS_PADDING * PAIRS_PADDING;
+  return capacity == 0 ? PAIRS_PADDING : capacity;
+}
+
+// Allocates columns for count pairs, all zero, stored as PAIRS_F64.
+// Returns false if out of memory.
+bool pairs_init(pairs_t *pairs, int count);
+void pairs_free(pairs_t *pairs);
+
+// Allocates a copy of PAIRS_F64 pairs in another storage. Returns false if
+// out of memory or if a coordinate doesn't fit into microdegrees.
+bool pairs_init_converted(pairs_t *pairs, const pairs_t *from,
+                          pairs_storage_t storage);
+
+// Bytes between the starts of two columns. Compact columns are rounded up
+// to PAIRS_ALIGNMENT as well, so that all of them start on a cache line.
+static inline size_t pairs_column_bytes(int count, pairs_storage_t storage) {
+  size_t bytes = pairs_capacity(count) * pairs_storage_size(storage);
+  return (bytes + PAIRS_ALIGNMENT - 1) / PAIRS_ALIGNMENT * PAIRS_ALIGNMENT;
+}
+
+// Bytes taken by the columns, padding included.
+static inline size_t pairs_bytes(const pairs_t *pairs) {
+  return 4 * pairs_column_bytes(pairs->count, pairs->storage);
+}
+
+// PAIRS_F64 only.
+static inline void pairs_set(pairs_t *pairs, int i, double x0, double y0,
+                             double x1, double y1) {
+  pairs->x0[i] = x0;
+  pairs->y0[i] = y0;
+  pairs->x1[i] = x1;
+  pairs->y1[i] = y1;
+}
+
+// Blocks of SUMMATION_BLOCK pairs, the last one possibly partial.
+static inline int pairs_blocks(const pairs_t *pairs) {
+  return (pairs->count + SUMMATION_BLOCK - 1) / SUMMATION_BLOCK;
+}
+
+// haversine_batch() on n pairs from first, whatever the storage.
+static inline double pairs_distances(const pairs_t *pairs, int first, int n,
+                                     double *out) {
+  switch (pairs->storage) {
+  case PAIRS_F32:
+    return haversine_kernels.batch_f32(
+        (const float *)pairs->x0 + first, (const float *)pairs->y0 + first,
+        (const float *)pairs->x1 + first, (const float *)pairs->y1 + first, n,
+        REFERENCE_EARTH_RADIUS, out);
+  case PAIRS_MICRODEGREES:
+    return haversine_kernels.batch_microdegrees(
+        (const int32_t *)pairs->x0 + first, (const int32_t *)pairs->y0 + first,
+        (const int32_t *)pairs->x1 + first, (const int32_t *)pairs->y1 + first,
+        n, REFERENCE_EARTH_RADIUS, out);
+  default:
+    return haversine_batch(pairs->x0 + first, pairs->y0 + first,
+                           pairs->x1 + first, pairs->y1 + first, n,
+                           REFERENCE_EARTH_RADIUS, out);
+  }
+}
+
+// What a pass over the pairs can give besides the sum, every part of it
+// optional.
+typedef struct {
+  // Statistics of the distances, initialized.
+  distance_stats_t *stats;
+  // Every distance, at the index of its pair.
+  double *distances;
+} pairs_outputs_t;
+
+// Distances of the pairs in blocks [first_block, end_block). With
+// SUMMATION_FAST returns their sum. With SUMMATION_DETERMINISTIC adds the
+// pairwise sum of every block b to tree as block number block_base + b and
+// returns 0. Fills in outputs as well unless it is NULL.
+double pairs_sum_blocks(const pairs_t *pairs, int first_block, int end_block,
+                        summation_t summation, uint32_t block_base,
+                        summation_tree_t *tree,
+                        const pairs_outputs_t *outputs);
+
+// Mean distance of pairs that come one at a time and aren't kept. They are
+// collected into a block of SUMMATION_BLOCK, and every full block goes
+// through the kernels right away. Those are the same blocks in the same
+// order as average_harvestine() with one thread, so the result is the same
+// in either summation mode.
+typedef struct {
+  _Alignas(64) double x0[SUMMATION_BLOCK];
+  _Alignas(64) double y0[SUMMATION_BLOCK];
+  _Alignas(64) double x1[SUMMATION_BLOCK];
+  _Alignas(64) double y1[SUMMATION_BLOCK];
+  // Pairs in the current block.
+  int len;
+  // Full blocks so far.
+  uint32_t blocks;
+  summation_t summation;
+  // SUMMATION_FAST
+  double sum;
+  // SUMMATION_DETERMINISTIC
+  summation_tree_t tree;
+} pairs_accumulator_t;
+
+void pairs_accumulator_init(pairs_accumulator_t *acc, summation_t summation);
+// Adds the current block, full or not, to the sum.
+void pairs_accumulator_flush(pairs_accumulator_t *acc);
+
+static inline void pairs_accumulator_add(pairs_accumulator_t *acc, double x0,
+                                         double y0, double x1, double y1) {
+  int i = acc->len;
+  acc->x0[i] = x0;
+  acc->y0[i] = y0;
+  acc->x1[i] = x1;
+  acc->y1[i] = y1;
+  acc->len = i + 1;
+  if (acc->len == SUMMATION_BLOCK) {
+    pairs_accumulator_flush(acc);
+  }
+}
+
+// Mean distance of all the pairs added. Flushes the last block, so nothing
+// can be added after.
+double pairs_accumulator_average(pairs_accumulator_t *acc);
+
+// Mean haversine distance of the pairs, split across the given number of
+// threads, 1 to PARALLEL_MAX_THREADS. The calling thread does one share of
+// the work itself.
+double average_harvestine(const pairs_t *pairs, int threads,
+                          summation_t summation);
+
+// The same, with the same result, and fills in outputs in the same pass.
+// Every thread writes the distances of its own blocks. Returns false if out
+// of memory for the statistics of the other threads.
+bool average_harvestine_into(const pairs_t *pairs, int threads,
+                             summation_t summation, double *average,
+                             const pairs_outputs_t *outputs);
+
+#endif // PAIRS_H_
@@ -0,0 +1,184 @@
+#include "pairs_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BYTE_ORDER_MARK 0x01020304
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+_Static_assert(sizeof(pairs_file_header_t) == 64,
+               "columns have to start on a cache line");
+
+const char *pairs_file_status_name(pairs_file_status_t status) {
+  switch (status) {
+  case PAIRS_FILE_OK:
+    return "ok";
+  case PAIRS_FILE_IO_ERROR:
+    return strerror(errno);
+  case PAIRS_FILE_BAD_FORMAT:
+    return "not a pairs file";
+  case PAIRS_FILE_BAD_CHECKSUM:
+    return "checksum mismatch";
+  }
+  return "unknown error";
+}
+
+// A multiplication only carries a difference upwards, so the high half is
+// folded back down after each one. Without that, the sign bits of two
+// words cancel out.
+static uint64_t checksum_column(uint64_t hash, const double *column,
+                                size_t capacity) {
+  for (size_t i = 0; i < capacity; i++) {
+    uint64_t word;
+    memcpy(&word, &column[i], sizeof(word));
+    hash = (hash ^ word) * FNV_PRIME;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
+uint64_t pairs_file_checksum(const pairs_t *pairs) {
+  size_t capacity = pairs_capacity(pairs->count);
+  uint64_t hash = FNV_OFFSET_BASIS;
+  hash = checksum_column(hash, pairs->x0, capacity);
+  hash = checksum_column(hash, pairs->y0, capacity);
+  hash = checksum_column(hash, pairs->x1, capacity);
+  hash = checksum_column(hash, pairs->y1, capacity);
+  return hash;
+}
+
+bool pairs_file_write(FILE *out, const pairs_t *pairs) {
+  if (pairs->storage != PAIRS_F64) {
+    errno = EINVAL;
+    return false;
+  }
+  size_t capacity = pairs_capacity(pairs->count);
+  pairs_file_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PAIRS_FILE_MAGIC, sizeof(header.magic));
+  header.version = PAIRS_FILE_VERSION;
+  header.byte_order = BYTE_ORDER_MARK;
+  header.count = (uint64_t)pairs->count;
+  header.capacity = capacity;
+  header.checksum = pairs_file_checksum(pairs);
+
+  const double *columns[4] = {pairs->x0, pairs->y0, pairs->x1, pairs->y1};
+  if (fwrite(&header, sizeof(header), 1, out) != 1) {
+    return false;
+  }
+  for (int i = 0; i < 4; i++) {
+    if (fwrite(columns[i], sizeof(double), capacity, out) != capacity) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool pairs_file_save(const char *filename, const pairs_t *pairs) {
+  FILE *out = fopen(filename, "wb");
+  if (out == NULL) {
+    return false;
+  }
+  bool success = pairs_file_write(out, pairs);
+  if (fclose(out) != 0) {
+    success = false;
+  }
+  return success;
+}
+
+bool pairs_file_detect(const char *filename) {
+  FILE *in = fopen(filename, "rb");
+  if (in == NULL) {
+    return false;
+  }
+  char magic[4];
+  bool detected = fread(magic, sizeof(magic), 1, in) == 1 &&
+                  memcmp(magic, PAIRS_FILE_MAGIC, sizeof(magic)) == 0;
+  fclose(in);
+  return detected;
+}
+
+static bool header_is_valid(const pairs_file_header_t *header, size_t size) {
+  if (memcmp(header->magic, PAIRS_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != PAIRS_FILE_VERSION ||
+      header->byte_order != BYTE_ORDER_MARK || header->count > INT_MAX) {
+    return false;
+  }
+  size_t capacity = pairs_capacity((int)header->count);
+  return header->capacity == capacity &&
+         size == sizeof(*header) + 4 * capacity * sizeof(double);
+}
+
+pairs_file_status_t pairs_file_open(pairs_file_t *file, const char *filename,
+                                    bool verify) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return PAIRS_FILE_IO_ERROR;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return PAIRS_FILE_IO_ERROR;
+  }
+  if ((size_t)st.st_size < sizeof(pairs_file_header_t)) {
+    close(fd);
+    return PAIRS_FILE_BAD_FORMAT;
+  }
+
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed.
+  int error = errno;
+  close(fd);
+  if (base == MAP_FAILED) {
+    errno = error;
+    return PAIRS_FILE_IO_ERROR;
+  }
+  // The columns are read front to back, often more than once.
+  madvise(base, st.st_size, MADV_WILLNEED);
+
+  const pairs_file_header_t *header = (const pairs_file_header_t *)base;
+  if (!header_is_valid(header, (size_t)st.st_size)) {
+    munmap(base, st.st_size);
+    return PAIRS_FILE_BAD_FORMAT;
+  }
+
+  // The mapping is read-only, the pointers aren't const only because
+  // pairs_t is also used for columns that get filled.
+  double *columns = (double *)((char *)base + sizeof(*header));
+  size_t capacity = header->capacity;
+  file->pairs.x0 = columns;
+  file->pairs.y0 = columns + capacity;
+  file->pairs.x1 = columns + 2 * capacity;
+  file->pairs.y1 = columns + 3 * capacity;
+  file->pairs.count = (int)header->count;
+  file->pairs.storage = PAIRS_F64;
+
+  if (verify && pairs_file_checksum(&file->pairs) != header->checksum) {
+    munmap(base, st.st_size);
+    return PAIRS_FILE_BAD_CHECKSUM;
+  }
+
+  file->base = (const char *)base;
+  file->size = st.st_size;
+  return PAIRS_FILE_OK;
+}
+
+void pairs_file_close(pairs_file_t *file) {
+  if (file->base != NULL) {
+    munmap((void *)file->base, file->size);
+  }
+  file->base = NULL;
+  file->size = 0;
+  file->pairs.x0 = file->pairs.y0 = file->pairs.x1 = file->pairs.y1 = NULL;
+  file->pairs.count = 0;
+}
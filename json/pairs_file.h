@@ -0,0 +1,81 @@
+#ifndef PAIRS_FILE_H_
+#define PAIRS_FILE_H_
+
+// A binary file of pairs, laid out exactly like pairs_t, so that it can be
+// mapped and computed on in place instead of parsing the JSON again.
+//
+// Layout (native little-endian):
+//
+//   pairs_file_header_t   64 bytes: magic, version, byte order, count,
+//                         capacity and checksum
+//   x0                    capacity doubles
+//   y0                    capacity doubles
+//   x1                    capacity doubles
+//   y1                    capacity doubles
+//
+// capacity is count rounded up to PAIRS_PADDING, and the padding is zero,
+// the same as pairs_init() leaves it. Every column starts on a multiple of
+// 64 bytes, and so on a cache line once mapped.
+//
+// The checksum is FNV-1a's xor and multiply over the 64-bit words of the
+// four columns, padding included, with the high half of the hash folded into
+// the low half after every word, see pairs_file_checksum().
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "pairs.h"
+
+#define PAIRS_FILE_MAGIC "HPRS"
+#define PAIRS_FILE_VERSION 2
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t byte_order; // 0x01020304 as written by the producer
+  uint32_t reserved;
+  uint64_t count;
+  uint64_t capacity;
+  uint64_t checksum;
+  uint8_t padding[24];
+} pairs_file_header_t;
+
+typedef enum {
+  PAIRS_FILE_OK,
+  // errno is set.
+  PAIRS_FILE_IO_ERROR,
+  // Not a pairs file of this version, or truncated.
+  PAIRS_FILE_BAD_FORMAT,
+  PAIRS_FILE_BAD_CHECKSUM,
+} pairs_file_status_t;
+
+const char *pairs_file_status_name(pairs_file_status_t status);
+
+uint64_t pairs_file_checksum(const pairs_t *pairs);
+
+// Returns false on I/O errors, and for pairs not stored as PAIRS_F64 with
+// errno set to EINVAL.
+bool pairs_file_write(FILE *out, const pairs_t *pairs);
+bool pairs_file_save(const char *filename, const pairs_t *pairs);
+
+// Whether filename starts with the magic of a pairs file, whatever else it
+// holds.
+bool pairs_file_detect(const char *filename);
+
+typedef struct {
+  const char *base;
+  size_t size;
+  // Points into the mapping, which is read-only. Not to be passed to
+  // pairs_free().
+  pairs_t pairs;
+} pairs_file_t;
+
+// Maps a pairs file and checks its header and, if verify is set, its
+// checksum, which means reading it all once.
+pairs_file_status_t pairs_file_open(pairs_file_t *file, const char *filename,
+                                    bool verify);
+void pairs_file_close(pairs_file_t *file);
+
+#endif // PAIRS_FILE_H_
@@ -0,0 +1,344 @@
+#include "pairs_parser.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+  STEP_OK,
+  // The step needs more input than is there. Nothing it consumed counts.
+  STEP_INCOMPLETE,
+  STEP_ERROR,
+} step_t;
+
+void pairs_parser_init(pairs_parser_t *parser, pairs_parser_on_pair_t on_pair,
+                       void *ctx) {
+  json_lexer_init(&parser->lexer, NULL);
+  parser->state = PAIRS_STATE_DOCUMENT;
+  parser->seen_pairs = false;
+  parser->on_pair = on_pair;
+  parser->ctx = ctx;
+  parser->count = 0;
+  parser->offset = 0;
+  parser->text = NULL;
+}
+
+void pairs_parser_free(pairs_parser_t *parser) {
+  json_lexer_free(&parser->lexer);
+}
+
+static void parse_error(pairs_parser_t *parser, const char *expected) {
+  fprintf(stderr, "parse error: expected %s near offset %zu\n", expected,
+          parser->offset + (parser->lexer.input - parser->text));
+}
+
+// Pieces are only ever parsed up to a '}', so a string running into the end
+// of the input has been cut off by it.
+static bool next_token(pairs_parser_t *parser) {
+  json_lexer_t *lexer = &parser->lexer;
+  if (!json_lexer_get_token(lexer)) {
+    return false;
+  }
+  return lexer->token != JSON_TOK_STRING || lexer->input < lexer->end;
+}
+
+static step_t expect(pairs_parser_t *parser, int token, const char *expected) {
+  if (!next_token(parser)) {
+    return STEP_INCOMPLETE;
+  }
+  if (parser->lexer.token != token) {
+    parse_error(parser, expected);
+    return STEP_ERROR;
+  }
+  return STEP_OK;
+}
+
+static bool is_scalar(int token) {
+  return token == JSON_TOK_STRING || token == JSON_TOK_NUMBER ||
+         token == JSON_TOK_TRUE || token == JSON_TOK_FALSE ||
+         token == JSON_TOK_NULL;
+}
+
+static const char *const fields[4] = {"x0", "y0", "x1", "y1"};
+
+static int field_index(const char *key) {
+  for (int i = 0; i < 4; i++) {
+    if (strcmp(key, fields[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// The rest of a pair once its { has been consumed.
+static step_t parse_pair(pairs_parser_t *parser) {
+  json_lexer_t *lexer = &parser->lexer;
+  double values[4];
+  bool found[4] = {false, false, false, false};
+
+  if (!next_token(parser)) {
+    return STEP_INCOMPLETE;
+  }
+  while (lexer->token != '}') {
+    if (lexer->token != JSON_TOK_STRING) {
+      parse_error(parser, "a key");
+      return STEP_ERROR;
+    }
+    // Before the next token overwrites the string.
+    int field = field_index(lexer->string_value);
+
+    step_t step = expect(parser, ':', "':'");
+    if (step != STEP_OK) {
+      return step;
+    }
+    if (!next_token(parser)) {
+      return STEP_INCOMPLETE;
+    }
+    if (field >= 0 && lexer->token == JSON_TOK_NUMBER) {
+      values[field] = lexer->numeric_value;
+      found[field] = true;
+    } else if (field >= 0 || !is_scalar(lexer->token)) {
+      parse_error(parser, field >= 0 ? "a number" : "a scalar");
+      return STEP_ERROR;
+    }
+
+    if (!next_token(parser)) {
+      return STEP_INCOMPLETE;
+    }
+    if (lexer->token == ',') {
+      if (!next_token(parser)) {
+        return STEP_INCOMPLETE;
+      }
+    } else if (lexer->token != '}') {
+      parse_error(parser, "',' or '}'");
+      return STEP_ERROR;
+    }
+  }
+
+  if (!found[0] || !found[1] || !found[2] || !found[3]) {
+    fprintf(stderr,
+            "load error: one of x0, y0, x1, y1 is missing in pair %d\n",
+            parser->count);
+    return STEP_ERROR;
+  }
+  parser->count++;
+  parser->on_pair(parser->ctx, values[0], values[1], values[2], values[3]);
+  return STEP_OK;
+}
+
+static step_t finish(pairs_parser_t *parser) {
+  if (!parser->seen_pairs) {
+    fprintf(stderr, "load error: \"pairs\" not found\n");
+    return STEP_ERROR;
+  }
+  parser->state = PAIRS_STATE_DONE;
+  return STEP_OK;
+}
+
+static step_t parse_member(pairs_parser_t *parser) {
+  json_lexer_t *lexer = &parser->lexer;
+  if (!next_token(parser)) {
+    return STEP_INCOMPLETE;
+  }
+  if (parser->state == PAIRS_STATE_FIRST_MEMBER && lexer->token == '}') {
+    return finish(parser);
+  }
+  if (lexer->token != JSON_TOK_STRING) {
+    parse_error(parser, "a key");
+    return STEP_ERROR;
+  }
+  bool is_pairs = strcmp(lexer->string_value, "pairs") == 0;
+
+  step_t step = expect(parser, ':', "':'");
+  if (step != STEP_OK) {
+    return step;
+  }
+  if (!next_token(parser)) {
+    return STEP_INCOMPLETE;
+  }
+  if (is_pairs) {
+    if (lexer->token != '[') {
+      fprintf(stderr, "load error: \"pairs\" expected to be an array\n");
+      return STEP_ERROR;
+    }
+    parser->seen_pairs = true;
+    parser->state = PAIRS_STATE_FIRST_PAIR;
+    return STEP_OK;
+  }
+  if (!is_scalar(lexer->token)) {
+    parse_error(parser, "a scalar");
+    return STEP_ERROR;
+  }
+  parser->state = PAIRS_STATE_AFTER_MEMBER;
+  return STEP_OK;
+}
+
+// Consumes one member of the document or one pair, and only commits to the
+// new state once it is complete.
+static step_t parse_step(pairs_parser_t *parser) {
+  json_lexer_t *lexer = &parser->lexer;
+  step_t step;
+
+  switch (parser->state) {
+  case PAIRS_STATE_DOCUMENT:
+    step = expect(parser, '{', "'{'");
+    if (step == STEP_OK) {
+      parser->state = PAIRS_STATE_FIRST_MEMBER;
+    }
+    return step;
+
+  case PAIRS_STATE_FIRST_MEMBER:
+  case PAIRS_STATE_MEMBER:
+    return parse_member(parser);
+
+  case PAIRS_STATE_AFTER_MEMBER:
+    if (!next_token(parser)) {
+      return STEP_INCOMPLETE;
+    }
+    if (lexer->token == ',') {
+      parser->state = PAIRS_STATE_MEMBER;
+    } else if (lexer->token == '}') {
+      return finish(parser);
+    } else {
+      parse_error(parser, "',' or '}'");
+      return STEP_ERROR;
+    }
+    return STEP_OK;
+
+  case PAIRS_STATE_FIRST_PAIR:
+  case PAIRS_STATE_PAIR:
+    if (!next_token(parser)) {
+      return STEP_INCOMPLETE;
+    }
+    if (parser->state == PAIRS_STATE_FIRST_PAIR && lexer->token == ']') {
+      parser->state = PAIRS_STATE_AFTER_MEMBER;
+      return STEP_OK;
+    }
+    if (lexer->token != '{') {
+      parse_error(parser, "'{'");
+      return STEP_ERROR;
+    }
+    step = parse_pair(parser);
+    if (step == STEP_OK) {
+      parser->state = PAIRS_STATE_AFTER_PAIR;
+    }
+    return step;
+
+  case PAIRS_STATE_AFTER_PAIR:
+    if (!next_token(parser)) {
+      return STEP_INCOMPLETE;
+    }
+    if (lexer->token == ',') {
+      parser->state = PAIRS_STATE_PAIR;
+    } else if (lexer->token == ']') {
+      parser->state = PAIRS_STATE_AFTER_MEMBER;
+    } else {
+      parse_error(parser, "',' or ']'");
+      return STEP_ERROR;
+    }
+    return STEP_OK;
+
+  case PAIRS_STATE_DONE:
+    break;
+  }
+  return STEP_OK;
+}
+
+pairs_parser_status_t pairs_parser_feed(pairs_parser_t *parser, char *text,
+                                        size_t len, bool end_of_input,
+                                        size_t *consumed) {
+  if (parser->state == PAIRS_STATE_DONE) {
+    *consumed = len;
+    return PAIRS_PARSER_DONE;
+  }
+
+  // Up to the last '}' there can't be a number cut in half, only a string,
+  // which next_token() catches.
+  size_t limit = len;
+  if (!end_of_input) {
+    while (limit > 0 && text[limit - 1] != '}') {
+      limit--;
+    }
+  }
+  char saved = text[limit];
+  text[limit] = '\0';
+
+  parser->text = text;
+  json_lexer_reset(&parser->lexer, text, limit);
+  const char *checkpoint = text;
+  step_t step = STEP_OK;
+  while (parser->state != PAIRS_STATE_DONE) {
+    checkpoint = parser->lexer.input;
+    step = parse_step(parser);
+    if (step != STEP_OK) {
+      break;
+    }
+  }
+  text[limit] = saved;
+
+  pairs_parser_status_t status;
+  if (step == STEP_ERROR) {
+    status = PAIRS_PARSER_ERROR;
+  } else if (parser->state == PAIRS_STATE_DONE) {
+    checkpoint = text + len;
+    status = PAIRS_PARSER_DONE;
+  } else if (end_of_input) {
+    parser->lexer.input = checkpoint;
+    parse_error(parser, "more input");
+    status = PAIRS_PARSER_ERROR;
+  } else {
+    status = PAIRS_PARSER_MORE;
+  }
+
+  *consumed = checkpoint - text;
+  parser->offset += *consumed;
+  return status;
+}
+
+pairs_parser_status_t pairs_parser_read(pairs_parser_t *parser,
+                                        file_reader_t *reader) {
+  size_t staging_cap = 2 * reader->buffer_size + 1;
+  char *staging = malloc(staging_cap);
+  if (staging == NULL) {
+    fprintf(stderr, "parse error: out of memory\n");
+    return PAIRS_PARSER_ERROR;
+  }
+
+  size_t staged = 0;
+  pairs_parser_status_t status = PAIRS_PARSER_MORE;
+  const char *piece;
+  size_t len;
+  while (status == PAIRS_PARSER_MORE &&
+         (piece = file_reader_next(reader, &len)) != NULL) {
+    if (staged + len >= staging_cap) {
+      fprintf(stderr, "parse error: no '}' in %zu bytes near offset %zu\n",
+              staged, parser->offset);
+      status = PAIRS_PARSER_ERROR;
+    } else {
+      memcpy(staging + staged, piece, len);
+      staged += len;
+    }
+    file_reader_release(reader);
+
+    if (status == PAIRS_PARSER_MORE) {
+      size_t consumed;
+      status = pairs_parser_feed(parser, staging, staged, false, &consumed);
+      memmove(staging, staging + consumed, staged - consumed);
+      staged -= consumed;
+    }
+  }
+
+  if (reader->error != 0) {
+    // Whatever was parsed, the input is incomplete.
+    errno = reader->error;
+    perror("read error");
+    status = PAIRS_PARSER_ERROR;
+  } else if (status == PAIRS_PARSER_MORE) {
+    size_t consumed;
+    status = pairs_parser_feed(parser, staging, staged, true, &consumed);
+  }
+
+  free(staging);
+  return status;
+}
@@ -0,0 +1,79 @@
+#ifndef PAIRS_PARSER_H_
+#define PAIRS_PARSER_H_
+
+// Streaming parser for the input format only, not JSON in general: a dict
+// with a "pairs" array of dicts that have numbers x0, y0, x1 and y1. Other
+// members have to be scalars.
+//
+// No document is built. Every pair is handed to a callback as soon as its
+// closing } has been read, and the input can come in pieces of any size.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "file_reader.h"
+#include "json_lexer.h"
+
+typedef void (*pairs_parser_on_pair_t)(void *ctx, double x0, double y0,
+                                       double x1, double y1);
+
+typedef enum {
+  // Everything complete has been parsed, the rest needs more input.
+  PAIRS_PARSER_MORE,
+  // The document is finished. Anything after it is ignored, like
+  // json_parse() does.
+  PAIRS_PARSER_DONE,
+  // Reported on stderr.
+  PAIRS_PARSER_ERROR,
+} pairs_parser_status_t;
+
+typedef enum {
+  PAIRS_STATE_DOCUMENT,     // before the opening {
+  PAIRS_STATE_FIRST_MEMBER, // right after it
+  PAIRS_STATE_MEMBER,       // after a comma
+  PAIRS_STATE_AFTER_MEMBER,
+  PAIRS_STATE_FIRST_PAIR, // right after the [ of "pairs"
+  PAIRS_STATE_PAIR,       // after a comma
+  PAIRS_STATE_AFTER_PAIR,
+  PAIRS_STATE_DONE,
+} pairs_parser_state_t;
+
+typedef struct {
+  json_lexer_t lexer;
+  pairs_parser_state_t state;
+  bool seen_pairs;
+  pairs_parser_on_pair_t on_pair;
+  void *ctx;
+  // Pairs so far.
+  int count;
+  // Offset of the text passed to the current call in the whole input, for
+  // error messages.
+  size_t offset;
+  const char *text;
+} pairs_parser_t;
+
+void pairs_parser_init(pairs_parser_t *parser, pairs_parser_on_pair_t on_pair,
+                       void *ctx);
+void pairs_parser_free(pairs_parser_t *parser);
+
+// Parses text[0, len), which continues the input where the previous call
+// left off, and sets *consumed to how much of it was used. The rest has to
+// be passed again, followed by more input, in the next call. With
+// end_of_input set that rest has to be empty.
+//
+// text[len] has to be writable, the parser terminates the text in place.
+// Pieces are parsed up to their last '}' only, so every piece has to
+// contain one for the parser to make progress.
+pairs_parser_status_t pairs_parser_feed(pairs_parser_t *parser, char *text,
+                                        size_t len, bool end_of_input,
+                                        size_t *consumed);
+
+// Parses the pieces of a file as they come from reader, and stops reading
+// once the document is finished. Every piece is copied into a staging
+// buffer after the incomplete rest of the previous one, so no pair can be
+// longer than a piece. Returns PAIRS_PARSER_DONE or PAIRS_PARSER_ERROR,
+// with read errors reported on stderr as well.
+pairs_parser_status_t pairs_parser_read(pairs_parser_t *parser,
+                                        file_reader_t *reader);
+
+#endif // PAIRS_PARSER_H_
@@ -0,0 +1,27 @@
+#include "parallel.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+void run_parallel(void *shares, size_t stride, int threads,
+                  void *(*fn)(void *)) {
+  assert(1 <= threads && threads <= PARALLEL_MAX_THREADS);
+  pthread_t ids[PARALLEL_MAX_THREADS];
+  bool started[PARALLEL_MAX_THREADS];
+  char *share = (char *)shares;
+
+  for (int t = 1; t < threads; t++) {
+    started[t] = pthread_create(&ids[t], NULL, fn, share + t * stride) == 0;
+    if (!started[t]) {
+      // Out of threads, do it here instead.
+      fn(share + t * stride);
+    }
+  }
+  fn(share);
+  for (int t = 1; t < threads; t++) {
+    if (started[t]) {
+      pthread_join(ids[t], NULL);
+    }
+  }
+}
@@ -0,0 +1,30 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+// Splitting work into one share per thread and running the shares at once.
+// Every caller keeps its shares in an array of its own struct, which starts
+// with an _Alignas(64) field so that every share is on cache lines of its
+// own and the threads writing their results don't fight over them.
+
+#include <stddef.h>
+
+// Upper bound for the threads argument of everything built on
+// run_parallel().
+#define PARALLEL_MAX_THREADS 256
+
+// Where share t starts when count items are split into threads contiguous
+// runs, the first count % threads of them one longer. Share t is
+// [parallel_split(count, threads, t), parallel_split(count, threads, t + 1)).
+static inline int parallel_split(int count, int threads, int t) {
+  int longer = t < count % threads ? t : count % threads;
+  return t * (count / threads) + longer;
+}
+
+// Calls fn(share) for the threads shares starting at shares, stride bytes
+// apart, and returns when all of them are done. Share 0 runs on the calling
+// thread, the others on threads of their own, or on the calling thread too
+// if there are none to be had.
+void run_parallel(void *shares, size_t stride, int threads,
+                  void *(*fn)(void *));
+
+#endif // PARALLEL_H_
@@ -0,0 +1,346 @@
+#include "pipeline.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "file_reader.h"
+#include "pairs.h"
+#include "pairs_parser.h"
+#include "spsc_ring.h"
+#include "stopwatch.h"
+
+#define BATCH_BLOCKS (PIPELINE_BATCH / SUMMATION_BLOCK)
+_Static_assert(PIPELINE_BATCH % SUMMATION_BLOCK == 0,
+               "batches have to be whole summation blocks");
+
+// PIPELINE_BATCH pairs, the last batch of the input possibly fewer. pairs
+// points at the columns of the same slot.
+typedef struct {
+  uint32_t index;
+  pairs_t pairs;
+  _Alignas(64) double columns[4][PIPELINE_BATCH];
+} batch_t;
+
+typedef struct {
+  const pipeline_options_t *options;
+  file_reader_t reader;
+
+  // One per worker. Batch number i goes to worker i % threads.
+  spsc_ring_t batches[PARALLEL_MAX_THREADS];
+  // SUMMATION_DETERMINISTIC only: the summation tree of every batch, back
+  // from the worker in the same order.
+  spsc_ring_t results[PARALLEL_MAX_THREADS];
+  size_t memory;
+
+  // Written by the parser, which reads as well.
+  bool failed;
+  int count;
+  uint64_t parse_ns;
+} pipeline_t;
+
+typedef struct {
+  _Alignas(64) pipeline_t *pipeline;
+  int id;
+  pthread_t thread;
+  // SUMMATION_FAST: the sum of all the batches of this worker.
+  double sum;
+  uint64_t busy_ns;
+} worker_t;
+
+// Parser
+
+typedef struct {
+  pipeline_t *pipeline;
+  pairs_parser_t parser;
+
+  // The batch being filled, if any.
+  batch_t *batch;
+  uint32_t batch_index;
+
+  uint64_t wait_ns;
+  stopwatch_t stopwatch;
+} parse_stage_t;
+
+static void publish_batch(parse_stage_t *stage) {
+  int threads = stage->pipeline->options->threads;
+  spsc_ring_end_push(&stage->pipeline->batches[stage->batch_index % threads]);
+  stage->batch = NULL;
+  stage->batch_index++;
+}
+
+static void add_pair(void *ctx, double x0, double y0, double x1, double y1) {
+  parse_stage_t *stage = (parse_stage_t *)ctx;
+  if (stage->batch == NULL) {
+    int threads = stage->pipeline->options->threads;
+    stopwatch_start(&stage->stopwatch);
+    batch_t *batch = (batch_t *)spsc_ring_begin_push(
+        &stage->pipeline->batches[stage->batch_index % threads]);
+    stage->wait_ns += stopwatch_end(&stage->stopwatch);
+
+    batch->index = stage->batch_index;
+    batch->pairs.x0 = batch->columns[0];
+    batch->pairs.y0 = batch->columns[1];
+    batch->pairs.x1 = batch->columns[2];
+    batch->pairs.y1 = batch->columns[3];
+    batch->pairs.count = 0;
+    batch->pairs.storage = PAIRS_F64;
+    stage->batch = batch;
+  }
+
+  pairs_t *pairs = &stage->batch->pairs;
+  pairs_set(pairs, pairs->count++, x0, y0, x1, y1);
+  if (pairs->count == PIPELINE_BATCH) {
+    publish_batch(stage);
+  }
+}
+
+static void *run_parser(void *arg) {
+  parse_stage_t *stage = (parse_stage_t *)arg;
+  pipeline_t *pipeline = stage->pipeline;
+  stopwatch_t total;
+  stopwatch_init(&total);
+  stopwatch_start(&total);
+
+  pipeline->failed = pairs_parser_read(&stage->parser, &pipeline->reader) !=
+                     PAIRS_PARSER_DONE;
+  if (stage->batch != NULL && stage->batch->pairs.count > 0) {
+    publish_batch(stage);
+  }
+  for (int w = 0; w < pipeline->options->threads; w++) {
+    spsc_ring_close(&pipeline->batches[w]);
+  }
+
+  pipeline->count = stage->parser.count;
+  pipeline->parse_ns =
+      stopwatch_end(&total) - stage->wait_ns - pipeline->reader.wait_ns;
+  return NULL;
+}
+
+// Compute
+
+static void *run_worker(void *arg) {
+  worker_t *worker = (worker_t *)arg;
+  pipeline_t *pipeline = worker->pipeline;
+  spsc_ring_t *batches = &pipeline->batches[worker->id];
+  spsc_ring_t *results = &pipeline->results[worker->id];
+  summation_t summation = pipeline->options->summation;
+  stopwatch_t stopwatch;
+  stopwatch_init(&stopwatch);
+
+  batch_t *batch;
+  while ((batch = (batch_t *)spsc_ring_begin_pop(batches)) != NULL) {
+    int blocks = pairs_blocks(&batch->pairs);
+    if (summation == SUMMATION_DETERMINISTIC) {
+      summation_tree_t *tree =
+          (summation_tree_t *)spsc_ring_begin_push(results);
+      summation_tree_init(tree);
+      stopwatch_start(&stopwatch);
+      pairs_sum_blocks(&batch->pairs, 0, blocks, summation,
+                       batch->index * BATCH_BLOCKS, tree, NULL);
+      worker->busy_ns += stopwatch_end(&stopwatch);
+      spsc_ring_end_push(results);
+    } else {
+      stopwatch_start(&stopwatch);
+      worker->sum +=
+          pairs_sum_blocks(&batch->pairs, 0, blocks, summation, 0, NULL,
+                           NULL);
+      worker->busy_ns += stopwatch_end(&stopwatch);
+    }
+    spsc_ring_end_pop(batches);
+  }
+
+  if (summation == SUMMATION_DETERMINISTIC) {
+    spsc_ring_close(results);
+  }
+  return NULL;
+}
+
+// Setup
+
+void pipeline_options_init(pipeline_options_t *options) {
+  options->threads = 1;
+  options->summation = SUMMATION_FAST;
+  options->memory = PIPELINE_DEFAULT_MEMORY;
+  options->chunk = PIPELINE_DEFAULT_CHUNK;
+}
+
+// The largest power of two number of slots that fits into budget, at least
+// two so that producer and consumer can work at the same time.
+static size_t ring_capacity(size_t budget, size_t slot_size) {
+  size_t capacity = 2;
+  while (capacity * 2 * slot_size <= budget) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+static bool init_ring(pipeline_t *pipeline, spsc_ring_t *ring, size_t budget,
+                      size_t slot_size) {
+  size_t capacity = ring_capacity(budget, slot_size);
+  if (!spsc_ring_init(ring, capacity, slot_size)) {
+    return false;
+  }
+  pipeline->memory += ring->capacity * ring->slot_size;
+  return true;
+}
+
+// Half of the budget goes to the input: the reader's buffers and the staging
+// buffer of the parser, which holds up to two of them. The other half to the
+// batches, shared among the workers.
+static int reader_buffers(const pipeline_options_t *options) {
+  size_t staging = 2 * options->chunk + 1;
+  size_t input_budget = options->memory / 2;
+  input_budget = input_budget > staging ? input_budget - staging : 0;
+  return (int)ring_capacity(input_budget, options->chunk);
+}
+
+static bool init_rings(pipeline_t *pipeline, int *initialized) {
+  const pipeline_options_t *options = pipeline->options;
+  size_t worker_budget = options->memory / 2 / options->threads;
+  for (*initialized = 0; *initialized < options->threads; (*initialized)++) {
+    int w = *initialized;
+    if (!init_ring(pipeline, &pipeline->batches[w], worker_budget,
+                   sizeof(batch_t))) {
+      return false;
+    }
+    // A tree per batch in flight, small next to the batches themselves.
+    if (!init_ring(pipeline, &pipeline->results[w],
+                   pipeline->batches[w].capacity * sizeof(summation_tree_t),
+                   sizeof(summation_tree_t))) {
+      spsc_ring_free(&pipeline->batches[w]);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void free_rings(pipeline_t *pipeline, int workers) {
+  for (int w = 0; w < workers; w++) {
+    spsc_ring_free(&pipeline->batches[w]);
+    spsc_ring_free(&pipeline->results[w]);
+  }
+}
+
+bool pipeline_run(const char *filename, const pipeline_options_t *options,
+                  pipeline_result_t *result) {
+  assert(1 <= options->threads &&
+         options->threads <= PARALLEL_MAX_THREADS);
+
+  pipeline_t *pipeline = calloc(1, sizeof(pipeline_t));
+  worker_t *workers = aligned_alloc(_Alignof(worker_t),
+                                    options->threads * sizeof(worker_t));
+  parse_stage_t stage = {0};
+  int rings = 0;
+  int started = 0;
+  pthread_t parser_thread;
+  bool parser_started = false;
+  bool success = false;
+
+  if (pipeline == NULL || workers == NULL) {
+    fprintf(stderr, "pipeline error: out of memory\n");
+    goto exit;
+  }
+  pipeline->options = options;
+  if (!init_rings(pipeline, &rings)) {
+    fprintf(stderr, "pipeline error: out of memory\n");
+    goto exit;
+  }
+
+  // Consumers first, so that every stage has someone to drain its output by
+  // the time it starts.
+  for (; started < options->threads; started++) {
+    worker_t *worker = &workers[started];
+    memset(worker, 0, sizeof(*worker));
+    worker->pipeline = pipeline;
+    worker->id = started;
+    if (pthread_create(&worker->thread, NULL, run_worker, worker) != 0) {
+      break;
+    }
+  }
+
+  if (started < options->threads) {
+    fprintf(stderr, "pipeline error: could not start threads\n");
+  } else if (!file_reader_open(&pipeline->reader, filename, options->chunk,
+                               reader_buffers(options))) {
+    perror(filename);
+  } else {
+    pipeline->memory += pipeline->reader.buffer_count *
+                            pipeline->reader.buffer_size +
+                        2 * pipeline->reader.buffer_size + 1;
+    stage.pipeline = pipeline;
+    pairs_parser_init(&stage.parser, add_pair, &stage);
+    stopwatch_init(&stage.stopwatch);
+    parser_started =
+        pthread_create(&parser_thread, NULL, run_parser, &stage) == 0;
+    if (!parser_started) {
+      fprintf(stderr, "pipeline error: could not start threads\n");
+      file_reader_close(&pipeline->reader);
+      pairs_parser_free(&stage.parser);
+    }
+  }
+  if (!parser_started) {
+    // Lets the workers that did start run dry.
+    pipeline->failed = true;
+    for (int w = 0; w < started; w++) {
+      spsc_ring_close(&pipeline->batches[w]);
+    }
+  }
+
+  // Put the batches back in order. The workers take turns, so the next one
+  // always comes from the next worker.
+  summation_tree_t tree;
+  summation_tree_init(&tree);
+  if (options->summation == SUMMATION_DETERMINISTIC && started > 0) {
+    for (int i = 0;; i = (i + 1) % started) {
+      const summation_tree_t *batch =
+          (const summation_tree_t *)spsc_ring_begin_pop(&pipeline->results[i]);
+      if (batch == NULL) {
+        break;
+      }
+      summation_tree_append(&tree, batch);
+      spsc_ring_end_pop(&pipeline->results[i]);
+    }
+  }
+
+  double sum = 0;
+  uint64_t compute_ns = 0;
+  for (int w = 0; w < started; w++) {
+    pthread_join(workers[w].thread, NULL);
+    sum += workers[w].sum;
+    compute_ns += workers[w].busy_ns;
+  }
+  if (options->summation == SUMMATION_DETERMINISTIC) {
+    sum = summation_tree_total(&tree);
+  }
+  if (!parser_started) {
+    goto exit;
+  }
+
+  pthread_join(parser_thread, NULL);
+  // The parser stops reading at the end of the document, after an error in
+  // the middle of it too.
+  file_reader_close(&pipeline->reader);
+  pairs_parser_free(&stage.parser);
+
+  success = !pipeline->failed;
+  if (success) {
+    result->answer = sum / pipeline->count;
+    result->count = pipeline->count;
+    result->input_len = pipeline->reader.len;
+    result->memory = pipeline->memory;
+    result->read_ns = pipeline->reader.read_ns;
+    result->parse_ns = pipeline->parse_ns;
+    result->compute_ns = compute_ns;
+  }
+
+exit:
+  if (pipeline != NULL) {
+    free_rings(pipeline, rings);
+  }
+  free(workers);
+  free(pipeline);
+  return success;
+}
@@ -0,0 +1,64 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+// Reads, parses and computes at the same time instead of one phase after
+// the other:
+//
+//   reader --chunks--> parser --batches--> compute workers --> caller
+//
+// The reader thread fills chunks of the file, the parser thread turns them
+// into batches of pairs and hands them out round robin to the workers, one
+// spsc_ring_t per hand-off. Full rings hold the earlier stages back, so the
+// whole run stays within a fixed amount of memory however large the input,
+// and the wall time approaches that of the slowest stage rather than the
+// sum of all three.
+//
+// The parser is a pairs_parser_t, which only understands the input format.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "summation.h"
+
+// Pairs per batch, a multiple of SUMMATION_BLOCK.
+#define PIPELINE_BATCH 4096
+
+#define PIPELINE_DEFAULT_MEMORY (16 << 20)
+#define PIPELINE_DEFAULT_CHUNK (1 << 20)
+
+typedef struct {
+  // Compute workers, 1 to PARALLEL_MAX_THREADS. The reader and the parser
+  // get a thread each on top.
+  int threads;
+  summation_t summation;
+  // Bytes for all the buffers together. Every ring gets at least two slots,
+  // so budgets too small for that are exceeded.
+  size_t memory;
+  // Bytes per read from the file. The parser keeps the last incomplete pair
+  // of a chunk, so it has to be longer than any pair.
+  size_t chunk;
+} pipeline_options_t;
+
+typedef struct {
+  double answer;
+  int count;
+  size_t input_len;
+  // Buffers actually allocated.
+  size_t memory;
+  // Time each stage spent working rather than waiting for the others,
+  // summed over the workers for compute.
+  uint64_t read_ns;
+  uint64_t parse_ns;
+  uint64_t compute_ns;
+} pipeline_result_t;
+
+void pipeline_options_init(pipeline_options_t *options);
+
+// Mean haversine distance of the pairs in filename, the same as
+// average_harvestine() on the loaded pairs, bit for bit in
+// SUMMATION_DETERMINISTIC mode. Reports errors on stderr and returns false.
+bool pipeline_run(const char *filename, const pipeline_options_t *options,
+                  pipeline_result_t *result);
+
+#endif // PIPELINE_H_
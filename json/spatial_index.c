@@ -0,0 +1,346 @@
+#include "spatial_index.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harvestine_math.h"
+
+// Added to the bounds of the cap against rounding, about 10 cm.
+#define MARGIN_DEGREES 1e-6
+#define MIN_MATCHES 64
+
+// The cell a coordinate falls in along one axis, clamped to [0, cells), so
+// that 90 and 180 go in the last one.
+static int cell_of(double degrees, double cell_degrees, int cells) {
+  double cell = floor(degrees / cell_degrees);
+  if (!(cell >= 0)) {
+    return 0;
+  }
+  return cell >= cells ? cells - 1 : (int)cell;
+}
+
+static int cell_index(const spatial_index_t *index, double x, double y) {
+  int band = cell_of(y + 90, index->cell_degrees, index->bands);
+  int column = cell_of(x + 180, index->cell_degrees, index->columns);
+  return band * index->columns + column;
+}
+
+bool spatial_index_init(spatial_index_t *index, const double *x,
+                        const double *y, int count, double earth_radius) {
+  // Square cells in degrees, twice as many columns as bands.
+  double bands = ceil(sqrt(count / (2.0 * SPATIAL_INDEX_POINTS_PER_CELL)));
+  index->bands = bands < 1                         ? 1
+                 : bands > SPATIAL_INDEX_MAX_BANDS ? SPATIAL_INDEX_MAX_BANDS
+                                                   : (int)bands;
+  index->columns = 2 * index->bands;
+  index->cell_degrees = 180.0 / index->bands;
+  index->earth_radius = earth_radius;
+  size_t cells = (size_t)index->bands * index->columns;
+
+  index->cell_starts = calloc(cells + 1, sizeof(int));
+  index->ids = malloc(((size_t)count + 1) * sizeof(int));
+  int *point_cells = malloc(((size_t)count + 1) * sizeof(int));
+  double *sorted = malloc(((size_t)count + 1) * 2 * sizeof(double));
+  bool ok = index->cell_starts != NULL && index->ids != NULL &&
+            point_cells != NULL && sorted != NULL;
+
+  if (ok) {
+    // A counting sort by cell, which keeps the points of a cell in order.
+    int *starts = index->cell_starts;
+    for (int i = 0; i < count; i++) {
+      point_cells[i] = cell_index(index, x[i], y[i]);
+      starts[point_cells[i] + 1]++;
+    }
+    for (size_t c = 0; c < cells; c++) {
+      starts[c + 1] += starts[c];
+    }
+    double *sorted_x = sorted;
+    double *sorted_y = sorted + count;
+    for (int i = 0; i < count; i++) {
+      int to = starts[point_cells[i]]++;
+      index->ids[to] = i;
+      sorted_x[to] = x[i];
+      sorted_y[to] = y[i];
+    }
+    // Every start moved to the next cell's, move them back.
+    memmove(starts + 1, starts, cells * sizeof(int));
+    starts[0] = 0;
+    ok = haversine_points_init(&index->points, sorted_x, sorted_y, count);
+  }
+
+  free(point_cells);
+  free(sorted);
+  if (!ok) {
+    free(index->cell_starts);
+    free(index->ids);
+    index->cell_starts = NULL;
+    index->ids = NULL;
+  }
+  return ok;
+}
+
+void spatial_index_free(spatial_index_t *index) {
+  haversine_points_free(&index->points);
+  free(index->ids);
+  free(index->cell_starts);
+  index->ids = NULL;
+  index->cell_starts = NULL;
+}
+
+void spatial_matches_free(spatial_matches_t *matches) {
+  free(matches->matches);
+  spatial_matches_init(matches);
+}
+
+static bool push_match(spatial_matches_t *matches, int point,
+                       double distance) {
+  if (matches->count == matches->capacity) {
+    int capacity =
+        matches->capacity < MIN_MATCHES ? MIN_MATCHES : 2 * matches->capacity;
+    spatial_match_t *grown =
+        realloc(matches->matches, capacity * sizeof(spatial_match_t));
+    if (grown == NULL) {
+      return false;
+    }
+    matches->matches = grown;
+    matches->capacity = capacity;
+  }
+  matches->matches[matches->count++] = (spatial_match_t){point, distance};
+  return true;
+}
+
+static int compare_matches(const void *a, const void *b) {
+  const spatial_match_t *x = (const spatial_match_t *)a;
+  const spatial_match_t *y = (const spatial_match_t *)b;
+  if (x->distance != y->distance) {
+    return x->distance < y->distance ? -1 : 1;
+  }
+  return (x->point > y->point) - (x->point < y->point);
+}
+
+static void sort_matches(spatial_matches_t *matches) {
+  if (matches->count > 1) {
+    qsort(matches->matches, matches->count, sizeof(spatial_match_t),
+          compare_matches);
+  }
+}
+
+// Adds the points [first, end) of the index within radius of point to
+// matches, a tile of them at a time like distance_matrix().
+static bool refine(const spatial_index_t *index,
+                   const haversine_point_t *point, int first, int end,
+                   double radius, spatial_matches_t *matches) {
+  double distances[DISTANCE_MATRIX_TILE_COLUMNS];
+  for (int j = first; j < end; j += DISTANCE_MATRIX_TILE_COLUMNS) {
+    int n = end - j < DISTANCE_MATRIX_TILE_COLUMNS
+                ? end - j
+                : DISTANCE_MATRIX_TILE_COLUMNS;
+    haversine_kernels.row(point, &index->points, j, n, index->earth_radius,
+                          distances);
+    for (int i = 0; i < n; i++) {
+      if (distances[i] <= radius &&
+          !push_match(matches, index->ids[j + i], distances[i])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Adds the points within radius of point, which is (x, y), to matches in
+// no particular order.
+static bool collect(const spatial_index_t *index,
+                    const haversine_point_t *point, double x, double y,
+                    double radius, spatial_matches_t *matches) {
+  double angle = radius / index->earth_radius;
+  double degrees = angle / HARVESTINE_DEGREES_TO_RADIANS + MARGIN_DEGREES;
+  double south = y - degrees;
+  double north = y + degrees;
+  double cell = index->cell_degrees;
+  int first_band = cell_of(south + 90, cell, index->bands);
+  int last_band = cell_of(north + 90, cell, index->bands);
+
+  // A cap clear of the poles spans asin(sin(angle) / cos(y)) of longitude
+  // either side of x, one around a pole all of them.
+  int columns = index->columns;
+  double west_cell = 0;
+  double east_cell = columns;
+  if (south > -90 && north < 90) {
+    double ratio = sin(angle) / cos(y * HARVESTINE_DEGREES_TO_RADIANS);
+    if (ratio < 1) {
+      double half_width =
+          asin(ratio) / HARVESTINE_DEGREES_TO_RADIANS + MARGIN_DEGREES;
+      west_cell = floor((x - half_width + 180) / cell);
+      east_cell = floor((x + half_width + 180) / cell);
+    }
+  }
+  // Columns [west, east], which wrap around past either end.
+  bool all = east_cell - west_cell + 1 >= columns;
+  int west = all ? 0 : (int)west_cell;
+  int east = all ? columns - 1 : (int)east_cell;
+
+  for (int band = first_band; band <= last_band; band++) {
+    const int *starts = index->cell_starts + (size_t)band * columns;
+    bool ok;
+    if (west < 0) {
+      ok = refine(index, point, starts[west + columns], starts[columns],
+                  radius, matches) &&
+           refine(index, point, starts[0], starts[east + 1], radius,
+                  matches);
+    } else if (east >= columns) {
+      ok = refine(index, point, starts[west], starts[columns], radius,
+                  matches) &&
+           refine(index, point, starts[0], starts[east - columns + 1],
+                  radius, matches);
+    } else {
+      ok = refine(index, point, starts[west], starts[east + 1], radius,
+                  matches);
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool spatial_index_within(const spatial_index_t *index, double x, double y,
+                          double radius, spatial_matches_t *matches) {
+  haversine_point_t point = haversine_point_prepare(x, y);
+  matches->count = 0;
+  if (!collect(index, &point, x, y, radius, matches)) {
+    return false;
+  }
+  sort_matches(matches);
+  return true;
+}
+
+// spatial_index_nearest() with the candidates in scratch, which is reused
+// across queries.
+static bool find_nearest(const spatial_index_t *index, double x, double y,
+                         int k, spatial_matches_t *scratch,
+                         spatial_match_t *matches, int *found) {
+  int count = index->points.count;
+  k = k < count ? k : count;
+  *found = k;
+  if (k <= 0) {
+    return true;
+  }
+
+  // The cap around k evenly spread points, 1 - cos(angle) = 2 k / count
+  // of the sphere, to start with.
+  haversine_point_t point = haversine_point_prepare(x, y);
+  double angle = acos(fmax(-1, 1 - 2.0 * k / count));
+  double radius = angle * index->earth_radius;
+  for (;;) {
+    if (radius >= M_PI * index->earth_radius) {
+      radius = INFINITY;
+    }
+    scratch->count = 0;
+    if (!collect(index, &point, x, y, radius, scratch)) {
+      return false;
+    }
+    if (scratch->count >= k) {
+      break;
+    }
+    radius *= 2;
+  }
+  sort_matches(scratch);
+  memcpy(matches, scratch->matches, k * sizeof(spatial_match_t));
+  return true;
+}
+
+bool spatial_index_nearest(const spatial_index_t *index, double x, double y,
+                           int k, spatial_match_t *matches, int *found) {
+  spatial_matches_t scratch;
+  spatial_matches_init(&scratch);
+  bool ok = find_nearest(index, x, y, k, &scratch, matches, found);
+  spatial_matches_free(&scratch);
+  return ok;
+}
+
+// The queries [first, end) of one thread. results is set for radius
+// queries, matches and found for nearest neighbours.
+typedef struct {
+  _Alignas(64) const spatial_index_t *index;
+  const double *x;
+  const double *y;
+  int first;
+  int end;
+  double radius;
+  spatial_matches_t *results;
+  int k;
+  spatial_match_t *matches;
+  int *found;
+  bool ok;
+} share_t;
+
+static void *run_share(void *arg) {
+  share_t *share = (share_t *)arg;
+  share->ok = true;
+  if (share->results != NULL) {
+    for (int i = share->first; i < share->end && share->ok; i++) {
+      share->ok = spatial_index_within(share->index, share->x[i], share->y[i],
+                                       share->radius, &share->results[i]);
+    }
+    return NULL;
+  }
+  spatial_matches_t scratch;
+  spatial_matches_init(&scratch);
+  for (int i = share->first; i < share->end && share->ok; i++) {
+    share->ok = find_nearest(share->index, share->x[i], share->y[i],
+                             share->k, &scratch,
+                             share->matches + (size_t)i * share->k,
+                             &share->found[i]);
+  }
+  spatial_matches_free(&scratch);
+  return NULL;
+}
+
+// Splits the n queries of share into threads contiguous runs and runs them.
+static bool run_shares(const share_t *share, int n, int threads) {
+  assert(1 <= threads && threads <= PARALLEL_MAX_THREADS);
+  share_t shares[PARALLEL_MAX_THREADS];
+  for (int t = 0; t < threads; t++) {
+    shares[t] = *share;
+    shares[t].first = parallel_split(n, threads, t);
+    shares[t].end = parallel_split(n, threads, t + 1);
+  }
+  run_parallel(shares, sizeof(share_t), threads, run_share);
+
+  bool ok = true;
+  for (int t = 0; t < threads; t++) {
+    ok = ok && shares[t].ok;
+  }
+  return ok;
+}
+
+bool spatial_index_within_batch(const spatial_index_t *index,
+                                const double *x, const double *y, int n,
+                                double radius, int threads,
+                                spatial_matches_t *results) {
+  share_t share = {
+      .index = index,
+      .x = x,
+      .y = y,
+      .radius = radius,
+      .results = results,
+  };
+  return run_shares(&share, n, threads);
+}
+
+bool spatial_index_nearest_batch(const spatial_index_t *index,
+                                 const double *x, const double *y, int n,
+                                 int k, int threads, spatial_match_t *matches,
+                                 int *found) {
+  share_t share = {
+      .index = index,
+      .x = x,
+      .y = y,
+      .k = k,
+      .matches = matches,
+      .found = found,
+  };
+  return run_shares(&share, n, threads);
+}
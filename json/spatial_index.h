@@ -0,0 +1,98 @@
+#ifndef SPATIAL_INDEX_H_
+#define SPATIAL_INDEX_H_
+
+// Radius ("every point within r km of here") and nearest neighbour ("the k
+// points nearest to here") queries over a fixed set of points.
+//
+// The points are bucketed in a grid of latitude bands, each cut into cells
+// of the same width in longitude, and sorted by cell, so that the cells of
+// a band are next to each other. The points within r of a query are in a
+// band of latitudes and, away from the poles, a range of longitudes, the
+// two of them bounding the spherical cap. That is one contiguous run of
+// points per band, two across the antimeridian, and only those go through
+// the row kernel of haversine_kernels for their exact distances. The points
+// are prepared like for distance_matrix(), so that the distances are the
+// same as its.
+//
+// Nearest neighbour queries are radius queries, starting from the radius
+// that would hold k points if they were spread evenly and doubling it
+// until it holds k. The k nearest of them are then the k nearest of all.
+
+#include <stdbool.h>
+
+#include "distance_matrix.h"
+
+// Points per cell the grid is sized for.
+#define SPATIAL_INDEX_POINTS_PER_CELL 8
+#define SPATIAL_INDEX_MAX_BANDS 4096
+
+typedef struct {
+  // Sorted by cell, see ids for where they came from.
+  haversine_points_t points;
+  // The index of every point of points in the arrays it was built from.
+  int *ids;
+  // The points of cell c are [cell_starts[c], cell_starts[c + 1]), the cells
+  // of band b [b * columns, (b + 1) * columns), band 0 the southernmost.
+  int *cell_starts;
+  int bands;
+  int columns;
+  // Of a cell, in latitude and longitude.
+  double cell_degrees;
+  double earth_radius;
+} spatial_index_t;
+
+typedef struct {
+  // Index of the point in the arrays the index was built from.
+  int point;
+  double distance;
+} spatial_match_t;
+
+// A growing array of matches.
+typedef struct {
+  spatial_match_t *matches;
+  int count;
+  int capacity;
+} spatial_matches_t;
+
+// Indexes count points given in degrees, x the longitude and y the
+// latitude, in range as for haversine_points_init(). Returns false if out
+// of memory.
+bool spatial_index_init(spatial_index_t *index, const double *x,
+                        const double *y, int count, double earth_radius);
+void spatial_index_free(spatial_index_t *index);
+
+static inline void spatial_matches_init(spatial_matches_t *matches) {
+  matches->matches = NULL;
+  matches->count = 0;
+  matches->capacity = 0;
+}
+void spatial_matches_free(spatial_matches_t *matches);
+
+// Replaces matches with the points within radius of (x, y), nearest first
+// and the lowest point first among equally near ones. Returns false if out
+// of memory.
+bool spatial_index_within(const spatial_index_t *index, double x, double y,
+                          double radius, spatial_matches_t *matches);
+
+// Stores the k nearest points to (x, y), nearest first as above, in
+// matches[0, *found), *found = k unless there are fewer points. Returns
+// false if out of memory.
+bool spatial_index_nearest(const spatial_index_t *index, double x, double y,
+                           int k, spatial_match_t *matches, int *found);
+
+// spatial_index_within() for the n queries (x[i], y[i]) into results[i],
+// which have to be initialized, split across threads, 1 to
+// PARALLEL_MAX_THREADS.
+bool spatial_index_within_batch(const spatial_index_t *index,
+                                const double *x, const double *y, int n,
+                                double radius, int threads,
+                                spatial_matches_t *results);
+
+// spatial_index_nearest() for the n queries (x[i], y[i]) into
+// matches[i * k, (i + 1) * k) and found[i], split across threads.
+bool spatial_index_nearest_batch(const spatial_index_t *index,
+                                 const double *x, const double *y, int n,
+                                 int k, int threads, spatial_match_t *matches,
+                                 int *found);
+
+#endif // SPATIAL_INDEX_H_
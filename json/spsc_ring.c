@@ -0,0 +1,93 @@
+#include "spsc_ring.h"
+
+#include <sched.h>
+#include <stdlib.h>
+
+#define SPSC_RING_ALIGNMENT 64
+
+// Spins before falling back to sched_yield(). Short enough not to matter
+// when the other side is descheduled, long enough to catch a hand-off that
+// is a few hundred nanoseconds away.
+#define SPSC_RING_SPINS 256
+
+bool spsc_ring_init(spsc_ring_t *ring, size_t capacity, size_t slot_size) {
+  size_t pow2 = 1;
+  while (pow2 < capacity) {
+    pow2 *= 2;
+  }
+  slot_size = (slot_size + SPSC_RING_ALIGNMENT - 1) / SPSC_RING_ALIGNMENT *
+              SPSC_RING_ALIGNMENT;
+
+  ring->slots = aligned_alloc(SPSC_RING_ALIGNMENT, pow2 * slot_size);
+  if (ring->slots == NULL) {
+    return false;
+  }
+  ring->slot_size = slot_size;
+  ring->capacity = pow2;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->closed, false);
+  return true;
+}
+
+void spsc_ring_free(spsc_ring_t *ring) {
+  free(ring->slots);
+  ring->slots = NULL;
+}
+
+static void relax(int *spins) {
+  if (*spins < SPSC_RING_SPINS) {
+    (*spins)++;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  } else {
+    sched_yield();
+  }
+}
+
+static void *slot(const spsc_ring_t *ring, size_t n) {
+  return ring->slots + (n & (ring->capacity - 1)) * ring->slot_size;
+}
+
+void *spsc_ring_begin_push(spsc_ring_t *ring) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  int spins = 0;
+  // Acquire, so that the consumer is done reading the slot before it is
+  // overwritten.
+  while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) ==
+         ring->capacity) {
+    relax(&spins);
+  }
+  return slot(ring, head);
+}
+
+void spsc_ring_end_push(spsc_ring_t *ring) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void spsc_ring_close(spsc_ring_t *ring) {
+  atomic_store_explicit(&ring->closed, true, memory_order_release);
+}
+
+void *spsc_ring_begin_pop(spsc_ring_t *ring) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  int spins = 0;
+  while (atomic_load_explicit(&ring->head, memory_order_acquire) == tail) {
+    if (atomic_load_explicit(&ring->closed, memory_order_acquire)) {
+      // The producer may have published its last slot right before closing.
+      if (atomic_load_explicit(&ring->head, memory_order_acquire) == tail) {
+        return NULL;
+      }
+      break;
+    }
+    relax(&spins);
+  }
+  return slot(ring, tail);
+}
+
+void spsc_ring_end_pop(spsc_ring_t *ring) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
@@ -0,0 +1,50 @@
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+// A bounded queue between exactly one producer thread and one consumer
+// thread. Slots are fixed size and aligned to a cache line, and are filled
+// and drained in place: the producer asks for the next free slot, writes it
+// and publishes it, the consumer asks for the next full one, reads it and
+// releases it. No locks, just the two counters below.
+//
+// A full ring makes the producer wait and an empty one the consumer, which
+// is what keeps every stage of a pipeline within its share of the memory.
+// Waiting spins for a while and then yields, so it works on a single core
+// as well.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+  // Slots ever published, written by the producer only.
+  _Alignas(64) atomic_size_t head;
+  // Slots ever released, written by the consumer only.
+  _Alignas(64) atomic_size_t tail;
+  // Set by the producer after its last slot.
+  atomic_bool closed;
+
+  _Alignas(64) char *slots;
+  size_t slot_size; // rounded up to the alignment
+  size_t capacity;  // a power of two
+} spsc_ring_t;
+
+// Allocates capacity slots of slot_size bytes each. capacity is rounded up
+// to a power of two. Returns false if out of memory.
+bool spsc_ring_init(spsc_ring_t *ring, size_t capacity, size_t slot_size);
+void spsc_ring_free(spsc_ring_t *ring);
+
+// Producer side. Waits for a free slot and returns it.
+void *spsc_ring_begin_push(spsc_ring_t *ring);
+// Publishes the slot returned by spsc_ring_begin_push().
+void spsc_ring_end_push(spsc_ring_t *ring);
+// No more slots are coming.
+void spsc_ring_close(spsc_ring_t *ring);
+
+// Consumer side. Waits for a full slot and returns it, or NULL once the ring
+// is closed and everything has been consumed.
+void *spsc_ring_begin_pop(spsc_ring_t *ring);
+// Releases the slot returned by spsc_ring_begin_pop() to the producer.
+void spsc_ring_end_pop(spsc_ring_t *ring);
+
+#endif // SPSC_RING_H_
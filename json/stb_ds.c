@@ -1,2 +1,4 @@
+#include "json_alloc.h"
+
 #define STB_DS_IMPLEMENTATION
 #include "stb_ds.h"
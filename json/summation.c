@@ -0,0 +1,66 @@
+#include "summation.h"
+
+#include <assert.h>
+#include <stdbool.h>
+
+// Below this many values the sum is plain left to right.
+#define PAIRWISE_BASE 8
+
+double pairwise_sum(const double *values, size_t n) {
+  if (n <= PAIRWISE_BASE) {
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+      sum += values[i];
+    }
+    return sum;
+  }
+  size_t half = n / 2;
+  return pairwise_sum(values, half) + pairwise_sum(values + half, n - half);
+}
+
+void summation_tree_init(summation_tree_t *tree) { tree->len = 0; }
+
+// Pushes a node and folds it into its left sibling for as long as that is
+// the node right before it.
+static void push_node(summation_tree_t *tree, summation_node_t node) {
+  while (tree->len > 0) {
+    summation_node_t *top = &tree->nodes[tree->len - 1];
+    bool is_sibling = top->level == node.level && top->index % 2 == 0 &&
+                      top->index + 1 == node.index;
+    if (!is_sibling) {
+      break;
+    }
+    node = (summation_node_t){
+        .value = top->value + node.value,
+        .level = node.level + 1,
+        .index = top->index / 2,
+    };
+    tree->len--;
+  }
+  assert(tree->len < SUMMATION_MAX_NODES);
+  tree->nodes[tree->len++] = node;
+}
+
+void summation_tree_add(summation_tree_t *tree, uint32_t block, double sum) {
+  push_node(tree, (summation_node_t){.value = sum, .level = 0, .index = block});
+}
+
+void summation_tree_append(summation_tree_t *tree,
+                           const summation_tree_t *src) {
+  for (int i = 0; i < src->len; i++) {
+    push_node(tree, src->nodes[i]);
+  }
+}
+
+double summation_tree_total(const summation_tree_t *tree) {
+  // Once every sibling pair is merged, what's left are the subtrees along
+  // the right edge, each of them next to zero padding.
+  if (tree->len == 0) {
+    return 0;
+  }
+  double total = tree->nodes[tree->len - 1].value;
+  for (int i = tree->len - 2; i >= 0; i--) {
+    total = tree->nodes[i].value + total;
+  }
+  return total;
+}
@@ -0,0 +1,59 @@
+#ifndef SUMMATION_H_
+#define SUMMATION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+  // Whatever order is fastest: SIMD lanes and threads each keep their own
+  // running sum. The result changes with the ISA and the thread count.
+  SUMMATION_FAST,
+  // Fixed blocks reduced by pairwise_sum(), then the block sums reduced by a
+  // summation_tree_t. The result only depends on the values, not on how the
+  // work was split, so runs on different machines can be compared bit for
+  // bit. That relies on the compiler adding and multiplying exactly as
+  // written, which the Makefile makes sure of with -ffp-contract=off.
+  SUMMATION_DETERMINISTIC,
+} summation_t;
+
+// Values per block in SUMMATION_DETERMINISTIC mode. Work has to be split at
+// multiples of this for the result to stay the same.
+#define SUMMATION_BLOCK 256
+
+// Sum of values[0, n), adding halves recursively. The tree only depends on
+// n, and the error grows with log(n) rather than n.
+double pairwise_sum(const double *values, size_t n);
+
+// Pairwise sum of a sequence of block sums that arrives in pieces, by thread
+// or by chunk of input. The blocks are the leaves of a fixed binary tree over
+// their numbers, padded with zeros to a power of two, and every inner node is
+// left + right. Adding zeros is exact, so the total is the same however the
+// sequence was cut up, as long as the pieces are put together in order.
+//
+// Only the nodes that are still missing a sibling are kept, at most two per
+// level, so a tree takes a fixed 1 KB and never allocates. Block numbers
+// have to fit into 32 bits.
+typedef struct {
+  double value;
+  uint32_t level;
+  uint32_t index; // among the nodes of the same level
+} summation_node_t;
+
+#define SUMMATION_MAX_NODES 64
+
+typedef struct {
+  summation_node_t nodes[SUMMATION_MAX_NODES];
+  int len;
+} summation_tree_t;
+
+void summation_tree_init(summation_tree_t *tree);
+// Adds the sum of block number `block`. Blocks have to be added in order,
+// without gaps, starting anywhere.
+void summation_tree_add(summation_tree_t *tree, uint32_t block, double sum);
+// Appends the blocks of src, which have to follow the ones already in tree.
+void summation_tree_append(summation_tree_t *tree,
+                           const summation_tree_t *src);
+// Sum of all the blocks, once the tree holds every one of them from block 0.
+double summation_tree_total(const summation_tree_t *tree);
+
+#endif // SUMMATION_H_
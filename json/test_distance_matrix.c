@@ -0,0 +1,164 @@
+#include "distance_matrix.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_helpers.h"
+
+#ifdef NDEBUG
+#error "Distance matrix tests need assertions"
+#endif
+
+// Past a tile of columns, with a partial vector at the end, and past a
+// tile of rows.
+#define ROWS 83
+#define COLUMNS (DISTANCE_MATRIX_TILE_COLUMNS * 2 + 13)
+#define STRIDE (COLUMNS + 3)
+
+// The differences of the half angles are taken from their sines and
+// cosines, which costs about an ulp of 1 rather than of the difference,
+// see harvestine.h.
+#define MAX_RELATIVE_ERROR 1e-14
+#define MAX_ABSOLUTE_ERROR 1e-11
+#define MAX_ANTIPODAL_ERROR 1e-4
+#define ANTIPODAL_DISTANCE (M_PI * REFERENCE_EARTH_RADIUS - 1000)
+
+static double row_x[ROWS], row_y[ROWS];
+static double column_x[COLUMNS], column_y[COLUMNS];
+static double matrix[ROWS * STRIDE];
+static double expected[ROWS * STRIDE];
+
+static bool close_enough(double actual, double expected) {
+  if (expected > ANTIPODAL_DISTANCE) {
+    return fabs(actual - expected) <= MAX_ANTIPODAL_ERROR;
+  }
+  return fabs(actual - expected) <=
+         MAX_RELATIVE_ERROR * expected + MAX_ABSOLUTE_ERROR;
+}
+
+// Random points, a few of them close together, and column 700 the same
+// as column 100 and as row 5, for a tie.
+static void random_points(void) {
+  srand(49);
+  for (int i = 0; i < ROWS; i++) {
+    row_x[i] = random_in(-180, 180);
+    row_y[i] = random_in(-90, 90);
+  }
+  for (int j = 0; j < COLUMNS; j++) {
+    column_x[j] = random_in(-180, 180);
+    column_y[j] = random_in(-90, 90);
+  }
+  for (int j = 0; j < 10; j++) {
+    column_x[900 + j] = row_x[10] + random_in(-1e-3, 1e-3);
+    column_y[900 + j] = row_y[10] + random_in(-1e-3, 1e-3);
+  }
+  column_x[100] = column_x[700] = row_x[5];
+  column_y[100] = column_y[700] = row_y[5];
+
+  for (int i = 0; i < ROWS; i++) {
+    for (int j = 0; j < COLUMNS; j++) {
+      expected[i * STRIDE + j] =
+          reference_haversine(row_x[i], row_y[i], column_x[j], column_y[j],
+                              REFERENCE_EARTH_RADIUS);
+    }
+  }
+}
+
+static void test_tier(const haversine_kernels_t *kernels) {
+  if (!isa_supported(kernels->isa)) {
+    return;
+  }
+  haversine_kernels_t saved = haversine_kernels;
+  haversine_kernels = *kernels;
+
+  haversine_points_t rows, columns;
+  assert(haversine_points_init(&rows, row_x, row_y, ROWS));
+  assert(haversine_points_init(&columns, column_x, column_y, COLUMNS));
+
+  static int nearest[ROWS];
+  static double distance[ROWS];
+  static double first_matrix[ROWS * STRIDE];
+  for (int threads = 1; threads <= 5; threads++) {
+    for (int i = 0; i < ROWS * STRIDE; i++) {
+      matrix[i] = -1;
+    }
+    distance_matrix(&rows, &columns, threads, REFERENCE_EARTH_RADIUS, matrix,
+                    STRIDE);
+    for (int i = 0; i < ROWS; i++) {
+      for (int j = 0; j < COLUMNS; j++) {
+        assert(close_enough(matrix[i * STRIDE + j], expected[i * STRIDE + j]));
+      }
+      // Past the columns, up to the stride.
+      for (int j = COLUMNS; j < STRIDE; j++) {
+        assert(matrix[i * STRIDE + j] == -1);
+      }
+    }
+    if (threads == 1) {
+      memcpy(first_matrix, matrix, sizeof(matrix));
+    }
+    assert(memcmp(matrix, first_matrix, sizeof(matrix)) == 0);
+
+    // The same as the first minimum of every row of the matrix, which is
+    // computed the same way. Distances can be equal where their a isn't,
+    // so the index is only checked to point at the minimum.
+    distance_matrix_nearest(&rows, &columns, threads, REFERENCE_EARTH_RADIUS,
+                            nearest, distance);
+    for (int i = 0; i < ROWS; i++) {
+      double min = INFINITY;
+      for (int j = 0; j < COLUMNS; j++) {
+        min = fmin(min, matrix[i * STRIDE + j]);
+      }
+      assert(distance[i] == min);
+      assert(0 <= nearest[i] && nearest[i] < COLUMNS);
+      assert(matrix[i * STRIDE + nearest[i]] == min);
+    }
+    // Not exactly 0: the fused difference of products keeps the rounding
+    // error of the other product.
+    assert(nearest[5] == 100 && distance[5] < MAX_ABSOLUTE_ERROR);
+    assert(nearest[10] >= 900 && nearest[10] < 910);
+  }
+
+  haversine_points_free(&rows);
+  haversine_points_free(&columns);
+  haversine_kernels = saved;
+}
+
+// No rows is nothing to do, and a single column is everyone's nearest.
+static void test_edges(void) {
+  haversine_points_t rows, columns;
+  assert(haversine_points_init(&rows, row_x, row_y, 0));
+  assert(haversine_points_init(&columns, column_x, column_y, 1));
+  int nearest[ROWS];
+  double distance[ROWS];
+  distance_matrix_nearest(&rows, &columns, 3, REFERENCE_EARTH_RADIUS, nearest,
+                          distance);
+  distance_matrix(&rows, &columns, 3, REFERENCE_EARTH_RADIUS, matrix, 1);
+  haversine_points_free(&rows);
+
+  assert(haversine_points_init(&rows, row_x, row_y, ROWS));
+  distance_matrix_nearest(&rows, &columns, 4, REFERENCE_EARTH_RADIUS, nearest,
+                          distance);
+  for (int i = 0; i < ROWS; i++) {
+    assert(nearest[i] == 0);
+    assert(close_enough(distance[i], expected[i * STRIDE]));
+  }
+  haversine_points_free(&rows);
+  haversine_points_free(&columns);
+}
+
+int main(void) {
+  random_points();
+  test_tier(&haversine_kernels_libm);
+  test_tier(&haversine_kernels_scalar);
+#if defined(__x86_64__) || defined(__i386__)
+  test_tier(&haversine_kernels_avx2);
+  test_tier(&haversine_kernels_avx512);
+#endif
+  test_edges();
+  printf("all tests passed\n");
+  return 0;
+}
@@ -0,0 +1,216 @@
+#include "distance_stats.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pairs.h"
+#include "test_helpers.h"
+
+#ifdef NDEBUG
+#error "Distance stats tests need assertions"
+#endif
+
+#define COUNT 200000
+
+static double values[COUNT];
+static double sorted[COUNT];
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Skewed like distances, with most of them large and a tail of short ones.
+static void random_values(void) {
+  srand(47);
+  for (int i = 0; i < COUNT; i++) {
+    values[i] = 20000 * sqrt(random_in(0, 1));
+  }
+  memcpy(sorted, values, sizeof(values));
+  qsort(sorted, COUNT, sizeof(double), compare_doubles);
+}
+
+// Adds values[first, end) in blocks, the way the computation does.
+static void add_range(distance_stats_t *stats, int first, int end) {
+  for (int i = first; i < end; i += SUMMATION_BLOCK) {
+    int n = end - i < SUMMATION_BLOCK ? end - i : SUMMATION_BLOCK;
+    distance_stats_add(stats, values + i, n);
+  }
+}
+
+// The fraction of the values at or below value.
+static double rank_of(double value) {
+  int lo = 0;
+  int hi = COUNT;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (sorted[mid] <= value) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return (double)lo / COUNT;
+}
+
+static void check_stats(const distance_stats_t *stats) {
+  double sum = 0;
+  for (int i = 0; i < COUNT; i++) {
+    sum += values[i];
+  }
+  double mean = sum / COUNT;
+  double m2 = 0;
+  for (int i = 0; i < COUNT; i++) {
+    m2 += (values[i] - mean) * (values[i] - mean);
+  }
+
+  assert(stats->count == COUNT);
+  assert(stats->min == sorted[0]);
+  assert(stats->max == sorted[COUNT - 1]);
+  assert(fabs(stats->mean - mean) < 1e-9 * mean);
+  assert(fabs(distance_stats_variance(stats) - m2 / COUNT) <
+         1e-9 * m2 / COUNT);
+
+  // Every value in the bin its bounds say.
+  uint64_t histogram[DISTANCE_STATS_BINS] = {0};
+  for (int i = 0, bin = 0; i < COUNT; i++) {
+    while (sorted[i] >= distance_stats_bin_bound(bin + 1)) {
+      bin++;
+    }
+    histogram[bin]++;
+  }
+  assert(memcmp(histogram, stats->histogram, sizeof(histogram)) == 0);
+
+  const double fractions[] = {0, 0.01, 0.1, 0.5, 0.9, 0.99, 0.999, 1};
+  const int n = sizeof(fractions) / sizeof(fractions[0]);
+  double quantiles[sizeof(fractions) / sizeof(fractions[0])];
+  bool ok = distance_stats_quantiles(stats, fractions, n, quantiles);
+  assert(ok);
+  for (int q = 0; q < n; q++) {
+    assert(quantiles[q] >= stats->min && quantiles[q] <= stats->max);
+    assert(fabs(rank_of(quantiles[q]) - fractions[q]) <
+           2.0 / DISTANCE_STATS_SKETCH_K);
+  }
+}
+
+static void test_single(void) {
+  distance_stats_t *stats = malloc(sizeof(distance_stats_t));
+  assert(stats != NULL);
+  distance_stats_init(stats);
+  add_range(stats, 0, COUNT);
+  check_stats(stats);
+  free(stats);
+}
+
+// Shares merged together are as good as one, whatever the split.
+static void test_merge(void) {
+  distance_stats_t *stats = malloc(5 * sizeof(distance_stats_t));
+  assert(stats != NULL);
+  const int splits[][4] = {
+      {0, COUNT / 4, COUNT / 2, 3 * COUNT / 4},
+      {0, 1, 2, COUNT - 1},
+      {0, 1000, 1000, 1000},
+  };
+  for (size_t s = 0; s < sizeof(splits) / sizeof(splits[0]); s++) {
+    for (int t = 0; t < 4; t++) {
+      distance_stats_init(&stats[t]);
+      add_range(&stats[t], splits[s][t], t < 3 ? splits[s][t + 1] : COUNT);
+    }
+    distance_stats_init(&stats[4]);
+    for (int t = 0; t < 4; t++) {
+      distance_stats_merge(&stats[4], &stats[t]);
+    }
+    check_stats(&stats[4]);
+  }
+  free(stats);
+}
+
+static void test_edge_cases(void) {
+  distance_stats_t *stats = malloc(sizeof(distance_stats_t));
+  assert(stats != NULL);
+  distance_stats_init(stats);
+
+  double quantile;
+  double half = 0.5;
+  assert(distance_stats_quantiles(stats, &half, 1, &quantile));
+  assert(isnan(quantile));
+  assert(distance_stats_variance(stats) == 0);
+
+  // NaNs are counted and left out of everything else.
+  const double some[] = {NAN, 3, NAN, 0, 1e-9, INFINITY};
+  distance_stats_add(stats, some, 2);
+  distance_stats_add(stats, some + 2, 2);
+  assert(stats->count == 2 && stats->nans == 2);
+  assert(stats->min == 0 && stats->max == 3);
+  assert(stats->mean == 1.5 && distance_stats_variance(stats) == 2.25);
+  distance_stats_add(stats, some + 4, 2);
+  assert(stats->histogram[0] == 2);
+  assert(stats->histogram[DISTANCE_STATS_BINS - 1] == 1);
+
+  assert(distance_stats_bin_bound(0) == 0);
+  assert(distance_stats_bin_bound(1) ==
+         ldexp(1, DISTANCE_STATS_MIN_EXPONENT));
+  assert(distance_stats_bin_bound(DISTANCE_STATS_BINS - 1) ==
+         ldexp(1, DISTANCE_STATS_MAX_EXPONENT));
+  assert(isinf(distance_stats_bin_bound(DISTANCE_STATS_BINS)));
+  free(stats);
+}
+
+// Gathering statistics doesn't change the average, and any number of
+// threads gathers the same histogram.
+static void test_average(void) {
+  const int count = 30011;
+  pairs_t pairs;
+  srand(7);
+  random_pairs(&pairs, count);
+  double expected = average_harvestine(&pairs, 1, SUMMATION_DETERMINISTIC);
+
+  distance_stats_t *stats = malloc(2 * sizeof(distance_stats_t));
+  assert(stats != NULL);
+  distance_stats_init(&stats[0]);
+  double average;
+  pairs_outputs_t outputs = {&stats[0], NULL};
+  bool ok = average_harvestine_into(&pairs, 1, SUMMATION_DETERMINISTIC,
+                                    &average, &outputs);
+  assert(ok);
+  assert(memcmp(&average, &expected, sizeof(double)) == 0);
+  assert(stats[0].count == (uint64_t)count);
+  assert(fabs(stats[0].mean - expected) < 1e-9 * expected);
+
+  for (int threads = 1; threads <= 9; threads++) {
+    outputs.stats = &stats[1];
+    distance_stats_init(&stats[1]);
+    ok = average_harvestine_into(&pairs, threads, SUMMATION_DETERMINISTIC,
+                                 &average, &outputs);
+    assert(ok);
+    assert(memcmp(&average, &expected, sizeof(double)) == 0);
+    assert(stats[1].count == (uint64_t)count);
+    assert(stats[1].min == stats[0].min && stats[1].max == stats[0].max);
+    assert(memcmp(stats[1].histogram, stats[0].histogram,
+                  sizeof(stats[0].histogram)) == 0);
+
+    distance_stats_init(&stats[1]);
+    ok = average_harvestine_into(&pairs, threads, SUMMATION_FAST, &average,
+                                 &outputs);
+    assert(ok);
+    assert(fabs(average - expected) < 1e-9);
+    assert(stats[1].count == (uint64_t)count);
+  }
+
+  free(stats);
+  pairs_free(&pairs);
+}
+
+int main(void) {
+  random_values();
+  test_single();
+  test_merge();
+  test_edge_cases();
+  test_average();
+  printf("all tests passed\n");
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include "file_reader.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+
+#ifdef NDEBUG
+#error "File reader tests need assertions"
+#endif
+
+static void write_bytes(const char *filename, const char *data, size_t len) {
+  FILE *file = fopen(filename, "wb");
+  assert(file != NULL);
+  assert(fwrite(data, 1, len, file) == len);
+  fclose(file);
+}
+
+// The pieces put together are the file, for files smaller than a buffer,
+// exactly a few buffers long and in between, and however many buffers there
+// are to go round.
+static void test_contents(void) {
+  char filename[] = "/tmp/test_file_reader_XXXXXX";
+  temp_filename(filename);
+
+  const size_t size = 5 * FILE_READER_ALIGNMENT;
+  char *data = malloc(size);
+  char *copy = malloc(size);
+  for (size_t i = 0; i < size; i++) {
+    data[i] = (char)(i * 31 + i / 4099);
+  }
+
+  const size_t sizes[] = {0, 1, FILE_READER_ALIGNMENT - 1,
+                          FILE_READER_ALIGNMENT, 2 * FILE_READER_ALIGNMENT,
+                          size - 7, size};
+  const size_t buffer_sizes[] = {1, FILE_READER_ALIGNMENT,
+                                 3 * FILE_READER_ALIGNMENT};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    write_bytes(filename, data, sizes[s]);
+    for (size_t b = 0; b < sizeof(buffer_sizes) / sizeof(buffer_sizes[0]);
+         b++) {
+      for (int count = 1; count <= 5; count += 2) {
+        file_reader_t reader;
+        assert(file_reader_open(&reader, filename, buffer_sizes[b], count));
+        assert(reader.buffer_size % FILE_READER_ALIGNMENT == 0);
+        assert(reader.buffer_count >= 2);
+
+        size_t total = 0;
+        const char *piece;
+        size_t len;
+        while ((piece = file_reader_next(&reader, &len)) != NULL) {
+          assert(len > 0 && len <= reader.buffer_size);
+          assert((uintptr_t)piece % FILE_READER_ALIGNMENT == 0);
+          assert(total + len <= sizes[s]);
+          memcpy(copy + total, piece, len);
+          total += len;
+          file_reader_release(&reader);
+        }
+        assert(total == sizes[s]);
+        assert(memcmp(copy, data, total) == 0);
+        assert(reader.len == sizes[s]);
+        assert(file_reader_close(&reader));
+      }
+    }
+  }
+
+  unlink(filename);
+  free(copy);
+  free(data);
+}
+
+// Closing before the end stops the thread even while it waits for a buffer.
+static void test_close_early(void) {
+  char filename[] = "/tmp/test_file_reader_XXXXXX";
+  temp_filename(filename);
+
+  const size_t size = 64 * FILE_READER_ALIGNMENT;
+  char *data = calloc(size, 1);
+  write_bytes(filename, data, size);
+
+  for (int pieces = 0; pieces < 3; pieces++) {
+    file_reader_t reader;
+    assert(file_reader_open(&reader, filename, FILE_READER_ALIGNMENT, 2));
+    for (int i = 0; i < pieces; i++) {
+      size_t len;
+      assert(file_reader_next(&reader, &len) != NULL);
+      file_reader_release(&reader);
+    }
+    assert(file_reader_close(&reader));
+  }
+
+  unlink(filename);
+  free(data);
+}
+
+static void test_missing(void) {
+  file_reader_t reader;
+  assert(!file_reader_open(&reader, "/nonexistent/test_file_reader",
+                           FILE_READER_DEFAULT_BUFFER,
+                           FILE_READER_DEFAULT_BUFFERS));
+  assert(errno == ENOENT);
+}
+
+// A directory opens fine but can't be read.
+static void test_read_error(void) {
+  file_reader_t reader;
+  assert(file_reader_open(&reader, "/tmp", FILE_READER_ALIGNMENT, 2));
+  size_t len;
+  assert(file_reader_next(&reader, &len) == NULL);
+  assert(!file_reader_close(&reader));
+  assert(errno == EISDIR);
+}
+
+int main(void) {
+  test_contents();
+  test_close_early();
+  test_missing();
+  test_read_error();
+  printf("all tests passed\n");
+  return 0;
+}
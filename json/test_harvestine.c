@@ -0,0 +1,264 @@
+#include "harvestine.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_helpers.h"
+
+#ifdef NDEBUG
+#error "Haversine tests need assertions"
+#endif
+
+#define COUNT 1000
+
+// Documented bounds for the vector tiers, see harvestine.h.
+#define MAX_RELATIVE_ERROR 1e-14
+#define MAX_ANTIPODAL_ERROR 1e-4
+// Distances beyond this are within 1000 km of the antipode.
+#define ANTIPODAL_DISTANCE (M_PI * REFERENCE_EARTH_RADIUS - 1000)
+
+static bool close_enough(double actual, double expected) {
+  if (expected > ANTIPODAL_DISTANCE) {
+    return fabs(actual - expected) <= MAX_ANTIPODAL_ERROR;
+  }
+  return fabs(actual - expected) <= MAX_RELATIVE_ERROR * expected;
+}
+
+static void test_tier(const haversine_kernels_t *kernels) {
+  if (!isa_supported(kernels->isa)) {
+    printf("skipping %s, not supported by this CPU\n", kernels->name);
+    return;
+  }
+
+  static double x0[COUNT], y0[COUNT], x1[COUNT], y1[COUNT];
+  static double expected[COUNT], out[COUNT + 1];
+
+  srand(42);
+  for (int i = 0; i < COUNT; i++) {
+    x0[i] = random_in(-180, 180);
+    y0[i] = random_in(-90, 90);
+    x1[i] = random_in(-180, 180);
+    y1[i] = random_in(-90, 90);
+  }
+  // The edges of the domain and a few tiny distances.
+  x0[0] = -180, y0[0] = -90, x1[0] = 180, y1[0] = 90;
+  x0[1] = 0, y0[1] = 0, x1[1] = 0, y1[1] = 0;
+  x0[2] = 10, y0[2] = 20, x1[2] = 10 + 1e-9, y1[2] = 20;
+  x0[3] = -180, y0[3] = 0, x1[3] = 180, y1[3] = 0;
+
+  for (int i = 0; i < COUNT; i++) {
+    expected[i] = reference_haversine(x0[i], y0[i], x1[i], y1[i],
+                                      REFERENCE_EARTH_RADIUS);
+  }
+
+  // Every length up to a few vectors, so that all the tails are covered.
+  for (int n = 0; n <= 40; n++) {
+    out[n] = -1;
+    double sum = kernels->batch(x0, y0, x1, y1, n, REFERENCE_EARTH_RADIUS, out);
+    double expected_sum = 0;
+    for (int i = 0; i < n; i++) {
+      assert(close_enough(out[i], expected[i]));
+      expected_sum += expected[i];
+    }
+    assert(out[n] == -1);
+    assert(fabs(sum - expected_sum) <= n * MAX_ANTIPODAL_ERROR);
+    assert(sum == kernels->batch(x0, y0, x1, y1, n, REFERENCE_EARTH_RADIUS,
+                                 NULL));
+  }
+
+  double sum = kernels->batch(x0, y0, x1, y1, COUNT, REFERENCE_EARTH_RADIUS,
+                              out);
+  double expected_sum = 0;
+  for (int i = 0; i < COUNT; i++) {
+    assert(close_enough(out[i], expected[i]));
+    expected_sum += expected[i];
+  }
+  assert(fabs(sum - expected_sum) <= COUNT * MAX_ANTIPODAL_ERROR);
+}
+
+// All tiers but libm compute the same operations in the same order, so
+// their distances have to match bit for bit.
+static void test_same_bits(const haversine_kernels_t *kernels) {
+  if (!isa_supported(kernels->isa)) {
+    return;
+  }
+
+  static double x0[COUNT], y0[COUNT], x1[COUNT], y1[COUNT];
+  static double expected[COUNT], actual[COUNT];
+
+  srand(43);
+  for (int i = 0; i < COUNT; i++) {
+    x0[i] = random_in(-180, 180);
+    y0[i] = random_in(-90, 90);
+    x1[i] = random_in(-180, 180);
+    y1[i] = random_in(-90, 90);
+  }
+
+  haversine_kernels_scalar.batch(x0, y0, x1, y1, COUNT, REFERENCE_EARTH_RADIUS,
+                                 expected);
+  kernels->batch(x0, y0, x1, y1, COUNT, REFERENCE_EARTH_RADIUS, actual);
+  assert(memcmp(expected, actual, sizeof(expected)) == 0);
+}
+
+// The compact kernels have to give exactly what the regular ones give on
+// the coordinates widened up front, for every tail length.
+static void test_compact(const haversine_kernels_t *kernels) {
+  if (!isa_supported(kernels->isa)) {
+    return;
+  }
+
+  static float f0[COUNT], g0[COUNT], f1[COUNT], g1[COUNT];
+  static int32_t m0[COUNT], n0[COUNT], m1[COUNT], n1[COUNT];
+  static double x0[COUNT], y0[COUNT], x1[COUNT], y1[COUNT];
+  static double expected[COUNT + 1], actual[COUNT + 1];
+
+  srand(44);
+  for (int i = 0; i < COUNT; i++) {
+    f0[i] = (float)random_in(-180, 180);
+    g0[i] = (float)random_in(-90, 90);
+    f1[i] = (float)random_in(-180, 180);
+    g1[i] = (float)random_in(-90, 90);
+    m0[i] = (int32_t)(random_in(-180, 180) * HARVESTINE_MICRODEGREES);
+    n0[i] = (int32_t)(random_in(-90, 90) * HARVESTINE_MICRODEGREES);
+    m1[i] = (int32_t)(random_in(-180, 180) * HARVESTINE_MICRODEGREES);
+    n1[i] = (int32_t)(random_in(-90, 90) * HARVESTINE_MICRODEGREES);
+  }
+
+  const int lengths[] = {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, COUNT};
+  for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+    int n = lengths[l];
+
+    for (int i = 0; i < COUNT; i++) {
+      x0[i] = f0[i], y0[i] = g0[i], x1[i] = f1[i], y1[i] = g1[i];
+    }
+    expected[n] = actual[n] = -1;
+    double expected_sum =
+        kernels->batch(x0, y0, x1, y1, n, REFERENCE_EARTH_RADIUS, expected);
+    double sum =
+        kernels->batch_f32(f0, g0, f1, g1, n, REFERENCE_EARTH_RADIUS, actual);
+    assert(memcmp(expected, actual, (n + 1) * sizeof(double)) == 0);
+    assert(sum == expected_sum);
+
+    for (int i = 0; i < COUNT; i++) {
+      x0[i] = m0[i] * HARVESTINE_DEGREES_PER_MICRODEGREE;
+      y0[i] = n0[i] * HARVESTINE_DEGREES_PER_MICRODEGREE;
+      x1[i] = m1[i] * HARVESTINE_DEGREES_PER_MICRODEGREE;
+      y1[i] = n1[i] * HARVESTINE_DEGREES_PER_MICRODEGREE;
+    }
+    expected_sum =
+        kernels->batch(x0, y0, x1, y1, n, REFERENCE_EARTH_RADIUS, expected);
+    sum = kernels->batch_microdegrees(m0, n0, m1, n1, n,
+                                      REFERENCE_EARTH_RADIUS, actual);
+    assert(memcmp(expected, actual, (n + 1) * sizeof(double)) == 0);
+    assert(sum == expected_sum);
+  }
+}
+
+static const int tail_lengths[] = {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, COUNT};
+
+// Exactly |x - y| whatever the tier, infinite for NaN, and nothing written
+// past n.
+static void test_errors(const haversine_kernels_t *kernels) {
+  if (!isa_supported(kernels->isa)) {
+    return;
+  }
+  static double x[COUNT], y[COUNT], out[COUNT + 1];
+  srand(45);
+  for (int i = 0; i < COUNT; i++) {
+    x[i] = random_in(0, 20000);
+    y[i] = x[i] + random_in(-1e-9, 1e-9);
+  }
+  x[2] = NAN;
+  y[6] = NAN;
+  x[8] = y[8] = INFINITY;
+  y[12] = -5;
+
+  for (size_t l = 0; l < sizeof(tail_lengths) / sizeof(tail_lengths[0]);
+       l++) {
+    int n = tail_lengths[l];
+    out[n] = -1;
+    double max = kernels->errors(x, y, n, out);
+    double expected_max = 0;
+    for (int i = 0; i < n; i++) {
+      double error = fabs(x[i] - y[i]);
+      error = isnan(error) ? INFINITY : error;
+      assert(out[i] == error);
+      expected_max = fmax(expected_max, error);
+    }
+    assert(out[n] == -1);
+    assert(max == expected_max);
+  }
+}
+
+// The same count, minimum and maximum as the scalar definition whatever the
+// tier, and the sums up to their rounding, NaNs left out.
+static void test_moments(const haversine_kernels_t *kernels) {
+  if (!isa_supported(kernels->isa)) {
+    return;
+  }
+  static double x[COUNT];
+  srand(47);
+  for (int i = 0; i < COUNT; i++) {
+    x[i] = random_in(0, 20000);
+  }
+  x[1] = NAN;
+  x[9] = NAN;
+  x[10] = 0;
+  x[15] = 25000;
+
+  for (size_t l = 0; l < sizeof(tail_lengths) / sizeof(tail_lengths[0]);
+       l++) {
+    int n = tail_lengths[l];
+    haversine_moments_t moments;
+    kernels->moments(x, n, &moments);
+    size_t count = 0;
+    double sum = 0;
+    double min = INFINITY;
+    double max = -INFINITY;
+    for (int i = 0; i < n; i++) {
+      if (!isnan(x[i])) {
+        count++;
+        sum += x[i];
+        min = fmin(min, x[i]);
+        max = fmax(max, x[i]);
+      }
+    }
+    double m2 = 0;
+    for (int i = 0; i < n; i++) {
+      if (!isnan(x[i])) {
+        m2 += (x[i] - sum / count) * (x[i] - sum / count);
+      }
+    }
+    assert(moments.count == count);
+    assert(moments.min == min && moments.max == max);
+    assert(fabs(moments.sum - sum) <= 1e-12 * sum);
+    assert(fabs(moments.m2 - m2) <= 1e-12 * m2);
+  }
+}
+
+int main(void) {
+  test_compact(&haversine_kernels_libm);
+  test_compact(&haversine_kernels_scalar);
+  test_tier(&haversine_kernels_libm);
+  test_tier(&haversine_kernels_scalar);
+  test_errors(&haversine_kernels_scalar);
+  test_moments(&haversine_kernels_scalar);
+#if defined(__x86_64__) || defined(__i386__)
+  test_tier(&haversine_kernels_avx2);
+  test_tier(&haversine_kernels_avx512);
+  test_same_bits(&haversine_kernels_avx2);
+  test_same_bits(&haversine_kernels_avx512);
+  test_compact(&haversine_kernels_avx2);
+  test_compact(&haversine_kernels_avx512);
+  test_errors(&haversine_kernels_avx2);
+  test_errors(&haversine_kernels_avx512);
+  test_moments(&haversine_kernels_avx2);
+  test_moments(&haversine_kernels_avx512);
+#endif
+  printf("all tests passed\n");
+  return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef TEST_HELPERS_H_
+#define TEST_HELPERS_H_
+
+// Fixtures shared by the tests, not part of the program.
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pairs.h"
+
+// Uniform in [lo, hi], from rand(), so srand() repeats it.
+static inline double random_in(double lo, double hi) {
+  return lo + (hi - lo) * ((double)rand() / RAND_MAX);
+}
+
+// count pairs anywhere on the globe, in pairs_init() storage.
+static inline void random_pairs(pairs_t *pairs, int count) {
+  bool ok = pairs_init(pairs, count);
+  assert(ok);
+  for (int i = 0; i < count; i++) {
+    pairs_set(pairs, i, random_in(-180, 180), random_in(-90, 90),
+              random_in(-180, 180), random_in(-90, 90));
+  }
+}
+
+// Creates an empty file from a mkstemp() template, like
+// "/tmp/test_x_XXXXXX", which is left holding its name.
+static inline void temp_filename(char *filename) {
+  int fd = mkstemp(filename);
+  assert(fd >= 0);
+  close(fd);
+}
+
+#endif // TEST_HELPERS_H_
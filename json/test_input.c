@@ -0,0 +1,75 @@
+#include "input.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+
+#ifdef NDEBUG
+#error "Input tests need assertions"
+#endif
+
+static void write_bytes(const char *filename, const char *data, size_t len) {
+  FILE *file = fopen(filename, "wb");
+  assert(file != NULL);
+  assert(fwrite(data, 1, len, file) == len);
+  fclose(file);
+}
+
+// Both modes give the same NUL-terminated, writable bytes, including for
+// files that end exactly on a page boundary, where the NUL can't come from
+// the file's last page.
+static void test_modes(void) {
+  char filename[] = "/tmp/test_input_XXXXXX";
+  temp_filename(filename);
+
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  const size_t sizes[] = {0, 1, 100, page - 1, page, page + 1, 3 * page};
+  char *data = malloc(3 * page + 1);
+  for (size_t i = 0; i < 3 * page; i++) {
+    data[i] = 'a' + i % 26;
+  }
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    write_bytes(filename, data, sizes[s]);
+    for (int m = 0; m < 3; m++) {
+      input_t input;
+      assert(input_open(&input, filename, m == 0 ? INPUT_READ : INPUT_MMAP,
+                        m == 2));
+      assert(input.len == sizes[s]);
+      assert(memcmp(input.data, data, sizes[s]) == 0);
+      assert(input.data[input.len] == '\0');
+      // The parsers terminate pieces of the input in place.
+      input.data[input.len / 2] = '\0';
+      input_close(&input);
+    }
+  }
+
+  // Writing to a private mapping leaves the file alone.
+  input_t input;
+  assert(input_open(&input, filename, INPUT_READ, false));
+  assert(memcmp(input.data, data, 3 * page) == 0);
+  input_close(&input);
+
+  unlink(filename);
+  free(data);
+}
+
+static void test_missing(void) {
+  input_t input;
+  assert(!input_open(&input, "/nonexistent/test_input", INPUT_READ, false));
+  assert(errno == ENOENT);
+  assert(!input_open(&input, "/nonexistent/test_input", INPUT_MMAP, false));
+  assert(errno == ENOENT);
+}
+
+int main(void) {
+  test_modes();
+  test_missing();
+  printf("all tests passed\n");
+  return 0;
+}
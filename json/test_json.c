@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "json.h"
 
@@ -8,13 +9,12 @@
 #error "Get out!"
 #endif
 
-static void test_roundtrip(const char *input) {
-  json_object_t json;
-  assert(json_parse(input, &json));
+static json_parser_t shared_parser;
+static json_parser_t lazy_parser;
 
+static char *print_to_string(json_object_t json) {
   FILE *tf = tmpfile();
   json_fprint(tf, json);
-  json_free(json); // we no longer need the json object after this point
 
   int len = ftell(tf);
   fseek(tf, SEEK_SET, 0);
@@ -24,6 +24,10 @@ static void test_roundtrip(const char *input) {
   output[len] = '\0';
   fclose(tf);
 
+  return output;
+}
+
+static void check_output(const char *input, char *output) {
   if (strcmp(input, output) != 0) {
     fprintf(stderr, "%s !=\n%s\n", output, input);
     exit(1);
@@ -32,7 +36,177 @@ static void test_roundtrip(const char *input) {
   free(output);
 }
 
+static void test_roundtrip(const char *input) {
+  json_object_t json;
+  assert(json_parse(input, &json));
+  char *output = print_to_string(json);
+  json_free(json); // we no longer need the json object after this point
+  check_output(input, output);
+
+  // The same through the reusable parser, whose documents are not freed.
+  assert(json_parser_parse(&shared_parser, input, &json));
+  check_output(input, print_to_string(json));
+
+  assert(json_parser_parse(&lazy_parser, input, &json));
+  check_output(input, print_to_string(json));
+
+  // And with the length given rather than measured.
+  assert(json_parser_parse_len(&shared_parser, input, strlen(input), &json));
+  check_output(input, print_to_string(json));
+}
+
+static void test_parser_reuse(void) {
+  json_parser_t parser;
+  json_parser_init(&parser);
+
+  for (int i = 0; i < 100; i++) {
+    json_object_t json;
+    assert(json_parser_parse(
+        &parser, "{\"pairs\": [{\"x0\": 1, \"y0\": 2}, [], \"s\"]}", &json));
+    json_object_t pairs = json_dict_get(json, "pairs");
+    assert(json_array_len(pairs) == 3);
+    assert(json_get_number(json_dict_get(json_array_get(pairs, 0), "y0")) == 2);
+    assert(strcmp(json_get_string(json_array_get(pairs, 2)), "s") == 0);
+  }
+
+  // Every document fits into the block left over from the previous one.
+  assert(parser.arena.head != NULL && parser.arena.head->next == NULL);
+
+  assert(!json_parser_parse(&parser, "[1, 2", &(json_object_t){0}));
+  assert(parser.stack_len == 0);
+
+  json_parser_free(&parser);
+}
+
+static void test_lazy_numbers(void) {
+  const char *input = "{\"a\": 1.5, \"b\": [-2e3, 7]}";
+  json_object_t json;
+  assert(json_parser_parse(&lazy_parser, input, &json));
+
+  json_object_t a = json_dict_get(json, "a");
+  assert(json_is_number(a));
+  assert(!a.val.lazy_number->converted);
+  assert(json_get_number(a) == 1.5);
+  assert(a.val.lazy_number->converted);
+  // Copies of the object share the cached value.
+  assert(json_dict_get(json, "a").val.lazy_number->converted);
+
+  json_object_t b = json_dict_get(json, "b");
+  assert(json_get_number(json_array_get(b, 0)) == -2000);
+  assert(json_get_number(json_array_get(b, 1)) == 7);
+
+  // A long number followed by text that strtod() would take for its
+  // exponent.
+  char text[] = "0.0000000000000000000000000000000000000000000000000000000000"
+                "000000000025E5";
+  int len = (int)strlen(text) - 2;
+  json_lazy_number_t lazy = {.text = text, .len = len};
+  json_object_t number = {.typ = JSON_NUMBER,
+                          .number_repr = JSON_NUMBER_LAZY,
+                          .val.lazy_number = &lazy};
+  assert(json_get_number(number) == 25e-70);
+  lazy = (json_lazy_number_t){.text = text, .len = len + 2};
+  assert(json_get_number(number) == 25e-65);
+
+  // Longer than the lexer converts, cut off before the exponent by both.
+  char longest[JSON_LEXER_MAX_STRING + 64] = "[1.";
+  memset(longest + 3, '0', sizeof(longest) - 7);
+  strcpy(longest + sizeof(longest) - 4, "e5]");
+  assert(json_parse(longest, &json));
+  assert(json_get_number(json_array_get(json, 0)) == 1);
+  json_free(json);
+  assert(json_parser_parse(&lazy_parser, longest, &json));
+  assert(json_get_number(json_array_get(json, 0)) == 1);
+}
+
+static void test_integers(void) {
+  json_object_t json;
+  assert(json_parse("[9223372036854775807, -3, 2.5, 1e2]", &json));
+
+  assert(json_is_integer(json_array_get(json, 0)));
+  assert(json_get_int64(json_array_get(json, 0)) == INT64_MAX);
+  assert(json_is_integer(json_array_get(json, 1)));
+  assert(json_get_number(json_array_get(json, 1)) == -3);
+  assert(!json_is_integer(json_array_get(json, 2)));
+  assert(!json_is_integer(json_array_get(json, 3)));
+  assert(json_get_number(json_array_get(json, 3)) == 100);
+  json_free(json);
+
+  assert(json_parser_parse(&lazy_parser, "[123456789012345678, 0.5]", &json));
+  assert(json_is_integer(json_array_get(json, 0)));
+  assert(json_get_int64(json_array_get(json, 0)) == 123456789012345678LL);
+  assert(!json_is_integer(json_array_get(json, 1)));
+
+  json_object_t string = json_new_string("1");
+  assert(!json_is_integer(string));
+  json_free(string);
+  assert(json_get_int64(json_new_int64(-5)) == -5);
+}
+
+typedef struct {
+  int allocs;
+  int frees;
+} alloc_counter_t;
+
+static void *counting_alloc(void *ctx, size_t size) {
+  ((alloc_counter_t *)ctx)->allocs++;
+  return malloc(size);
+}
+
+static void *counting_realloc(void *ctx, void *ptr, size_t size) {
+  if (ptr == NULL) {
+    ((alloc_counter_t *)ctx)->allocs++;
+  }
+  return realloc(ptr, size);
+}
+
+static void counting_free(void *ctx, void *ptr) {
+  if (ptr != NULL) {
+    ((alloc_counter_t *)ctx)->frees++;
+  }
+  free(ptr);
+}
+
+static void test_custom_allocator(void) {
+  alloc_counter_t counter = {0};
+  json_allocator_t allocator = {
+      .alloc = counting_alloc,
+      .realloc = counting_realloc,
+      .free = counting_free,
+      .ctx = &counter,
+  };
+  const char *input = "{\"pairs\": [{\"x0\": 1.5, \"y0\": -2}, [true]]}";
+
+  // DOM built and freed under the custom allocator.
+  const json_allocator_t *previous = json_set_allocator(&allocator);
+  json_object_t json;
+  assert(json_parse(input, &json));
+  json_dict_set(&json, "name", json_new_string("value"));
+  json_free(json);
+  json_set_allocator(previous);
+
+  assert(counter.allocs > 0);
+  assert(counter.allocs == counter.frees);
+
+  // The reusable parser stops allocating once it has warmed up.
+  json_parser_t parser;
+  json_parser_init_with_allocator(&parser, &allocator);
+  assert(json_parser_parse(&parser, input, &json));
+  int warm_allocs = counter.allocs;
+  for (int i = 0; i < 100; i++) {
+    assert(json_parser_parse(&parser, input, &json));
+  }
+  assert(counter.allocs == warm_allocs);
+  json_parser_free(&parser);
+
+  assert(counter.allocs == counter.frees);
+}
+
 int main(void) {
+  json_parser_init(&shared_parser);
+  json_parser_init(&lazy_parser);
+  lazy_parser.lazy_numbers = true;
+
   test_roundtrip("{}");
   test_roundtrip("{\"foo\": \"bar\"}");
 
@@ -50,6 +224,7 @@ int main(void) {
   // "Quotes\\\"\"}");
   // test_roundtrip("{\"escaped\": \"Line\\\\nBreak\"}");
   test_roundtrip("{\"largeFloat\": 1.23456e+30}");
+  test_roundtrip("{\"id\": 9007199254740993, \"min\": -9223372036854775808}");
   test_roundtrip("{\"truthy\": true, \"falsy\": false}");
   test_roundtrip("{\"level1\": {\"level2\": {\"level3\": {\"level4\": "
                  "{\"key\": \"deep value\"}}}}}");
@@ -59,6 +234,14 @@ int main(void) {
   test_roundtrip("true");
   test_roundtrip("null");
 
+  test_parser_reuse();
+  test_custom_allocator();
+  test_lazy_numbers();
+  test_integers();
+
+  json_parser_free(&shared_parser);
+  json_parser_free(&lazy_parser);
+
   printf("all tests passed\n");
   return 0;
 }
@@ -0,0 +1,83 @@
+#include "json_kernels.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef NDEBUG
+#error "Kernel tests need assertions"
+#endif
+
+#define BUFFER_SIZE 300
+
+// Every tier has to agree with the scalar kernels on every prefix and
+// offset of the buffer, so that chunk boundaries and tails are covered.
+static void check_tier(const json_kernels_t *kernels, const char *buf) {
+  for (size_t start = 0; start < 70; start++) {
+    for (size_t len = 0; start + len <= BUFFER_SIZE; len++) {
+      const char *p = buf + start;
+      assert(kernels->scan_string(p, len) ==
+             json_kernels_scalar.scan_string(p, len));
+      assert(kernels->scan_digits(p, len) ==
+             json_kernels_scalar.scan_digits(p, len));
+    }
+  }
+}
+
+static void fill_plain(char *buf, char filler) {
+  for (int i = 0; i < BUFFER_SIZE; i++) {
+    buf[i] = filler;
+  }
+}
+
+static void test_tier(const json_kernels_t *kernels) {
+  if (!isa_supported(kernels->isa)) {
+    printf("skipping %s, not supported by this CPU\n", isa_name(kernels->isa));
+    return;
+  }
+
+  char buf[BUFFER_SIZE];
+  const char specials[] = {'"', '\\', '\n', '\0', (char)0x80, (char)0xC3,
+                           'a', '.'};
+
+  // A single interesting byte at every position.
+  for (size_t s = 0; s < sizeof(specials); s++) {
+    for (int pos = 0; pos < BUFFER_SIZE; pos += 7) {
+      fill_plain(buf, 'x');
+      buf[pos] = specials[s];
+      check_tier(kernels, buf);
+
+      fill_plain(buf, '7');
+      buf[pos] = specials[s];
+      check_tier(kernels, buf);
+    }
+  }
+
+  // Random bytes, biased towards digits and plain characters.
+  srand(42);
+  for (int round = 0; round < 20; round++) {
+    for (int i = 0; i < BUFFER_SIZE; i++) {
+      int r = rand() % 100;
+      buf[i] = r < 45 ? '0' + r % 10 : r < 97 ? 'a' + r % 26 : specials[r % 8];
+    }
+    check_tier(kernels, buf);
+  }
+
+  const char *digits = "0123456789012345";
+  assert(kernels->parse_sixteen_digits(digits) == 123456789012345ULL);
+  assert(kernels->parse_sixteen_digits("9999999999999999") ==
+         9999999999999999ULL);
+  assert(kernels->parse_sixteen_digits("0000000000000000") == 0);
+}
+
+int main(void) {
+  test_tier(&json_kernels_scalar);
+#if defined(__x86_64__) || defined(__i386__)
+  test_tier(&json_kernels_sse42);
+  test_tier(&json_kernels_avx2);
+  test_tier(&json_kernels_avx512);
+#endif
+  printf("all tests passed\n");
+  return 0;
+}
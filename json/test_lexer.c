@@ -55,9 +55,76 @@ static void test_string_escaping() {
   json_lexer_free(&lexer);
 }
 
+static void test_lazy_numbers() {
+  json_lexer_t lexer;
+  json_lexer_init(&lexer, "[-12.5e3, 7]");
+  lexer.lazy_numbers = true;
+
+  assert(json_lexer_get_token(&lexer));
+  assert(lexer.token == '[');
+
+  assert(json_lexer_get_token(&lexer));
+  assert(lexer.token == JSON_TOK_NUMBER);
+  assert(lexer.number_len == 7);
+  assert(strncmp(lexer.number_start, "-12.5e3", 7) == 0);
+  assert(lexer.numeric_value == 0);
+
+  assert(json_lexer_get_token(&lexer));
+  assert(lexer.token == ',');
+
+  assert(json_lexer_get_token(&lexer));
+  assert(lexer.token == JSON_TOK_NUMBER);
+  assert(lexer.number_len == 1);
+  assert(lexer.number_start[0] == '7');
+
+  json_lexer_free(&lexer);
+}
+
+static void expect_integer(const char *input, int64_t expected) {
+  json_lexer_t lexer;
+  json_lexer_init(&lexer, input);
+  assert(json_lexer_get_token(&lexer));
+  assert(lexer.token == JSON_TOK_NUMBER);
+  assert(lexer.is_integer);
+  assert(lexer.integer_value == expected);
+  assert(lexer.numeric_value == (double)expected);
+  json_lexer_free(&lexer);
+}
+
+static void expect_not_integer(const char *input, double expected) {
+  json_lexer_t lexer;
+  json_lexer_init(&lexer, input);
+  assert(json_lexer_get_token(&lexer));
+  assert(lexer.token == JSON_TOK_NUMBER);
+  assert(!lexer.is_integer);
+  assert(lexer.numeric_value == expected);
+  json_lexer_free(&lexer);
+}
+
+static void test_integers() {
+  expect_integer("0", 0);
+  expect_integer("42,", 42);
+  expect_integer("-7]", -7);
+  expect_integer("12345678", 12345678);
+  expect_integer("1234567890123456789", 1234567890123456789LL);
+  expect_integer("9007199254740993", 9007199254740993LL);
+  expect_integer("9223372036854775807", INT64_MAX);
+  expect_integer("-9223372036854775808", INT64_MIN);
+
+  expect_not_integer("9223372036854775808", 9223372036854775808.0);
+  expect_not_integer("-9223372036854775809", -9223372036854775809.0);
+  expect_not_integer("123456789012345678901", 123456789012345678901.0);
+  expect_not_integer("1.5", 1.5);
+  expect_not_integer("1e3", 1000);
+  expect_not_integer("12345678.5", 12345678.5);
+  expect_not_integer("-0", 0);
+}
+
 int main() {
   test_basic_json();
   test_string_escaping();
+  test_lazy_numbers();
+  test_integers();
   printf("all tests passed\n");
   return 0;
 }
@@ -0,0 +1,330 @@
+// Accuracy harness for the haversine math. Sweeps sin, cos, asin, sqrt and
+// the full haversine of every kernel table across their input domains,
+// compares them against the same formulas in long double, prints the worst
+// errors and fails if any of them exceeds its budget.
+
+#include "harvestine.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test_helpers.h"
+
+#ifdef NDEBUG
+#error "Math tests need assertions"
+#endif
+
+#define SWEEP_POINTS (1 << 20)
+#define RANDOM_PAIRS (1 << 18)
+
+typedef struct {
+  double max_abs;
+  double max_abs_at;
+  double max_ulp;
+  double max_ulp_at;
+  int nans;
+} error_stats_t;
+
+// Units in the last place of the double closest to expected, but never
+// smaller than DBL_EPSILON * scale. Results that come out 0 or close to it
+// only by cancellation, like a distance from a point to itself, would
+// otherwise be measured in the denormal ulps of 0.
+static double ulp_error(double actual, long double expected, double scale) {
+  double rounded = fabs((double)expected);
+  double ulp = nextafter(rounded, INFINITY) - rounded;
+  ulp = fmax(ulp, DBL_EPSILON * scale);
+  return (double)(fabsl((long double)actual - expected) / ulp);
+}
+
+static void record(error_stats_t *stats, double actual, long double expected,
+                   double at, double scale) {
+  if (isnan(actual)) {
+    stats->nans++;
+    return;
+  }
+  double abs_error = (double)fabsl((long double)actual - expected);
+  double ulps = ulp_error(actual, expected, scale);
+  if (abs_error > stats->max_abs) {
+    stats->max_abs = abs_error;
+    stats->max_abs_at = at;
+  }
+  if (ulps > stats->max_ulp) {
+    stats->max_ulp = ulps;
+    stats->max_ulp_at = at;
+  }
+}
+
+// libm is only there for comparison: it is the baseline the budgets are
+// measured against, not something this harness can fix.
+static const char *verdict(const haversine_kernels_t *kernels, bool passed) {
+  if (passed) {
+    return "";
+  }
+  return kernels == &haversine_kernels_libm ? "  (baseline)" : "  FAILED";
+}
+
+static bool gate(const haversine_kernels_t *kernels, bool passed) {
+  return passed || kernels == &haversine_kernels_libm;
+}
+
+static haversine_map_t get_sin(const haversine_kernels_t *k) { return k->sin; }
+static haversine_map_t get_cos(const haversine_kernels_t *k) { return k->cos; }
+static haversine_map_t get_asin(const haversine_kernels_t *k) {
+  return k->asin;
+}
+static haversine_map_t get_sqrt(const haversine_kernels_t *k) {
+  return k->sqrt;
+}
+
+typedef struct {
+  const char *name;
+  haversine_map_t (*get)(const haversine_kernels_t *kernels);
+  long double (*reference)(long double x);
+  double lo;
+  double hi;
+  // Budget, in ulps of the exact result.
+  double max_ulp;
+} function_t;
+
+static const function_t functions[] = {
+    {"sin", get_sin, sinl, -M_PI, M_PI, 2.5},
+    {"cos", get_cos, cosl, -M_PI_2, M_PI_2, 2.5},
+    {"asin", get_asin, asinl, 0.0, 1.0, 3.0},
+    {"sqrt", get_sqrt, sqrtl, 0.0, 1.0, 0.5},
+};
+
+#define FUNCTION_COUNT (sizeof(functions) / sizeof(functions[0]))
+
+// Domain edges, the points where the reductions switch over and their
+// neighbours, plus the tiny arguments short distances produce.
+static int special_points(const function_t *f, double *out) {
+  const double candidates[] = {
+      f->lo, f->hi, 0.0, 1e-300, 1e-20, 1e-9, 0.25, 0.5, 1.0, M_PI_4,
+      M_PI_2, -M_PI_2, M_PI, -M_PI,
+  };
+  int n = 0;
+  for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+    double x = candidates[i];
+    double neighbours[] = {x, nextafter(x, -INFINITY), nextafter(x, INFINITY)};
+    for (int j = 0; j < 3; j++) {
+      if (f->lo <= neighbours[j] && neighbours[j] <= f->hi) {
+        out[n++] = neighbours[j];
+      }
+    }
+  }
+  return n;
+}
+
+static bool check_function(const function_t *f,
+                           const haversine_kernels_t **kernels,
+                           int kernel_count) {
+  static double x[SWEEP_POINTS + 64];
+  static long double expected[SWEEP_POINTS + 64];
+  static double actual[SWEEP_POINTS + 64];
+
+  int n = special_points(f, x);
+  for (int i = 0; i < SWEEP_POINTS; i++) {
+    x[n++] = f->lo + (f->hi - f->lo) * i / (SWEEP_POINTS - 1);
+  }
+  for (int i = 0; i < n; i++) {
+    expected[i] = f->reference(x[i]);
+  }
+
+  bool ok = true;
+  for (int k = 0; k < kernel_count; k++) {
+    f->get(kernels[k])(x, n, actual);
+
+    error_stats_t stats = {0};
+    for (int i = 0; i < n; i++) {
+      // The functions have to be accurate down to the smallest results.
+      record(&stats, actual[i], expected[i], x[i], 0);
+    }
+
+    bool passed = stats.max_ulp <= f->max_ulp && stats.nans == 0;
+    printf("%-7s %-5s max abs %.3g at %.17g, max %.2f ulp at %.17g, %d NaN%s\n",
+           kernels[k]->name, f->name, stats.max_abs, stats.max_abs_at,
+           stats.max_ulp, stats.max_ulp_at, stats.nans,
+           verdict(kernels[k], passed));
+    ok = gate(kernels[k], passed) && ok;
+  }
+  return ok;
+}
+
+typedef struct {
+  double x0;
+  double y0;
+  double x1;
+  double y1;
+} pair_t;
+
+static long double square(long double x) { return x * x; }
+
+static long double precise_haversine(pair_t p, long double earth_radius) {
+  const long double radians = 3.141592653589793238462643383279502884L / 180;
+  long double d_lat = ((long double)p.y1 - p.y0) * radians;
+  long double d_lon = ((long double)p.x1 - p.x0) * radians;
+  long double a = square(sinl(d_lat / 2)) + cosl(p.y0 * radians) *
+                                                cosl(p.y1 * radians) *
+                                                square(sinl(d_lon / 2));
+  return earth_radius * 2 * asinl(sqrtl(a));
+}
+
+// Pairs whose exact distance is below this are within 1000 km of being
+// antipodal, where asin() amplifies the rounding of its argument.
+#define ANTIPODAL_DISTANCE (M_PI * REFERENCE_EARTH_RADIUS - 1000)
+
+// Budgets against the exact distance. Even the libm version is limited by
+// rounding the inputs to radians: at the poles cos(lat) is tiny and loses
+// relative precision, and the date line turns into sin(pi) != 0, hence the
+// absolute floor. Near the antipode a single ulp of a is worth 1e-4 km.
+#define MAX_RELATIVE_ERROR 1e-14
+#define MIN_ABSOLUTE_ERROR 1e-11
+#define MAX_ANTIPODAL_ERROR 1e-3
+
+typedef enum {
+  CASE_RANDOM,
+  CASE_TINY,
+  CASE_ANTIPODAL,
+  CASE_COUNT,
+} pair_case_t;
+
+static const char *case_names[CASE_COUNT] = {"random", "tiny", "antipodal"};
+
+static pair_t make_pair(pair_case_t c) {
+  pair_t p = {random_in(-180, 180), random_in(-90, 90), 0, 0};
+  switch (c) {
+  case CASE_RANDOM:
+    p.x1 = random_in(-180, 180);
+    p.y1 = random_in(-90, 90);
+    break;
+  case CASE_TINY: {
+    // Down to a few nanometers, clamped to the valid range.
+    double scale = pow(10, -random_in(3, 15));
+    p.x1 = fmin(180, fmax(-180, p.x0 + scale * random_in(-1, 1)));
+    p.y1 = fmin(90, fmax(-90, p.y0 + scale * random_in(-1, 1)));
+    break;
+  }
+  case CASE_ANTIPODAL: {
+    double scale = pow(10, -random_in(0, 12));
+    p.x1 = p.x0 > 0 ? p.x0 - 180 : p.x0 + 180;
+    p.x1 = fmin(180, fmax(-180, p.x1 + scale * random_in(-1, 1)));
+    p.y1 = fmin(90, fmax(-90, -p.y0 + scale * random_in(-1, 1)));
+    break;
+  }
+  default:
+    assert(false);
+  }
+  return p;
+}
+
+// Exact corner cases: the poles, the date line and identical points.
+static const pair_t fixed_pairs[] = {
+    {0, 0, 0, 0},       {-180, 0, 180, 0},   {0, 90, 0, -90},
+    {0, 90, 123, 90},   {-180, -90, 180, 90}, {0, 0, 180, 0},
+    {179.999, 0, -179.999, 0}, {45, 45, -135, -45},
+};
+
+#define FIXED_PAIRS (sizeof(fixed_pairs) / sizeof(fixed_pairs[0]))
+
+static bool check_haversine(const haversine_kernels_t **kernels,
+                            int kernel_count) {
+  static double x0[RANDOM_PAIRS], y0[RANDOM_PAIRS], x1[RANDOM_PAIRS],
+      y1[RANDOM_PAIRS], actual[RANDOM_PAIRS];
+  static long double expected[RANDOM_PAIRS];
+
+  bool ok = true;
+  for (int c = 0; c < CASE_COUNT; c++) {
+    srand(1234 + c);
+    int n = 0;
+    if (c == CASE_RANDOM) {
+      for (; n < (int)FIXED_PAIRS; n++) {
+        x0[n] = fixed_pairs[n].x0;
+        y0[n] = fixed_pairs[n].y0;
+        x1[n] = fixed_pairs[n].x1;
+        y1[n] = fixed_pairs[n].y1;
+      }
+    }
+    for (; n < RANDOM_PAIRS; n++) {
+      pair_t p = make_pair((pair_case_t)c);
+      x0[n] = p.x0;
+      y0[n] = p.y0;
+      x1[n] = p.x1;
+      y1[n] = p.y1;
+    }
+    for (int i = 0; i < n; i++) {
+      pair_t p = {x0[i], y0[i], x1[i], y1[i]};
+      expected[i] = precise_haversine(p, REFERENCE_EARTH_RADIUS);
+    }
+
+    for (int k = 0; k < kernel_count; k++) {
+      kernels[k]->batch(x0, y0, x1, y1, n, REFERENCE_EARTH_RADIUS, actual);
+
+      // Locations are recorded as indices here.
+      error_stats_t stats = {0};
+      bool passed = true;
+      for (int i = 0; i < n; i++) {
+        // In ulps of the earth radius at least, which is what the inputs
+        // are scaled to.
+        record(&stats, actual[i], expected[i], i, REFERENCE_EARTH_RADIUS);
+        // NaN fails the comparisons below as well.
+
+        double error = (double)fabsl(actual[i] - expected[i]);
+        if (expected[i] > ANTIPODAL_DISTANCE) {
+          passed = passed && error <= MAX_ANTIPODAL_ERROR;
+        } else {
+          passed = passed && error <= MAX_RELATIVE_ERROR * (double)expected[i] +
+                                          MIN_ABSOLUTE_ERROR;
+        }
+      }
+
+      int worst_abs = (int)stats.max_abs_at;
+      int worst_ulp = (int)stats.max_ulp_at;
+      printf("%-7s haversine %-9s max abs %.3g km at (%g, %g, %g, %g), "
+             "max %.3g ulp at (%g, %g, %g, %g), %d NaN%s\n",
+             kernels[k]->name, case_names[c], stats.max_abs, x0[worst_abs],
+             y0[worst_abs], x1[worst_abs], y1[worst_abs], stats.max_ulp,
+             x0[worst_ulp], y0[worst_ulp], x1[worst_ulp], y1[worst_ulp],
+             stats.nans, verdict(kernels[k], passed));
+      ok = gate(kernels[k], passed) && ok;
+    }
+  }
+  return ok;
+}
+
+int main(void) {
+  const haversine_kernels_t *candidates[] = {
+      &haversine_kernels_libm,
+      &haversine_kernels_scalar,
+#if defined(__x86_64__) || defined(__i386__)
+      &haversine_kernels_avx2,
+      &haversine_kernels_avx512,
+#endif
+  };
+  const haversine_kernels_t *kernels[sizeof(candidates) /
+                                     sizeof(candidates[0])];
+  int kernel_count = 0;
+  for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+    if (isa_supported(candidates[i]->isa)) {
+      kernels[kernel_count++] = candidates[i];
+    } else {
+      printf("skipping %s, not supported by this CPU\n", candidates[i]->name);
+    }
+  }
+
+  bool ok = true;
+  for (size_t f = 0; f < FUNCTION_COUNT; f++) {
+    ok = check_function(&functions[f], kernels, kernel_count) && ok;
+  }
+  ok = check_haversine(kernels, kernel_count) && ok;
+
+  if (!ok) {
+    printf("accuracy budget exceeded\n");
+    return 1;
+  }
+  printf("all tests passed\n");
+  return 0;
+}
@@ -0,0 +1,130 @@
+#include "page_alloc.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef NDEBUG
+#error "Page allocator tests need assertions"
+#endif
+
+static void configure(pages_t pages, int prefault_threads) {
+  page_options_t options = {pages, prefault_threads};
+  page_alloc_configure(&options);
+}
+
+// Every kind of buffer is aligned, usable in full and can be freed whatever
+// the options are by then. Huge TLB pages are rarely reserved, so that
+// mostly checks the fallback.
+static void test_kinds(void) {
+  const size_t sizes[] = {1, 1000, PAGE_ALLOC_MIN_SIZE,
+                          PAGE_ALLOC_HUGE_SIZE + 1, 5 * PAGE_ALLOC_MIN_SIZE};
+  for (int pages = 0; pages < PAGES_COUNT; pages++) {
+    for (int threads = 0; threads <= 3; threads += 3) {
+      configure((pages_t)pages, threads);
+      for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        unsigned char *ptr = page_alloc(sizes[s]);
+        assert(ptr != NULL);
+        assert((uintptr_t)ptr % 64 == 0);
+        memset(ptr, 0xab, sizes[s]);
+        assert(ptr[0] == 0xab && ptr[sizes[s] - 1] == 0xab);
+        configure(PAGES_MALLOC, 0);
+        page_free(ptr);
+        configure((pages_t)pages, threads);
+      }
+    }
+  }
+  page_alloc_trim();
+  configure(PAGES_MALLOC, 0);
+}
+
+// A freed mapping comes back for the next allocation that fits, with its
+// pages already faulted in, but only for the same kind of pages.
+static void test_reuse(void) {
+  configure(PAGES_NORMAL, 0);
+  size_t size = 4 * PAGE_ALLOC_MIN_SIZE;
+  char *ptr = page_alloc(size);
+  memset(ptr, 1, size);
+  page_free(ptr);
+
+  page_faults_t faults = page_faults();
+  char *again = page_alloc(size - 100);
+  assert(again == ptr);
+  memset(again, 2, size - 100);
+  assert(page_faults_since(faults).minor < 16);
+  page_free(again);
+
+  configure(PAGES_HUGE, 0);
+  char *huge = page_alloc(size);
+  assert(huge != ptr);
+  page_free(huge);
+
+  // The oldest buffers make room for new ones.
+  configure(PAGES_NORMAL, 0);
+  char *buffers[PAGE_ALLOC_CACHE + 1];
+  for (int i = 0; i <= PAGE_ALLOC_CACHE; i++) {
+    buffers[i] = page_alloc(size);
+  }
+  for (int i = 0; i <= PAGE_ALLOC_CACHE; i++) {
+    page_free(buffers[i]);
+  }
+  page_alloc_trim();
+
+  // Smaller buffers come from malloc and aren't kept.
+  char *small = page_alloc(100);
+  page_free(small);
+  configure(PAGES_MALLOC, 0);
+}
+
+// Prefaulting takes the faults up front, so touching the buffer afterwards
+// takes almost none.
+static void test_prefault(void) {
+  configure(PAGES_NORMAL, 4);
+  size_t size = 8 * PAGE_ALLOC_MIN_SIZE;
+  char *ptr = page_alloc(size);
+  page_faults_t faults = page_faults();
+  memset(ptr, 3, size);
+  assert(page_faults_since(faults).minor < 16);
+  page_free(ptr);
+  page_alloc_trim();
+  configure(PAGES_MALLOC, 0);
+}
+
+// Arena blocks grow in place while they fit and keep their contents when
+// they move.
+static void test_json_allocator(void) {
+  configure(PAGES_HUGE, 0);
+  const json_allocator_t *allocator = &page_json_allocator;
+  char *ptr = allocator->alloc(allocator->ctx, 10);
+  strcpy(ptr, "arena");
+  ptr = allocator->realloc(allocator->ctx, ptr, 50);
+  assert(strcmp(ptr, "arena") == 0);
+  ptr = allocator->realloc(allocator->ctx, ptr, 3 * PAGE_ALLOC_MIN_SIZE);
+  assert(strcmp(ptr, "arena") == 0);
+  ptr[3 * PAGE_ALLOC_MIN_SIZE - 1] = 1;
+  allocator->free(allocator->ctx, ptr);
+  allocator->free(allocator->ctx, NULL);
+  page_alloc_trim();
+  configure(PAGES_MALLOC, 0);
+}
+
+static void test_names(void) {
+  for (int i = 0; i < PAGES_COUNT; i++) {
+    pages_t pages;
+    assert(pages_from_name(pages_name((pages_t)i), &pages));
+    assert(pages == (pages_t)i);
+  }
+  pages_t pages;
+  assert(!pages_from_name("large", &pages));
+}
+
+int main(void) {
+  test_kinds();
+  test_reuse();
+  test_prefault();
+  test_json_allocator();
+  test_names();
+  printf("all tests passed\n");
+  return 0;
+}
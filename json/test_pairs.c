@@ -0,0 +1,238 @@
+#include "pairs.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harvestine.h"
+#include "test_helpers.h"
+
+#ifdef NDEBUG
+#error "Pairs tests need assertions"
+#endif
+
+// Columns are aligned and the padding is zero.
+static void test_layout(void) {
+  for (int count = 0; count <= 20; count++) {
+    pairs_t pairs;
+    random_pairs(&pairs, count);
+    double *columns[] = {pairs.x0, pairs.y0, pairs.x1, pairs.y1};
+    for (int c = 0; c < 4; c++) {
+      assert((uintptr_t)columns[c] % PAIRS_ALIGNMENT == 0);
+      int padded = (count + PAIRS_PADDING - 1) / PAIRS_PADDING * PAIRS_PADDING;
+      for (int i = count; i < padded; i++) {
+        assert(columns[c][i] == 0);
+      }
+    }
+    pairs_free(&pairs);
+  }
+}
+
+static void test_threads(void) {
+  const int count = 10007;
+  pairs_t pairs;
+  random_pairs(&pairs, count);
+
+  double expected = 0;
+  for (int i = 0; i < count; i++) {
+    expected += reference_haversine(pairs.x0[i], pairs.y0[i], pairs.x1[i],
+                                    pairs.y1[i], REFERENCE_EARTH_RADIUS);
+  }
+  expected /= count;
+
+  for (int threads = 1; threads <= 9; threads++) {
+    double average = average_harvestine(&pairs, threads, SUMMATION_FAST);
+    assert(fabs(average - expected) < 1e-9);
+  }
+  pairs_free(&pairs);
+
+  // More threads than pairs leaves some of them without work.
+  random_pairs(&pairs, 3);
+  for (int threads = 1; threads <= 8; threads++) {
+    double average = average_harvestine(&pairs, threads, SUMMATION_FAST);
+    assert(fabs(average - average_harvestine(&pairs, 1, SUMMATION_FAST)) < 1e-9);
+  }
+  pairs_free(&pairs);
+}
+
+// The same bits for every thread count and every tier but libm.
+static void test_deterministic(void) {
+  const int count = 100003;
+  pairs_t pairs;
+  random_pairs(&pairs, count);
+  haversine_kernels_t saved = haversine_kernels;
+
+  const haversine_kernels_t *tiers[] = {
+      &haversine_kernels_scalar,
+#if defined(__x86_64__) || defined(__i386__)
+      &haversine_kernels_avx2,
+      &haversine_kernels_avx512,
+#endif
+  };
+
+  haversine_kernels = haversine_kernels_scalar;
+  double expected =
+      average_harvestine(&pairs, 1, SUMMATION_DETERMINISTIC);
+  for (size_t i = 0; i < sizeof(tiers) / sizeof(tiers[0]); i++) {
+    if (!isa_supported(tiers[i]->isa)) {
+      continue;
+    }
+    haversine_kernels = *tiers[i];
+    for (int threads = 1; threads <= 9; threads++) {
+      double average =
+          average_harvestine(&pairs, threads, SUMMATION_DETERMINISTIC);
+      assert(memcmp(&average, &expected, sizeof(double)) == 0);
+    }
+  }
+
+  haversine_kernels = saved;
+  pairs_free(&pairs);
+}
+
+// Compact copies are half the size, padded with zeros, and average close to
+// the doubles they were made from, in either summation mode.
+static void test_storage(void) {
+  for (int s = 0; s < PAIRS_STORAGE_COUNT; s++) {
+    pairs_storage_t storage;
+    bool ok = pairs_storage_from_name(pairs_storage_name(s), &storage);
+    assert(ok && storage == (pairs_storage_t)s);
+  }
+  pairs_storage_t storage;
+  assert(!pairs_storage_from_name("f16", &storage));
+
+  const int count = 10007;
+  pairs_t pairs;
+  random_pairs(&pairs, count);
+  double expected = average_harvestine(&pairs, 1, SUMMATION_FAST);
+
+  const pairs_storage_t storages[] = {PAIRS_F32, PAIRS_MICRODEGREES};
+  const double tolerances[] = {1e-5, 1e-7};
+  for (int s = 0; s < 2; s++) {
+    pairs_t compact;
+    bool ok = pairs_init_converted(&compact, &pairs, storages[s]);
+    assert(ok);
+    assert(compact.count == count && compact.storage == storages[s]);
+    assert(pairs_bytes(&compact) <=
+           pairs_bytes(&pairs) / 2 + 4 * PAIRS_ALIGNMENT);
+
+    // Every element is 4 bytes, and 0 is all zero bits in either storage.
+    size_t column_elements = pairs_column_bytes(count, storages[s]) / 4;
+    const uint32_t *columns[] = {
+        (const uint32_t *)compact.x0, (const uint32_t *)compact.y0,
+        (const uint32_t *)compact.x1, (const uint32_t *)compact.y1};
+    for (int c = 0; c < 4; c++) {
+      assert((uintptr_t)columns[c] % PAIRS_ALIGNMENT == 0);
+      for (size_t i = count; i < column_elements; i++) {
+        assert(columns[c][i] == 0);
+      }
+    }
+
+    double first = average_harvestine(&compact, 1, SUMMATION_DETERMINISTIC);
+    assert(fabs(first - expected) < tolerances[s] * expected);
+    for (int threads = 1; threads <= 5; threads++) {
+      double average = average_harvestine(&compact, threads, SUMMATION_FAST);
+      assert(fabs(average - expected) < tolerances[s] * expected);
+      average =
+          average_harvestine(&compact, threads, SUMMATION_DETERMINISTIC);
+      assert(memcmp(&average, &first, sizeof(double)) == 0);
+    }
+    pairs_free(&compact);
+  }
+
+  // Out of the range of int32 microdegrees.
+  pairs.y1[count / 2] = 1e10;
+  pairs_t compact;
+  assert(!pairs_init_converted(&compact, &pairs, PAIRS_MICRODEGREES));
+  pairs.y1[count / 2] = NAN;
+  assert(!pairs_init_converted(&compact, &pairs, PAIRS_MICRODEGREES));
+  pairs_free(&pairs);
+}
+
+// Pairs added one at a time give exactly what average_harvestine() gives
+// with one thread.
+static void test_accumulator(void) {
+  const int counts[] = {1, 255, 256, 257, 10007};
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    pairs_t pairs;
+    random_pairs(&pairs, counts[c]);
+    for (int s = 0; s < 2; s++) {
+      summation_t summation = s ? SUMMATION_DETERMINISTIC : SUMMATION_FAST;
+      pairs_accumulator_t acc;
+      pairs_accumulator_init(&acc, summation);
+      for (int i = 0; i < pairs.count; i++) {
+        pairs_accumulator_add(&acc, pairs.x0[i], pairs.y0[i], pairs.x1[i],
+                              pairs.y1[i]);
+      }
+      double average = pairs_accumulator_average(&acc);
+      double expected = average_harvestine(&pairs, 1, summation);
+      assert(memcmp(&average, &expected, sizeof(double)) == 0);
+    }
+    pairs_free(&pairs);
+  }
+}
+
+static void test_pairwise_sum(void) {
+  assert(pairwise_sum(NULL, 0) == 0);
+
+  double values[1000];
+  for (int i = 0; i < 1000; i++) {
+    values[i] = 0.1;
+  }
+  double naive = 0;
+  for (int i = 0; i < 1000; i++) {
+    naive += values[i];
+  }
+  assert(fabs(pairwise_sum(values, 1000) - 100) <= fabs(naive - 100));
+}
+
+// Cutting the blocks into pieces anywhere mustn't change the total.
+static void test_summation_tree(void) {
+  enum { BLOCKS = 1000 };
+  double sums[BLOCKS];
+  srand(11);
+  for (int i = 0; i < BLOCKS; i++) {
+    sums[i] = random_in(0, 1e6) * (rand() % 2 ? 1 : 1e-9);
+  }
+
+  for (int n = 0; n <= BLOCKS; n += n < 20 ? 1 : 97) {
+    summation_tree_t whole;
+    summation_tree_init(&whole);
+    for (int i = 0; i < n; i++) {
+      summation_tree_add(&whole, i, sums[i]);
+    }
+    double expected = summation_tree_total(&whole);
+
+    for (int round = 0; round < 10; round++) {
+      summation_tree_t tree;
+      summation_tree_init(&tree);
+      int i = 0;
+      while (i < n) {
+        summation_tree_t piece;
+        summation_tree_init(&piece);
+        int end = i + 1 + rand() % 40;
+        for (; i < end && i < n; i++) {
+          summation_tree_add(&piece, i, sums[i]);
+        }
+        summation_tree_append(&tree, &piece);
+      }
+      double total = summation_tree_total(&tree);
+      assert(memcmp(&total, &expected, sizeof(double)) == 0);
+    }
+  }
+}
+
+int main(void) {
+  srand(7);
+  test_layout();
+  test_threads();
+  test_deterministic();
+  test_storage();
+  test_accumulator();
+  test_pairwise_sum();
+  test_summation_tree();
+  printf("all tests passed\n");
+  return 0;
+}
@@ -0,0 +1,126 @@
+#include "pairs_file.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+
+#ifdef NDEBUG
+#error "Pairs file tests need assertions"
+#endif
+
+// What comes back is laid out like pairs_init() does it, padding and all,
+// and gives the same answer.
+static void test_round_trip(void) {
+  char filename[] = "/tmp/test_pairs_file_XXXXXX";
+  temp_filename(filename);
+
+  const int counts[] = {0, 1, 7, 8, 9, 1000};
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    pairs_t pairs;
+    random_pairs(&pairs, counts[c]);
+    assert(pairs_file_save(filename, &pairs));
+    assert(pairs_file_detect(filename));
+
+    pairs_file_t file;
+    assert(pairs_file_open(&file, filename, true) == PAIRS_FILE_OK);
+    assert(file.pairs.count == counts[c]);
+    size_t capacity = pairs_capacity(counts[c]);
+    assert(file.pairs.y0 == file.pairs.x0 + capacity);
+    const double *columns[4] = {file.pairs.x0, file.pairs.y0, file.pairs.x1,
+                                file.pairs.y1};
+    const double *expected[4] = {pairs.x0, pairs.y0, pairs.x1, pairs.y1};
+    for (int i = 0; i < 4; i++) {
+      assert((uintptr_t)columns[i] % PAIRS_ALIGNMENT == 0);
+      assert(memcmp(columns[i], expected[i], capacity * sizeof(double)) == 0);
+    }
+
+    double answer =
+        average_harvestine(&file.pairs, 2, SUMMATION_DETERMINISTIC);
+    double reference = average_harvestine(&pairs, 1, SUMMATION_DETERMINISTIC);
+    assert(memcmp(&answer, &reference, sizeof(double)) == 0);
+
+    pairs_file_close(&file);
+    assert(file.base == NULL);
+    pairs_free(&pairs);
+  }
+  unlink(filename);
+}
+
+static void corrupt(const char *filename, long offset, int bits) {
+  FILE *file = fopen(filename, "r+b");
+  assert(file != NULL);
+  assert(fseek(file, offset, SEEK_SET) == 0);
+  int byte = fgetc(file);
+  assert(fseek(file, offset, SEEK_SET) == 0);
+  fputc(byte ^ bits, file);
+  fclose(file);
+}
+
+static void test_errors(void) {
+  char filename[] = "/tmp/test_pairs_file_XXXXXX";
+  temp_filename(filename);
+  pairs_t pairs;
+  random_pairs(&pairs, 100);
+  pairs_file_t file;
+
+  // A flipped bit in a column is only caught when asked to.
+  assert(pairs_file_save(filename, &pairs));
+  corrupt(filename, sizeof(pairs_file_header_t) + 3 * 800 + 5, 0x10);
+  assert(pairs_file_open(&file, filename, true) == PAIRS_FILE_BAD_CHECKSUM);
+  assert(pairs_file_open(&file, filename, false) == PAIRS_FILE_OK);
+  pairs_file_close(&file);
+
+  // So is one in the padding.
+  assert(pairs_file_save(filename, &pairs));
+  corrupt(filename, sizeof(pairs_file_header_t) + 103 * sizeof(double),
+          0x10);
+  assert(pairs_file_open(&file, filename, true) == PAIRS_FILE_BAD_CHECKSUM);
+
+  // Two coordinates negated, their sign bits the top bit of their last
+  // byte, in different columns and in the same one.
+  const long columns = sizeof(pairs_file_header_t);
+  const long column = pairs_capacity(100) * sizeof(double);
+  const long signs[][2] = {
+      {columns + 3 * 8 + 7, columns + 3 * column + 7 * 8 + 7},
+      {columns + 3 * 8 + 7, columns + 4 * 8 + 7},
+  };
+  for (int i = 0; i < 2; i++) {
+    assert(pairs_file_save(filename, &pairs));
+    corrupt(filename, signs[i][0], 0x80);
+    corrupt(filename, signs[i][1], 0x80);
+    assert(pairs_file_open(&file, filename, true) ==
+           PAIRS_FILE_BAD_CHECKSUM);
+  }
+
+  // The header has to match the size of the file.
+  assert(pairs_file_save(filename, &pairs));
+  assert(truncate(filename, 1000) == 0);
+  assert(pairs_file_open(&file, filename, false) == PAIRS_FILE_BAD_FORMAT);
+  assert(truncate(filename, 10) == 0);
+  assert(pairs_file_open(&file, filename, false) == PAIRS_FILE_BAD_FORMAT);
+
+  FILE *json = fopen(filename, "w");
+  fputs("{\"pairs\": []}", json);
+  fclose(json);
+  assert(!pairs_file_detect(filename));
+  assert(pairs_file_open(&file, filename, false) == PAIRS_FILE_BAD_FORMAT);
+
+  unlink(filename);
+  assert(!pairs_file_detect(filename));
+  assert(pairs_file_open(&file, filename, false) == PAIRS_FILE_IO_ERROR);
+  assert(errno == ENOENT);
+  pairs_free(&pairs);
+}
+
+int main(void) {
+  test_round_trip();
+  test_errors();
+  printf("all tests passed\n");
+  return 0;
+}
@@ -0,0 +1,176 @@
+#include "pipeline.h"
+
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pairs.h"
+#include "spsc_ring.h"
+
+#ifdef NDEBUG
+#error "Pipeline tests need assertions"
+#endif
+
+#define RING_VALUES 100000
+
+static void *produce(void *arg) {
+  spsc_ring_t *ring = (spsc_ring_t *)arg;
+  for (uint64_t i = 0; i < RING_VALUES; i++) {
+    uint64_t *slot = spsc_ring_begin_push(ring);
+    *slot = i;
+    spsc_ring_end_push(ring);
+  }
+  spsc_ring_close(ring);
+  return NULL;
+}
+
+// Everything arrives, in order, through a ring much smaller than the data.
+static void test_ring(void) {
+  spsc_ring_t ring;
+  assert(spsc_ring_init(&ring, 3, sizeof(uint64_t)));
+  assert(ring.capacity == 4);
+  assert(ring.slot_size == 64);
+
+  pthread_t producer;
+  assert(pthread_create(&producer, NULL, produce, &ring) == 0);
+  uint64_t expected = 0;
+  const uint64_t *slot;
+  while ((slot = spsc_ring_begin_pop(&ring)) != NULL) {
+    assert(*slot == expected);
+    expected++;
+    spsc_ring_end_pop(&ring);
+  }
+  assert(expected == RING_VALUES);
+  pthread_join(producer, NULL);
+  spsc_ring_free(&ring);
+}
+
+static double random_in(double lo, double hi) {
+  return lo + (hi - lo) * ((double)rand() / RAND_MAX);
+}
+
+// Writes count random pairs in the format of the generator, with a few
+// members it doesn't produce thrown in, and loads them as pairs as well.
+static void write_input(const char *filename, int count, pairs_t *pairs) {
+  FILE *file = fopen(filename, "w");
+  assert(file != NULL);
+  assert(pairs_init(pairs, count));
+
+  srand(5);
+  fprintf(file, "{\"name\": \"a } in a string\", \"pairs\":[\n");
+  for (int i = 0; i < count; i++) {
+    double x0 = random_in(-180, 180), y0 = random_in(-90, 90);
+    double x1 = random_in(-180, 180), y1 = random_in(-90, 90);
+    pairs_set(pairs, i, x0, y0, x1, y1);
+    if (i % 7 == 3) {
+      fprintf(file, "  {\"y1\": %.17g, \"note\": \"}\", \"x1\":%.17g, "
+                    "\"y0\":%.17g, \"x0\":%.17g}",
+              y1, x1, y0, x0);
+    } else {
+      fprintf(file,
+              "  {\"x0\":%.17g, \"y0\":%.17g, \"x1\":%.17g, \"y1\":%.17g}",
+              x0, y0, x1, y1);
+    }
+    fprintf(file, i + 1 < count ? ",\n" : "\n");
+  }
+  fprintf(file, "], \"count\": %d}\n", count);
+  fclose(file);
+}
+
+static void write_text(const char *filename, const char *text) {
+  FILE *file = fopen(filename, "w");
+  assert(file != NULL);
+  fputs(text, file);
+  fclose(file);
+}
+
+// The same answer as average_harvestine() for any chunk size, thread count
+// and memory budget, bit for bit in deterministic mode.
+static void test_answer(void) {
+  char filename[] = "/tmp/test_pipeline_XXXXXX";
+  int fd = mkstemp(filename);
+  assert(fd >= 0);
+  close(fd);
+
+  const int counts[] = {0, 1, 4095, 4096, 4097, 20011};
+  const size_t chunks[] = {160, 1000, 4096, PIPELINE_DEFAULT_CHUNK};
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    pairs_t pairs;
+    write_input(filename, counts[c], &pairs);
+
+    for (size_t k = 0; k < sizeof(chunks) / sizeof(chunks[0]); k++) {
+      for (int threads = 1; threads <= 4; threads++) {
+        pipeline_options_t options;
+        pipeline_options_init(&options);
+        options.threads = threads;
+        options.chunk = chunks[k];
+        // Small enough for the rings to fill up.
+        options.memory = 1 << 20;
+
+        pipeline_result_t result;
+        options.summation = SUMMATION_FAST;
+        assert(pipeline_run(filename, &options, &result));
+        assert(result.count == counts[c]);
+        double expected = average_harvestine(&pairs, 1, SUMMATION_FAST);
+        assert(isnan(expected) ? isnan(result.answer)
+                               : fabs(result.answer - expected) < 1e-9);
+
+        options.summation = SUMMATION_DETERMINISTIC;
+        assert(pipeline_run(filename, &options, &result));
+        expected = average_harvestine(&pairs, 1, SUMMATION_DETERMINISTIC);
+        assert(memcmp(&result.answer, &expected, sizeof(double)) == 0);
+      }
+    }
+    pairs_free(&pairs);
+  }
+  unlink(filename);
+}
+
+static void test_errors(void) {
+  const char *inputs[] = {
+      "",
+      "{\"pairs\": [{\"x0\": 1, \"y0\": 2, \"x1\": 3, \"y1\": 4}",
+      "{\"pairs\": [{\"x0\": 1, \"y0\": 2, \"x1\": 3}]}",
+      "{\"pairs\": [{\"x0\": 1, \"y0\": 2, \"x1\": 3, \"y1\": \"4\"}]}",
+      "{\"pairs\": [{\"x0\": 1 \"y0\": 2, \"x1\": 3, \"y1\": 4}]}",
+      "{\"pairs\": {}}",
+      "{\"points\": 1}",
+      "{\"other\": [], \"pairs\": []}",
+      "[]",
+  };
+
+  char filename[] = "/tmp/test_pipeline_XXXXXX";
+  int fd = mkstemp(filename);
+  assert(fd >= 0);
+  close(fd);
+
+  const size_t count = sizeof(inputs) / sizeof(inputs[0]);
+  fprintf(stderr, "expecting %zu errors:\n", count);
+  for (size_t i = 0; i < count; i++) {
+    write_text(filename, inputs[i]);
+    pipeline_options_t options;
+    pipeline_options_init(&options);
+    options.chunk = 64;
+    pipeline_result_t result;
+    assert(!pipeline_run(filename, &options, &result));
+  }
+  unlink(filename);
+
+  pipeline_options_t options;
+  pipeline_options_init(&options);
+  pipeline_result_t result;
+  assert(!pipeline_run("/nonexistent/test_pipeline", &options, &result));
+}
+
+int main(void) {
+  test_ring();
+  test_answer();
+  test_errors();
+  printf("all tests passed\n");
+  return 0;
+}
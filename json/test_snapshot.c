@@ -0,0 +1,151 @@
+#include "json_snapshot.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+
+#ifdef NDEBUG
+#error "Snapshot tests need assertions"
+#endif
+
+static void test_roundtrip(void) {
+  const char *input =
+      "{\"name\": \"snapshot\", \"count\": 9007199254740993, \"ratio\": 0.25, "
+      "\"flags\": [true, false, null], \"empty\": {}, \"none\": [], "
+      "\"pairs\": [{\"x0\": 1.5, \"y0\": -2}, {\"y0\": 3, \"x0\": -4.5}]}";
+  json_object_t json;
+  assert(json_parse(input, &json));
+
+  char filename[] = "/tmp/test_snapshot_XXXXXX";
+  temp_filename(filename);
+
+  assert(json_snapshot_save(filename, json, NULL));
+  json_free(json);
+
+  json_snapshot_t snapshot;
+  assert(json_snapshot_open(&snapshot, filename));
+  unlink(filename);
+
+  json_snapshot_value_t root = json_snapshot_root(&snapshot);
+  assert(json_snapshot_is_dict(root));
+  assert(json_snapshot_dict_len(root) == 7);
+  assert(strcmp(json_snapshot_dict_get_key(root, 0), "name") == 0);
+  assert(strcmp(json_snapshot_dict_get_key(root, 6), "pairs") == 0);
+
+  assert(strcmp(json_snapshot_get_string(json_snapshot_dict_get(root, "name")),
+                "snapshot") == 0);
+  json_snapshot_value_t count = json_snapshot_dict_get(root, "count");
+  assert(json_snapshot_is_integer(count));
+  assert(json_snapshot_get_int64(count) == 9007199254740993LL);
+  assert(json_snapshot_get_number(json_snapshot_dict_get(root, "ratio")) ==
+         0.25);
+
+  json_snapshot_value_t flags = json_snapshot_dict_get(root, "flags");
+  assert(json_snapshot_array_len(flags) == 3);
+  assert(json_snapshot_get_boolean(json_snapshot_array_get(flags, 0)));
+  assert(!json_snapshot_get_boolean(json_snapshot_array_get(flags, 1)));
+  assert(json_snapshot_is_null(json_snapshot_array_get(flags, 2)));
+
+  assert(json_snapshot_dict_len(json_snapshot_dict_get(root, "empty")) == 0);
+  assert(json_snapshot_array_len(json_snapshot_dict_get(root, "none")) == 0);
+
+  assert(!json_snapshot_dict_has_key(root, "missing"));
+  assert(json_snapshot_is_null(json_snapshot_dict_get(root, "missing")));
+  assert(json_snapshot_key_id(&snapshot, "missing") == -1);
+
+  // Keys are interned, so both pairs resolve through the same id.
+  int x0 = json_snapshot_key_id(&snapshot, "x0");
+  assert(x0 >= 0);
+  json_snapshot_value_t pairs = json_snapshot_dict_get(root, "pairs");
+  assert(json_snapshot_get_number(
+             json_snapshot_dict_get_id(json_snapshot_array_get(pairs, 0), x0)) ==
+         1.5);
+  assert(json_snapshot_get_number(
+             json_snapshot_dict_get_id(json_snapshot_array_get(pairs, 1), x0)) ==
+         -4.5);
+  assert(json_snapshot_get_int64(json_snapshot_dict_get(
+             json_snapshot_array_get(pairs, 1), "y0")) == 3);
+
+  json_snapshot_close(&snapshot);
+}
+
+static void test_rejects_other_files(void) {
+  char filename[] = "/tmp/test_snapshot_XXXXXX";
+  int fd = mkstemp(filename);
+  assert(fd >= 0);
+  const char *text = "{\"pairs\": []} and some padding to fill the header";
+  assert(write(fd, text, strlen(text)) == (ssize_t)strlen(text));
+  close(fd);
+
+  json_snapshot_t snapshot;
+  assert(!json_snapshot_open(&snapshot, filename));
+  unlink(filename);
+
+  assert(!json_snapshot_open(&snapshot, "/nonexistent/snapshot"));
+}
+
+// Sets the modification time of filename to sec.nsec.
+static void set_mtime(const char *filename, long sec, long nsec) {
+  struct timespec times[2] = {{sec, nsec}, {sec, nsec}};
+  assert(utimensat(AT_FDCWD, filename, times, 0) == 0);
+}
+
+// A snapshot stays fresh only while its input has the size and the
+// modification time it had, down to the nanosecond.
+static void test_freshness(void) {
+  char input[] = "/tmp/test_snapshot_input_XXXXXX";
+  int fd = mkstemp(input);
+  assert(fd >= 0);
+  assert(write(fd, "[1, 2]", 6) == 6);
+  close(fd);
+  set_mtime(input, 1700000000, 100);
+
+  char filename[] = "/tmp/test_snapshot_XXXXXX";
+  fd = mkstemp(filename);
+  assert(fd >= 0);
+  close(fd);
+  json_object_t json;
+  assert(json_parse("[1, 2]", &json));
+  json_snapshot_source_t source;
+  assert(json_snapshot_source_of(input, &source));
+  assert(source.size == 6 && source.mtime_nsec == 100);
+  assert(json_snapshot_save(filename, json, &source));
+
+  json_snapshot_t snapshot;
+  assert(json_snapshot_open(&snapshot, filename));
+  assert(json_snapshot_is_fresh(&snapshot, input));
+
+  // Rewritten within the same second, with the same size.
+  set_mtime(input, 1700000000, 200);
+  assert(!json_snapshot_is_fresh(&snapshot, input));
+  set_mtime(input, 1700000000, 100);
+  assert(json_snapshot_is_fresh(&snapshot, input));
+  assert(truncate(input, 5) == 0);
+  set_mtime(input, 1700000000, 100);
+  assert(!json_snapshot_is_fresh(&snapshot, input));
+  unlink(input);
+  assert(!json_snapshot_is_fresh(&snapshot, input));
+  json_snapshot_close(&snapshot);
+
+  // Nothing known about the input, never fresh.
+  assert(json_snapshot_save(filename, json, NULL));
+  assert(json_snapshot_open(&snapshot, filename));
+  assert(!json_snapshot_is_fresh(&snapshot, filename));
+  json_snapshot_close(&snapshot);
+  unlink(filename);
+  json_free(json);
+}
+
+int main(void) {
+  test_roundtrip();
+  test_rejects_other_files();
+  test_freshness();
+  printf("all tests passed\n");
+  return 0;
+}
@@ -0,0 +1,219 @@
+#include "spatial_index.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_helpers.h"
+
+#ifdef NDEBUG
+#error "Spatial index tests need assertions"
+#endif
+
+#define COUNT 8000
+#define QUERIES 120
+#define K 25
+// As in test_distance_matrix.c.
+#define MAX_RELATIVE_ERROR 1e-14
+#define MAX_ABSOLUTE_ERROR 1e-11
+#define MAX_ANTIPODAL_ERROR 1e-4
+#define ANTIPODAL_DISTANCE (M_PI * REFERENCE_EARTH_RADIUS - 1000)
+
+static double point_x[COUNT], point_y[COUNT];
+static double query_x[QUERIES], query_y[QUERIES];
+// Every distance from every query, to check against.
+static double distances[QUERIES * COUNT];
+
+// Spread over the sphere, with clusters on the poles and the antimeridian,
+// duplicates, and the queries on and around them too.
+static void random_points(void) {
+  srand(50);
+  for (int i = 0; i < COUNT; i++) {
+    point_x[i] = random_in(-180, 180);
+    point_y[i] = random_in(-90, 90);
+  }
+  for (int i = 0; i < 400; i++) {
+    point_x[i] = random_in(-180, 180);
+    point_y[i] = random_in(89, 90);
+    point_x[400 + i] = random_in(-180, -179.5);
+    point_y[400 + i] = random_in(-30, 30);
+    point_x[800 + i] = random_in(179.5, 180);
+    point_y[800 + i] = random_in(-30, 30);
+  }
+  point_x[1200] = point_x[1201] = 180;
+  point_y[1200] = point_y[1201] = 0;
+  point_x[1202] = -180;
+  point_y[1202] = 0;
+  point_y[1203] = 90;
+  point_y[1204] = -90;
+
+  for (int q = 0; q < QUERIES; q++) {
+    query_x[q] = random_in(-180, 180);
+    query_y[q] = random_in(-90, 90);
+  }
+  const double edges[][2] = {
+      {0, 90}, {0, -90}, {180, 0}, {-180, 0}, {179.9, 10}, {-179.9, -10},
+      {45, 89.9}, {point_x[5], point_y[5]}, {point_x[600], point_y[600]},
+  };
+  for (size_t q = 0; q < sizeof(edges) / sizeof(edges[0]); q++) {
+    query_x[q] = edges[q][0];
+    query_y[q] = edges[q][1];
+  }
+
+  haversine_points_t queries, points;
+  assert(haversine_points_init(&queries, query_x, query_y, QUERIES));
+  assert(haversine_points_init(&points, point_x, point_y, COUNT));
+  distance_matrix(&queries, &points, 1, REFERENCE_EARTH_RADIUS, distances,
+                  COUNT);
+  haversine_points_free(&queries);
+  haversine_points_free(&points);
+}
+
+static int compare_matches(const void *a, const void *b) {
+  const spatial_match_t *x = (const spatial_match_t *)a;
+  const spatial_match_t *y = (const spatial_match_t *)b;
+  if (x->distance != y->distance) {
+    return x->distance < y->distance ? -1 : 1;
+  }
+  return (x->point > y->point) - (x->point < y->point);
+}
+
+// Every point of query q by distance, what the index has to agree with bit
+// for bit.
+static void sorted_distances(int q, spatial_match_t *all) {
+  for (int j = 0; j < COUNT; j++) {
+    all[j] = (spatial_match_t){j, distances[q * COUNT + j]};
+  }
+  qsort(all, COUNT, sizeof(spatial_match_t), compare_matches);
+}
+
+// Field by field, the padding of spatial_match_t isn't set.
+static bool same_matches(const spatial_match_t *a, const spatial_match_t *b,
+                         int n) {
+  for (int i = 0; i < n; i++) {
+    if (a[i].point != b[i].point || a[i].distance != b[i].distance) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void check_within(int q, double radius,
+                         const spatial_matches_t *matches,
+                         const spatial_match_t *all) {
+  int count = 0;
+  while (count < COUNT && all[count].distance <= radius) {
+    count++;
+  }
+  assert(matches->count == count);
+  assert(same_matches(matches->matches, all, count));
+  // And the nearest of them close to reference_haversine().
+  for (int i = 0; i < count && i < 100; i++) {
+    int j = all[i].point;
+    double expected =
+        reference_haversine(query_x[q], query_y[q], point_x[j], point_y[j],
+                            REFERENCE_EARTH_RADIUS);
+    double error = fabs(all[i].distance - expected);
+    assert(expected > ANTIPODAL_DISTANCE
+               ? error <= MAX_ANTIPODAL_ERROR
+               : error <= MAX_RELATIVE_ERROR * expected + MAX_ABSOLUTE_ERROR);
+  }
+}
+
+static void test_queries(const spatial_index_t *index) {
+  static spatial_match_t all[COUNT];
+  static spatial_match_t nearest[K];
+  const double radii[] = {0, 10, 300, 2500, 12000, 30000};
+  const int ks[] = {1, K};
+  spatial_matches_t matches;
+  spatial_matches_init(&matches);
+
+  for (int q = 0; q < QUERIES; q++) {
+    sorted_distances(q, all);
+    for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+      assert(spatial_index_within(index, query_x[q], query_y[q], radii[r],
+                                  &matches));
+      check_within(q, radii[r], &matches, all);
+    }
+    for (size_t i = 0; i < sizeof(ks) / sizeof(ks[0]); i++) {
+      int found;
+      assert(spatial_index_nearest(index, query_x[q], query_y[q], ks[i],
+                                   nearest, &found));
+      assert(found == ks[i]);
+      assert(same_matches(nearest, all, found));
+    }
+  }
+  spatial_matches_free(&matches);
+}
+
+// Any number of threads gives the same as one query at a time.
+static void test_batch(const spatial_index_t *index) {
+  static spatial_match_t all[COUNT];
+  static spatial_match_t nearest[QUERIES * K];
+  static int found[QUERIES];
+  spatial_matches_t results[QUERIES];
+  const double radius = 700;
+
+  for (int threads = 1; threads <= 5; threads++) {
+    for (int q = 0; q < QUERIES; q++) {
+      spatial_matches_init(&results[q]);
+    }
+    assert(spatial_index_within_batch(index, query_x, query_y, QUERIES,
+                                      radius, threads, results));
+    memset(found, 0, sizeof(found));
+    assert(spatial_index_nearest_batch(index, query_x, query_y, QUERIES, K,
+                                       threads, nearest, found));
+    for (int q = 0; q < QUERIES; q++) {
+      sorted_distances(q, all);
+      check_within(q, radius, &results[q], all);
+      assert(found[q] == K);
+      assert(same_matches(nearest + q * K, all, K));
+      spatial_matches_free(&results[q]);
+    }
+  }
+}
+
+// Fewer points than asked for, and none at all.
+static void test_edges(void) {
+  spatial_index_t index;
+  spatial_match_t nearest[K];
+  int found;
+  spatial_matches_t matches;
+  spatial_matches_init(&matches);
+
+  assert(spatial_index_init(&index, point_x, point_y, 0,
+                            REFERENCE_EARTH_RADIUS));
+  assert(spatial_index_nearest(&index, 1, 2, K, nearest, &found));
+  assert(found == 0);
+  assert(spatial_index_within(&index, 1, 2, 30000, &matches));
+  assert(matches.count == 0);
+  spatial_index_free(&index);
+
+  assert(spatial_index_init(&index, point_x, point_y, 7,
+                            REFERENCE_EARTH_RADIUS));
+  assert(index.bands == 1);
+  assert(spatial_index_nearest(&index, 1, 2, K, nearest, &found));
+  assert(found == 7);
+  for (int i = 1; i < found; i++) {
+    assert(nearest[i - 1].distance <= nearest[i].distance);
+  }
+  spatial_index_free(&index);
+  spatial_matches_free(&matches);
+}
+
+int main(void) {
+  random_points();
+  spatial_index_t index;
+  assert(spatial_index_init(&index, point_x, point_y, COUNT,
+                            REFERENCE_EARTH_RADIUS));
+  assert(index.cell_starts[index.bands * index.columns] == COUNT);
+  test_queries(&index);
+  test_batch(&index);
+  spatial_index_free(&index);
+  test_edges();
+  printf("all tests passed\n");
+  return 0;
+}
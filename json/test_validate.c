@@ -0,0 +1,114 @@
+#include "json_validate.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef NDEBUG
+#error "Validation tests need assertions"
+#endif
+
+static void expect_valid(const char *input) {
+  size_t offset = 0;
+  if (!json_validate(input, strlen(input), &offset)) {
+    fprintf(stderr, "expected valid: %s (error at %zu)\n", input, offset);
+    assert(false);
+  }
+}
+
+static void expect_invalid(const char *input, size_t expected_offset) {
+  size_t offset = 0;
+  if (json_validate(input, strlen(input), &offset)) {
+    fprintf(stderr, "expected invalid: %s\n", input);
+    assert(false);
+  }
+  if (offset != expected_offset) {
+    fprintf(stderr, "%s: error at %zu, expected %zu\n", input, offset,
+            expected_offset);
+    assert(false);
+  }
+}
+
+static void test_values(void) {
+  expect_valid("{}");
+  expect_valid("[]");
+  expect_valid(" \t\r\n{ } ");
+  expect_valid("{\"pairs\":[\n    {\"x0\":-12.5, \"y0\":0.25, \"x1\":1e3, "
+               "\"y1\":-2E-7}\n]}\n");
+  expect_valid("[true, false, null, \"\", [[]], {\"a\": {}}]");
+  expect_valid("\"string\"");
+  expect_valid("-0");
+
+  expect_invalid("", 0);
+  expect_invalid("{", 1);
+  expect_invalid("[1, 2", 5);
+  expect_invalid("[1, 2,]", 6);
+  expect_invalid("[1 2]", 3);
+  expect_invalid("{\"a\" 1}", 5);
+  expect_invalid("{\"a\": 1,}", 8);
+  expect_invalid("{1: 2}", 1);
+  expect_invalid("[}", 1);
+  expect_invalid("{]", 1);
+  expect_invalid("tru", 3);
+  expect_invalid("nul1", 3);
+  expect_invalid("{} {}", 3);
+}
+
+static void test_numbers(void) {
+  expect_valid("0");
+  expect_valid("123");
+  expect_valid("-1.5e+10");
+  expect_valid("3.14159");
+
+  expect_invalid("01", 1);
+  expect_invalid("-", 1);
+  expect_invalid("+1", 0);
+  expect_invalid("1.", 2);
+  expect_invalid(".5", 0);
+  expect_invalid("1e", 2);
+  expect_invalid("1e+", 3);
+  expect_invalid("1-2", 1);
+  expect_invalid("--1", 1);
+}
+
+static void test_strings(void) {
+  expect_valid("\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\"");
+  expect_valid("\"a long string that takes the eight bytes at a time path\"");
+  expect_valid("\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80\"");
+
+  expect_invalid("\"unterminated", 13);
+  expect_invalid("\"\\x\"", 2);
+  expect_invalid("\"\\u12g4\"", 5);
+  expect_invalid("\"tab\there\"", 4);
+  // Overlong encoding, stray continuation byte, surrogate, > U+10FFFF.
+  expect_invalid("\"\xc0\xaf\"", 1);
+  expect_invalid("\"abc\x80\"", 4);
+  expect_invalid("\"\xed\xa0\x80\"", 2);
+  expect_invalid("\"\xf4\x90\x80\x80\"", 2);
+  expect_invalid("\"\xe2\x82\"", 3);
+}
+
+static void test_depth(void) {
+  char input[2 * (JSON_VALIDATE_MAX_DEPTH + 1) + 1];
+
+  for (int i = 0; i < JSON_VALIDATE_MAX_DEPTH; i++) {
+    input[i] = '[';
+    input[JSON_VALIDATE_MAX_DEPTH + i] = ']';
+  }
+  input[2 * JSON_VALIDATE_MAX_DEPTH] = '\0';
+  expect_valid(input);
+
+  memset(input, '[', JSON_VALIDATE_MAX_DEPTH + 1);
+  memset(input + JSON_VALIDATE_MAX_DEPTH + 1, ']', JSON_VALIDATE_MAX_DEPTH + 1);
+  input[2 * (JSON_VALIDATE_MAX_DEPTH + 1)] = '\0';
+  expect_invalid(input, JSON_VALIDATE_MAX_DEPTH);
+}
+
+int main(void) {
+  test_values();
+  test_numbers();
+  test_strings();
+  test_depth();
+  printf("all tests passed\n");
+  return 0;
+}
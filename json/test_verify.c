@@ -0,0 +1,196 @@
+#include "verify.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "harvestine.h"
+#include "test_helpers.h"
+
+#ifdef NDEBUG
+#error "Verify tests need assertions"
+#endif
+
+#define COUNT 5000
+
+static void write_doubles(const char *filename, const double *values,
+                          size_t n) {
+  FILE *file = fopen(filename, "wb");
+  assert(file != NULL);
+  assert(fwrite(values, sizeof(double), n, file) == n);
+  fclose(file);
+}
+
+// Answers computed by the kernels themselves, then a few of them moved by
+// known amounts: the errors found have to be exactly those, wherever the
+// thread boundaries fall.
+static void test_errors(void) {
+  pairs_t pairs;
+  srand(3);
+  random_pairs(&pairs, COUNT);
+
+  double *expected = malloc((COUNT + 1) * sizeof(double));
+  double sum = haversine_batch(pairs.x0, pairs.y0, pairs.x1, pairs.y1, COUNT,
+                               REFERENCE_EARTH_RADIUS, expected);
+  expected[COUNT] = sum / COUNT;
+  expected[700] += 0.5;
+  expected[2600] -= 2.0;
+  expected[4999] += 1e-6;
+  expected[3000] = NAN;
+
+  char filename[] = "/tmp/test_verify_XXXXXX";
+  temp_filename(filename);
+  write_doubles(filename, expected, COUNT + 1);
+
+  answers_t answers;
+  assert(answers_open(&answers, filename));
+  assert(answers.count == COUNT);
+  assert(answers.average == sum / COUNT);
+
+  for (int threads = 1; threads <= 5; threads++) {
+    verify_result_t result;
+    assert(verify_distances(&pairs, &answers, threads, 1e-3, &result));
+    assert(result.count == COUNT);
+    assert(isinf(result.max_error));
+    assert(result.max_index == 3000);
+    assert(result.mismatches == 3);
+    assert(result.first_mismatch == 700);
+    assert(result.p50_error == 0);
+    assert(result.p99_error == 0);
+    assert(result.p999_error == 0);
+
+    assert(verify_distances(&pairs, &answers, threads, INFINITY, &result));
+    assert(result.mismatches == 0);
+    assert(result.first_mismatch == -1);
+  }
+  answers_close(&answers);
+
+  // Without the NaN the mean is exact up to rounding.
+  expected[3000] = 0;
+  haversine_batch(pairs.x0 + 3000, pairs.y0 + 3000, pairs.x1 + 3000,
+                  pairs.y1 + 3000, 1, REFERENCE_EARTH_RADIUS, &expected[3000]);
+  write_doubles(filename, expected, COUNT + 1);
+  assert(answers_open(&answers, filename));
+  verify_result_t result;
+  assert(verify_distances(&pairs, &answers, 3, 0, &result));
+  assert(result.max_error == 2.0);
+  assert(result.max_index == 2600);
+  assert(result.first_mismatch == 700);
+  assert(result.mismatches == 3);
+  assert(fabs(result.mean_error - (2.5 + 1e-6) / COUNT) < 1e-12);
+  answers_close(&answers);
+
+  // Errors spread evenly up to 1 m: the percentiles are the upper bounds
+  // of the bins the exact ones fall into.
+  for (int i = 0; i < COUNT; i++) {
+    haversine_batch(pairs.x0 + i, pairs.y0 + i, pairs.x1 + i, pairs.y1 + i, 1,
+                    REFERENCE_EARTH_RADIUS, &expected[i]);
+    expected[i] += 1e-3 * (i + 1) / COUNT;
+  }
+  write_doubles(filename, expected, COUNT + 1);
+  assert(answers_open(&answers, filename));
+  assert(verify_distances(&pairs, &answers, 4, 1e-3, &result));
+  const double exact[3] = {0.5e-3, 0.99e-3, 0.999e-3};
+  const double found[3] = {result.p50_error, result.p99_error,
+                           result.p999_error};
+  for (int i = 0; i < 3; i++) {
+    assert(found[i] >= exact[i] * (1 - 1e-9));
+    assert(found[i] <= exact[i] * 1.125 || found[i] == result.max_error);
+  }
+  assert(result.max_index == COUNT - 1);
+  assert(fabs(result.max_error - 1e-3) < 1e-12);
+  answers_close(&answers);
+
+  unlink(filename);
+  free(expected);
+  pairs_free(&pairs);
+}
+
+static void test_empty(void) {
+  char filename[] = "/tmp/test_verify_XXXXXX";
+  temp_filename(filename);
+  double average = 0;
+  write_doubles(filename, &average, 1);
+
+  pairs_t pairs;
+  assert(pairs_init(&pairs, 0));
+  answers_t answers;
+  assert(answers_open(&answers, filename));
+  assert(answers.count == 0);
+  verify_result_t result;
+  assert(verify_distances(&pairs, &answers, 2, 0, &result));
+  assert(result.max_index == -1);
+  assert(result.first_mismatch == -1);
+  assert(result.mean_error == 0);
+  answers_close(&answers);
+  pairs_free(&pairs);
+
+  // Not a whole number of doubles.
+  assert(truncate(filename, 12) == 0);
+  assert(!answers_open(&answers, filename));
+  assert(errno == EINVAL);
+  assert(truncate(filename, 0) == 0);
+  assert(!answers_open(&answers, filename));
+  assert(errno == EINVAL);
+
+  unlink(filename);
+  assert(!answers_open(&answers, filename));
+  assert(errno == ENOENT);
+}
+
+// Distances written by the threads that compute them read back as the
+// answers, bit for bit, in place of a longer file that was there before.
+static void test_emit(void) {
+  pairs_t pairs;
+  srand(5);
+  random_pairs(&pairs, COUNT);
+  double *expected = malloc(2 * COUNT * sizeof(double));
+  haversine_batch(pairs.x0, pairs.y0, pairs.x1, pairs.y1, COUNT,
+                  REFERENCE_EARTH_RADIUS, expected);
+
+  char filename[] = "/tmp/test_verify_XXXXXX";
+  temp_filename(filename);
+  for (int threads = 1; threads <= 5; threads++) {
+    summation_t summation =
+        threads % 2 ? SUMMATION_DETERMINISTIC : SUMMATION_FAST;
+    write_doubles(filename, expected, 2 * COUNT);
+
+    answers_writer_t writer;
+    assert(answers_create(&writer, filename, COUNT));
+    pairs_outputs_t outputs = {NULL, writer.distances};
+    double average;
+    assert(average_harvestine_into(&pairs, threads, summation, &average,
+                                   &outputs));
+    answers_finish(&writer, average);
+    assert(average == average_harvestine(&pairs, threads, summation));
+
+    answers_t answers;
+    assert(answers_open(&answers, filename));
+    assert(answers.count == COUNT);
+    assert(memcmp(answers.distances, expected, COUNT * sizeof(double)) == 0);
+    assert(answers.average == average);
+    verify_result_t result;
+    assert(verify_distances(&pairs, &answers, threads, 0, &result));
+    assert(result.max_error == 0 && result.mismatches == 0);
+    answers_close(&answers);
+  }
+  unlink(filename);
+
+  answers_writer_t writer;
+  assert(!answers_create(&writer, "/nonexistent/distances.f64", COUNT));
+  assert(errno == ENOENT);
+  free(expected);
+  pairs_free(&pairs);
+}
+
+int main(void) {
+  test_errors();
+  test_empty();
+  test_emit();
+  printf("all tests passed\n");
+  return 0;
+}
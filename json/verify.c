@@ -0,0 +1,273 @@
+#include "verify.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool answers_open(answers_t *answers, const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return false;
+  }
+  size_t size = (size_t)st.st_size;
+  if (size < sizeof(double) || size % sizeof(double) != 0 ||
+      size / sizeof(double) - 1 > INT32_MAX) {
+    close(fd);
+    errno = EINVAL;
+    return false;
+  }
+
+  void *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed.
+  int error = errno;
+  close(fd);
+  if (base == MAP_FAILED) {
+    errno = error;
+    return false;
+  }
+  madvise(base, size, MADV_WILLNEED);
+
+  answers->base = (const char *)base;
+  answers->size = size;
+  answers->distances = (const double *)base;
+  answers->count = (int)(size / sizeof(double) - 1);
+  answers->average = answers->distances[answers->count];
+  return true;
+}
+
+void answers_close(answers_t *answers) {
+  if (answers->base != NULL) {
+    munmap((void *)answers->base, answers->size);
+  }
+  answers->base = NULL;
+  answers->distances = NULL;
+  answers->size = 0;
+  answers->count = 0;
+}
+
+bool answers_create(answers_writer_t *writer, const char *filename,
+                    int count) {
+  int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  size_t size = ((size_t)count + 1) * sizeof(double);
+  // Blocks allocated now rather than on first touch of the mapping, where
+  // running out of space would be a SIGBUS.
+  int error = posix_fallocate(fd, 0, (off_t)size);
+  if (error != 0) {
+    close(fd);
+    errno = error;
+    return false;
+  }
+
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  error = errno;
+  close(fd);
+  if (base == MAP_FAILED) {
+    errno = error;
+    return false;
+  }
+  writer->base = (char *)base;
+  writer->size = size;
+  writer->distances = (double *)base;
+  writer->count = count;
+  return true;
+}
+
+void answers_finish(answers_writer_t *writer, double average) {
+  writer->distances[writer->count] = average;
+  munmap(writer->base, writer->size);
+  writer->base = NULL;
+  writer->distances = NULL;
+  writer->size = 0;
+  writer->count = 0;
+}
+
+// The histogram bin of an error: 0 below 2^VERIFY_MIN_EXPONENT, then
+// VERIFY_BINS_PER_OCTAVE per power of two, from the exponent and the top
+// mantissa bits.
+static int error_bin(double error) {
+  uint64_t bits;
+  memcpy(&bits, &error, sizeof(bits));
+  int exponent = (int)((bits >> 52) & 0x7ff) - 1023;
+  int fraction = (int)((bits >> 49) & (VERIFY_BINS_PER_OCTAVE - 1));
+  if (exponent < VERIFY_MIN_EXPONENT) {
+    return 0;
+  }
+  if (exponent >= VERIFY_MAX_EXPONENT) {
+    return VERIFY_BINS - 1;
+  }
+  return (exponent - VERIFY_MIN_EXPONENT) * VERIFY_BINS_PER_OCTAVE + fraction +
+         1;
+}
+
+static double bin_upper_bound(int bin) {
+  if (bin == 0) {
+    return 0;
+  }
+  int exponent = VERIFY_MIN_EXPONENT + (bin - 1) / VERIFY_BINS_PER_OCTAVE;
+  int fraction = (bin - 1) % VERIFY_BINS_PER_OCTAVE;
+  return ldexp(1 + (fraction + 1) / (double)VERIFY_BINS_PER_OCTAVE, exponent);
+}
+
+// One thread's share, the blocks [first_block, end_block).
+typedef struct {
+  _Alignas(64) const pairs_t *pairs;
+  const double *expected;
+  int first_block;
+  int end_block;
+  double tolerance;
+
+  double error_sum;
+  double max_error;
+  int max_index;
+  int mismatches;
+  int first_mismatch;
+  uint64_t histogram[VERIFY_BINS];
+} share_t;
+
+static void *run_share(void *arg) {
+  share_t *share = (share_t *)arg;
+  const pairs_t *pairs = share->pairs;
+  _Alignas(64) double distances[SUMMATION_BLOCK];
+  _Alignas(64) double errors[SUMMATION_BLOCK];
+
+  for (int b = share->first_block; b < share->end_block; b++) {
+    int first = b * SUMMATION_BLOCK;
+    int n = pairs->count - first < SUMMATION_BLOCK ? pairs->count - first
+                                                   : SUMMATION_BLOCK;
+    pairs_distances(pairs, first, n, distances);
+
+    // The errors and their maximum by the kernels in use, their sum the
+    // same way as the distances'.
+    double block_max = haversine_kernels.errors(
+        distances, share->expected + first, n, errors);
+    share->error_sum += pairwise_sum(errors, n);
+
+    for (int i = 0; i < n; i++) {
+      share->histogram[error_bin(errors[i])]++;
+    }
+    // Only the rare blocks with something to report are searched.
+    if (block_max > share->max_error || share->max_index < 0) {
+      for (int i = 0; i < n; i++) {
+        if (errors[i] == block_max) {
+          share->max_error = block_max;
+          share->max_index = first + i;
+          break;
+        }
+      }
+    }
+    if (block_max > share->tolerance) {
+      for (int i = 0; i < n; i++) {
+        if (errors[i] > share->tolerance) {
+          if (share->first_mismatch < 0) {
+            share->first_mismatch = first + i;
+          }
+          share->mismatches++;
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+// The upper bound of the bin where the histogram reaches fraction of count.
+static double percentile(const uint64_t *histogram, int count,
+                         double fraction) {
+  uint64_t rank = (uint64_t)ceil(fraction * count);
+  uint64_t seen = 0;
+  for (int bin = 0; bin < VERIFY_BINS; bin++) {
+    seen += histogram[bin];
+    if (seen >= rank && seen > 0) {
+      return bin_upper_bound(bin);
+    }
+  }
+  return 0;
+}
+
+bool verify_distances(const pairs_t *pairs, const answers_t *answers,
+                      int threads, double tolerance, verify_result_t *result) {
+  assert(1 <= threads && threads <= PARALLEL_MAX_THREADS);
+  assert(pairs->count == answers->count);
+
+  // With their histograms, too large for the stack.
+  share_t *shares =
+      aligned_alloc(_Alignof(share_t), threads * sizeof(share_t));
+  if (shares == NULL) {
+    return false;
+  }
+
+  int blocks = pairs_blocks(pairs);
+  for (int t = 0; t < threads; t++) {
+    share_t *share = &shares[t];
+    share->pairs = pairs;
+    share->expected = answers->distances;
+    share->first_block = parallel_split(blocks, threads, t);
+    share->end_block = parallel_split(blocks, threads, t + 1);
+    share->tolerance = tolerance;
+    share->error_sum = 0;
+    share->max_error = 0;
+    share->max_index = -1;
+    share->mismatches = 0;
+    share->first_mismatch = -1;
+    memset(share->histogram, 0, sizeof(share->histogram));
+  }
+  run_parallel(shares, sizeof(share_t), threads, run_share);
+
+  // Shares are in index order, so the first one with a mismatch has the
+  // first mismatch, and ties for the maximum go to the lowest index.
+  uint64_t histogram[VERIFY_BINS] = {0};
+  double error_sum = 0;
+  result->count = pairs->count;
+  result->max_error = 0;
+  result->max_index = -1;
+  result->mismatches = 0;
+  result->first_mismatch = -1;
+  for (int t = 0; t < threads; t++) {
+    const share_t *share = &shares[t];
+    error_sum += share->error_sum;
+    if (share->max_index >= 0 &&
+        (result->max_index < 0 || share->max_error > result->max_error)) {
+      result->max_error = share->max_error;
+      result->max_index = share->max_index;
+    }
+    if (result->first_mismatch < 0) {
+      result->first_mismatch = share->first_mismatch;
+    }
+    result->mismatches += share->mismatches;
+    for (int bin = 0; bin < VERIFY_BINS; bin++) {
+      histogram[bin] += share->histogram[bin];
+    }
+  }
+
+  result->mean_error = pairs->count > 0 ? error_sum / pairs->count : 0;
+  result->p50_error = percentile(histogram, pairs->count, 0.5);
+  result->p99_error = percentile(histogram, pairs->count, 0.99);
+  result->p999_error = percentile(histogram, pairs->count, 0.999);
+  // The bins are coarser than the maximum, which is exact.
+  double *bounds[3] = {&result->p50_error, &result->p99_error,
+                       &result->p999_error};
+  for (int i = 0; i < 3; i++) {
+    if (*bounds[i] > result->max_error) {
+      *bounds[i] = result->max_error;
+    }
+  }
+
+  free(shares);
+  return true;
+}
@@ -0,0 +1,86 @@
+#ifndef VERIFY_H_
+#define VERIFY_H_
+
+// Checks computed distances against the answer file the generator writes
+// next to the input, pair by pair. The distances are computed again by the
+// kernels in use, block by block on several threads, and only the error
+// statistics are kept, so the whole data set can be checked at about the
+// cost of a run. Also writes answer files of our own, see
+// answers_create().
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pairs.h"
+
+// In km. Enough for the approximations in harvestine_math.h away from
+// antipodal points, see harvestine.h.
+#define VERIFY_DEFAULT_TOLERANCE 1e-9
+
+// The error histogram has this many bins per power of two, which is how
+// close the percentiles are to the exact ones: within 2^(1/8), about 9%.
+#define VERIFY_BINS_PER_OCTAVE 8
+// Errors below 2^VERIFY_MIN_EXPONENT count as 0, errors of
+// 2^VERIFY_MAX_EXPONENT and above go into the last bin.
+#define VERIFY_MIN_EXPONENT (-80)
+#define VERIFY_MAX_EXPONENT 16
+#define VERIFY_BINS                                                            \
+  ((VERIFY_MAX_EXPONENT - VERIFY_MIN_EXPONENT) * VERIFY_BINS_PER_OCTAVE + 1)
+
+// The answer file: a double per pair, then their mean. Mapped read-only.
+typedef struct {
+  const char *base;
+  size_t size;
+  const double *distances;
+  int count;
+  double average;
+} answers_t;
+
+// Returns false and sets errno on failure, EINVAL if the size isn't a
+// whole number of doubles, at least one.
+bool answers_open(answers_t *answers, const char *filename);
+void answers_close(answers_t *answers);
+
+// An answer file being written: sized for count distances and their mean
+// up front and mapped shared, so that the threads computing the distances
+// can store them right into it, each its own range.
+typedef struct {
+  char *base;
+  size_t size;
+  double *distances;
+  int count;
+} answers_writer_t;
+
+// Creates or truncates filename. Returns false and sets errno on failure,
+// ENOSPC included, which is found out here rather than by a fault while
+// writing.
+bool answers_create(answers_writer_t *writer, const char *filename,
+                    int count);
+// Stores the mean after the distances and unmaps the file, which the
+// kernel writes back in its own time.
+void answers_finish(answers_writer_t *writer, double average);
+
+typedef struct {
+  int count;
+  // Absolute errors, in km. NaN where either side is NaN counts as an
+  // infinite error.
+  double max_error;
+  int max_index; // -1 if there are no pairs
+  double mean_error;
+  // Upper bounds of the histogram bins the percentiles fall into.
+  double p50_error;
+  double p99_error;
+  double p999_error;
+  // Pairs off by more than the tolerance.
+  int mismatches;
+  int first_mismatch; // -1 if none
+} verify_result_t;
+
+// Compares the distances of pairs with answers, split across the given
+// number of threads like average_harvestine(). Both have to have the same
+// count. Returns false if out of memory.
+bool verify_distances(const pairs_t *pairs, const answers_t *answers,
+                      int threads, double tolerance, verify_result_t *result);
+
+#endif // VERIFY_H_